@@ -317,6 +317,7 @@ static void UART_Console_Init(void)
     {
         STM32_Error_Handler();
     }
+    UART_Console_DMA_Init();
 }
 
 static int val;
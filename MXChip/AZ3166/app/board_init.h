@@ -29,5 +29,6 @@ extern UART_HandleTypeDef UartHandle;
 
 /* Define prototypes. */
 void board_init(void);
+void UART_Console_DMA_Init(void);
 
 #endif // _BOARD_INIT_H
@@ -15,13 +15,14 @@
 #include "nx_azure_iot_provisioning_client.h"
 
 #include "azure_iot_nx_client.h"
+#include "window_stats.h"
 
 #include "azure_config.h"
 #include "azure_device_x509_cert_config.h"
 #include "azure_pnp_info.h"
 #include "wwd_networking.h"
 
-#define IOT_MODEL_ID "dtmi:azurertos:devkit:gsgmxchip;2"
+#define IOT_MODEL_ID "dtmi:azurertos:devkit:gsgmxchip;3"
 
 // Device telemetry names
 #define TELEMETRY_HUMIDITY          "humidity"
@@ -38,6 +39,23 @@
 #define TELEMETRY_GYROSCOPEZ        "gyroscopeZ"
 #define TELEMETRY_INTERVAL_PROPERTY "telemetryInterval"
 
+// Each telemetry value is the mean of the samples since the last message, the other
+// window statistics are sent along with these suffixes
+#define TELEMETRY_MIN_SUFFIX        "Min"
+#define TELEMETRY_MAX_SUFFIX        "Max"
+#define TELEMETRY_RMS_SUFFIX        "Rms"
+#define TELEMETRY_COUNT_SUFFIX      "Count"
+
+// Telemetry streams, each can be scheduled with the "<stream>Interval" and "<stream>Phase"
+// writable properties; telemetryInterval sets the interval of all of them
+#define STREAM_ENVIRONMENT          "environment"
+#define STREAM_MAGNETOMETER         "magnetometer"
+#define STREAM_ACCELEROMETER        "accelerometer"
+#define STREAM_GYROSCOPE            "gyroscope"
+
+// How often the sensors are sampled into the windows
+#define SAMPLE_INTERVAL_TICKS       (TX_TIMER_TICKS_PER_SECOND / 2)
+
 // Properties
 #define LED_STATE_PROPERTY          "ledState"
 
@@ -45,19 +63,46 @@
 #define SET_LED_STATE_COMMAND       "setLedState"
 #define SET_DISPLAY_TEXT_COMMAND    "setDisplayText"
 
-typedef enum TELEMETRY_STATE_ENUM
+typedef enum SENSOR_CHANNEL_ENUM
 {
-    TELEMETRY_STATE_DEFAULT,
-    TELEMETRY_STATE_MAGNETOMETER,
-    TELEMETRY_STATE_ACCELEROMETER,
-    TELEMETRY_STATE_GYROSCOPE,
-    TELEMETRY_STATE_END
-} TELEMETRY_STATE;
+    CHANNEL_HUMIDITY,
+    CHANNEL_TEMPERATURE,
+    CHANNEL_PRESSURE,
+    CHANNEL_MAGNETOMETERX,
+    CHANNEL_MAGNETOMETERY,
+    CHANNEL_MAGNETOMETERZ,
+    CHANNEL_ACCELEROMETERX,
+    CHANNEL_ACCELEROMETERY,
+    CHANNEL_ACCELEROMETERZ,
+    CHANNEL_GYROSCOPEX,
+    CHANNEL_GYROSCOPEY,
+    CHANNEL_GYROSCOPEZ,
+    CHANNEL_COUNT
+} SENSOR_CHANNEL;
+
+static const CHAR* channel_names[CHANNEL_COUNT] = {
+    TELEMETRY_HUMIDITY,
+    TELEMETRY_TEMPERATURE,
+    TELEMETRY_PRESSURE,
+    TELEMETRY_MAGNETOMETERX,
+    TELEMETRY_MAGNETOMETERY,
+    TELEMETRY_MAGNETOMETERZ,
+    TELEMETRY_ACCELEROMETERX,
+    TELEMETRY_ACCELEROMETERY,
+    TELEMETRY_ACCELEROMETERZ,
+    TELEMETRY_GYROSCOPEX,
+    TELEMETRY_GYROSCOPEY,
+    TELEMETRY_GYROSCOPEZ,
+};
 
 static AZURE_IOT_NX_CONTEXT azure_iot_nx_client;
 
 static int32_t telemetry_interval = 10;
 
+// samples since the channel was last sent; only used from the Azure IoT thread
+static WINDOW_STATS windows[CHANNEL_COUNT];
+static TX_TIMER sample_timer;
+
 static UINT append_device_info_properties(NX_AZURE_IOT_JSON_WRITER* json_writer)
 {
     if (nx_azure_iot_json_writer_append_property_with_string_value(json_writer,
@@ -107,22 +152,21 @@ static UINT append_device_info_properties(NX_AZURE_IOT_JSON_WRITER* json_writer)
     return NX_AZURE_IOT_SUCCESS;
 }
 
-static UINT append_device_telemetry(NX_AZURE_IOT_JSON_WRITER* json_writer)
+// name followed by suffix; returns the length, or 0 when it doesn't fit
+static UINT stat_name(CHAR* property, UINT size, const CHAR* name, const CHAR* suffix)
 {
-    lps22hb_t lps22hb_data    = lps22hb_data_read();
-    hts221_data_t hts221_data = hts221_data_read();
+    INT length = snprintf(property, size, "%s%s", name, suffix);
 
-    if (nx_azure_iot_json_writer_append_property_with_double_value(
-            json_writer, (UCHAR*)TELEMETRY_HUMIDITY, sizeof(TELEMETRY_HUMIDITY) - 1, hts221_data.humidity_perc, 2) ||
+    return length > 0 && length < size ? length : 0;
+}
 
-        nx_azure_iot_json_writer_append_property_with_double_value(json_writer,
-            (UCHAR*)TELEMETRY_TEMPERATURE,
-            sizeof(TELEMETRY_TEMPERATURE) - 1,
-            lps22hb_data.temperature_degC,
-            2) ||
+static UINT append_stat(NX_AZURE_IOT_JSON_WRITER* json_writer, const CHAR* name, const CHAR* suffix, double value)
+{
+    CHAR property[32];
+    UINT length = stat_name(property, sizeof(property), name, suffix);
 
-        nx_azure_iot_json_writer_append_property_with_double_value(
-            json_writer, (UCHAR*)TELEMETRY_PRESSURE, sizeof(TELEMETRY_PRESSURE) - 1, lps22hb_data.pressure_hPa, 2))
+    if (length == 0 ||
+        nx_azure_iot_json_writer_append_property_with_double_value(json_writer, (UCHAR*)property, length, value, 2))
     {
         return NX_NOT_SUCCESSFUL;
     }
@@ -130,27 +174,13 @@ static UINT append_device_telemetry(NX_AZURE_IOT_JSON_WRITER* json_writer)
     return NX_AZURE_IOT_SUCCESS;
 }
 
-static UINT append_device_telemetry_magnetometer(NX_AZURE_IOT_JSON_WRITER* json_writer)
+static UINT append_count(NX_AZURE_IOT_JSON_WRITER* json_writer, const CHAR* name, uint32_t count)
 {
-    lis2mdl_data_t lis2mdl_data = lis2mdl_data_read();
-
-    if (nx_azure_iot_json_writer_append_property_with_double_value(json_writer,
-            (UCHAR*)TELEMETRY_MAGNETOMETERX,
-            sizeof(TELEMETRY_MAGNETOMETERX) - 1,
-            lis2mdl_data.magnetic_mG[0],
-            2) ||
+    CHAR property[32];
+    UINT length = stat_name(property, sizeof(property), name, TELEMETRY_COUNT_SUFFIX);
 
-        nx_azure_iot_json_writer_append_property_with_double_value(json_writer,
-            (UCHAR*)TELEMETRY_MAGNETOMETERY,
-            sizeof(TELEMETRY_MAGNETOMETERY) - 1,
-            lis2mdl_data.magnetic_mG[1],
-            2) ||
-
-        nx_azure_iot_json_writer_append_property_with_double_value(json_writer,
-            (UCHAR*)TELEMETRY_MAGNETOMETERZ,
-            sizeof(TELEMETRY_MAGNETOMETERZ) - 1,
-            lis2mdl_data.magnetic_mG[2],
-            2))
+    if (length == 0 ||
+        nx_azure_iot_json_writer_append_property_with_int32_value(json_writer, (UCHAR*)property, length, count))
     {
         return NX_NOT_SUCCESSFUL;
     }
@@ -158,60 +188,77 @@ static UINT append_device_telemetry_magnetometer(NX_AZURE_IOT_JSON_WRITER* json_
     return NX_AZURE_IOT_SUCCESS;
 }
 
-static UINT append_device_telemetry_accelerometer(NX_AZURE_IOT_JSON_WRITER* json_writer)
+// Appends the statistics of the channels from first to last, and starts new windows for them.
+// Channels without samples are left out.
+static UINT append_windows(NX_AZURE_IOT_JSON_WRITER* json_writer, SENSOR_CHANNEL first, SENSOR_CHANNEL last)
 {
-    lsm6dsl_data_t lsm6dsl_data = lsm6dsl_data_read();
+    WINDOW_SUMMARY summary;
 
-    if (nx_azure_iot_json_writer_append_property_with_double_value(json_writer,
-            (UCHAR*)TELEMETRY_ACCELEROMETERX,
-            sizeof(TELEMETRY_ACCELEROMETERX) - 1,
-            lsm6dsl_data.acceleration_mg[0],
-            2) ||
+    for (SENSOR_CHANNEL channel = first; channel <= last; channel++)
+    {
+        const CHAR* name = channel_names[channel];
 
-        nx_azure_iot_json_writer_append_property_with_double_value(json_writer,
-            (UCHAR*)TELEMETRY_ACCELEROMETERY,
-            sizeof(TELEMETRY_ACCELEROMETERY) - 1,
-            lsm6dsl_data.acceleration_mg[1],
-            2) ||
+        if (!window_stats_take(&windows[channel], &summary))
+        {
+            continue;
+        }
 
-        nx_azure_iot_json_writer_append_property_with_double_value(json_writer,
-            (UCHAR*)TELEMETRY_ACCELEROMETERZ,
-            sizeof(TELEMETRY_ACCELEROMETERZ) - 1,
-            lsm6dsl_data.acceleration_mg[2],
-            2))
-    {
-        return NX_NOT_SUCCESSFUL;
+        if (append_stat(json_writer, name, "", summary.mean) ||
+            append_stat(json_writer, name, TELEMETRY_MIN_SUFFIX, summary.min) ||
+            append_stat(json_writer, name, TELEMETRY_MAX_SUFFIX, summary.max) ||
+            append_stat(json_writer, name, TELEMETRY_RMS_SUFFIX, summary.rms) ||
+            append_count(json_writer, name, summary.count))
+        {
+            return NX_NOT_SUCCESSFUL;
+        }
     }
 
     return NX_AZURE_IOT_SUCCESS;
 }
 
+static UINT append_device_telemetry(NX_AZURE_IOT_JSON_WRITER* json_writer)
+{
+    return append_windows(json_writer, CHANNEL_HUMIDITY, CHANNEL_PRESSURE);
+}
+
+static UINT append_device_telemetry_magnetometer(NX_AZURE_IOT_JSON_WRITER* json_writer)
+{
+    return append_windows(json_writer, CHANNEL_MAGNETOMETERX, CHANNEL_MAGNETOMETERZ);
+}
+
+static UINT append_device_telemetry_accelerometer(NX_AZURE_IOT_JSON_WRITER* json_writer)
+{
+    return append_windows(json_writer, CHANNEL_ACCELEROMETERX, CHANNEL_ACCELEROMETERZ);
+}
+
 static UINT append_device_telemetry_gyroscope(NX_AZURE_IOT_JSON_WRITER* json_writer)
 {
-    lsm6dsl_data_t lsm6dsl_data = lsm6dsl_data_read();
+    return append_windows(json_writer, CHANNEL_GYROSCOPEX, CHANNEL_GYROSCOPEZ);
+}
 
-    if (nx_azure_iot_json_writer_append_property_with_double_value(json_writer,
-            (UCHAR*)TELEMETRY_GYROSCOPEX,
-            sizeof(TELEMETRY_GYROSCOPEX) - 1,
-            lsm6dsl_data.angular_rate_mdps[0],
-            2) ||
+static void sample_sensors(AZURE_IOT_NX_CONTEXT* nx_context)
+{
+    lps22hb_t lps22hb_data      = lps22hb_data_read();
+    hts221_data_t hts221_data   = hts221_data_read();
+    lis2mdl_data_t lis2mdl_data = lis2mdl_data_read();
+    lsm6dsl_data_t lsm6dsl_data = lsm6dsl_data_read();
 
-        nx_azure_iot_json_writer_append_property_with_double_value(json_writer,
-            (UCHAR*)TELEMETRY_GYROSCOPEY,
-            sizeof(TELEMETRY_GYROSCOPEY) - 1,
-            lsm6dsl_data.angular_rate_mdps[1],
-            2) ||
+    window_stats_add(&windows[CHANNEL_HUMIDITY], hts221_data.humidity_perc);
+    window_stats_add(&windows[CHANNEL_TEMPERATURE], lps22hb_data.temperature_degC);
+    window_stats_add(&windows[CHANNEL_PRESSURE], lps22hb_data.pressure_hPa);
 
-        nx_azure_iot_json_writer_append_property_with_double_value(json_writer,
-            (UCHAR*)TELEMETRY_GYROSCOPEZ,
-            sizeof(TELEMETRY_GYROSCOPEZ) - 1,
-            lsm6dsl_data.angular_rate_mdps[2],
-            2))
+    for (int i = 0; i < 3; i++)
     {
-        return NX_NOT_SUCCESSFUL;
+        window_stats_add(&windows[CHANNEL_MAGNETOMETERX + i], lis2mdl_data.magnetic_mG[i]);
+        window_stats_add(&windows[CHANNEL_ACCELEROMETERX + i], lsm6dsl_data.acceleration_mg[i]);
+        window_stats_add(&windows[CHANNEL_GYROSCOPEX + i], lsm6dsl_data.angular_rate_mdps[i]);
     }
+}
 
-    return NX_AZURE_IOT_SUCCESS;
+// Sampling runs in the Azure IoT thread, through the app event, like the rest of the sensor reads
+static VOID sample_timer_entry(ULONG context)
+{
+    azure_iot_nx_client_app_event_set(&azure_iot_nx_client);
 }
 
 static void set_led_state(bool level)
@@ -287,19 +334,27 @@ static void writable_property_received_cb(AZURE_IOT_NX_CONTEXT* nx_context,
     UINT version)
 {
     UINT status;
+    int32_t interval;
 
     if (strncmp((CHAR*)property_name, TELEMETRY_INTERVAL_PROPERTY, property_name_len) == 0)
     {
-        status = nx_azure_iot_json_reader_token_int32_get(json_reader_ptr, &telemetry_interval);
+        status = nx_azure_iot_json_reader_token_int32_get(json_reader_ptr, &interval);
         if (status == NX_AZURE_IOT_SUCCESS)
         {
+            // Negative and too long intervals are rejected, and the current one is kept
+            if (azure_iot_nx_client_telemetry_interval_set(nx_context, NULL, interval) != NX_SUCCESS)
+            {
+                azure_nx_client_respond_int_writable_property(
+                    nx_context, NULL, TELEMETRY_INTERVAL_PROPERTY, telemetry_interval, 400, version);
+                return;
+            }
+
+            telemetry_interval = interval;
             printf("Updating %s to %ld\r\n", TELEMETRY_INTERVAL_PROPERTY, telemetry_interval);
 
             // Confirm reception back to hub
             azure_nx_client_respond_int_writable_property(
                 nx_context, NULL, TELEMETRY_INTERVAL_PROPERTY, telemetry_interval, 200, version);
-
-            azure_nx_client_periodic_interval_set(nx_context, telemetry_interval);
         }
     }
 }
@@ -313,14 +368,16 @@ static void property_received_cb(AZURE_IOT_NX_CONTEXT* nx_context,
     UINT version)
 {
     UINT status;
+    int32_t interval;
 
     if (strncmp((CHAR*)property_name, TELEMETRY_INTERVAL_PROPERTY, property_name_len) == 0)
     {
-        status = nx_azure_iot_json_reader_token_int32_get(json_reader_ptr, &telemetry_interval);
-        if (status == NX_AZURE_IOT_SUCCESS)
+        status = nx_azure_iot_json_reader_token_int32_get(json_reader_ptr, &interval);
+        if (status == NX_AZURE_IOT_SUCCESS &&
+            azure_iot_nx_client_telemetry_interval_set(nx_context, NULL, interval) == NX_SUCCESS)
         {
+            telemetry_interval = interval;
             printf("Updating %s to %ld\r\n", TELEMETRY_INTERVAL_PROPERTY, telemetry_interval);
-            azure_nx_client_periodic_interval_set(nx_context, telemetry_interval);
         }
     }
 }
@@ -332,40 +389,12 @@ static void properties_complete_cb(AZURE_IOT_NX_CONTEXT* nx_context)
     azure_iot_nx_client_publish_bool_property(nx_context, NULL, LED_STATE_PROPERTY, false);
     azure_iot_nx_client_publish_int_writable_property(
         nx_context, NULL, TELEMETRY_INTERVAL_PROPERTY, telemetry_interval);
+    azure_iot_nx_client_publish_telemetry_stream_properties(nx_context);
 
     printf("\r\nStarting Main loop\r\n");
     screen_print("Azure IoT", L0);
 }
 
-static void telemetry_cb(AZURE_IOT_NX_CONTEXT* nx_context)
-{
-    static TELEMETRY_STATE telemetry_state = TELEMETRY_STATE_DEFAULT;
-
-    switch (telemetry_state)
-    {
-        case TELEMETRY_STATE_DEFAULT:
-            azure_iot_nx_client_publish_telemetry(&azure_iot_nx_client, NULL, append_device_telemetry);
-            break;
-
-        case TELEMETRY_STATE_MAGNETOMETER:
-            azure_iot_nx_client_publish_telemetry(&azure_iot_nx_client, NULL, append_device_telemetry_magnetometer);
-            break;
-
-        case TELEMETRY_STATE_ACCELEROMETER:
-            azure_iot_nx_client_publish_telemetry(&azure_iot_nx_client, NULL, append_device_telemetry_accelerometer);
-            break;
-
-        case TELEMETRY_STATE_GYROSCOPE:
-            azure_iot_nx_client_publish_telemetry(&azure_iot_nx_client, NULL, append_device_telemetry_gyroscope);
-            break;
-
-        default:
-            break;
-    }
-
-    telemetry_state = (telemetry_state + 1) % TELEMETRY_STATE_END;
-}
-
 UINT azure_iot_nx_client_entry(
     NX_IP* ip_ptr, NX_PACKET_POOL* pool_ptr, NX_DNS* dns_ptr, UINT (*unix_time_callback)(ULONG* unix_time))
 {
@@ -388,7 +417,29 @@ UINT azure_iot_nx_client_entry(
     azure_iot_nx_client_register_writable_property_callback(&azure_iot_nx_client, writable_property_received_cb);
     azure_iot_nx_client_register_property_callback(&azure_iot_nx_client, property_received_cb);
     azure_iot_nx_client_register_properties_complete_callback(&azure_iot_nx_client, properties_complete_cb);
-    azure_iot_nx_client_register_timer_callback(&azure_iot_nx_client, telemetry_cb, telemetry_interval);
+    azure_iot_nx_client_register_app_event_callback(&azure_iot_nx_client, sample_sensors);
+
+    // Register the telemetry streams
+    azure_iot_nx_client_add_telemetry_stream(
+        &azure_iot_nx_client, STREAM_ENVIRONMENT, append_device_telemetry, telemetry_interval, 0);
+    azure_iot_nx_client_add_telemetry_stream(
+        &azure_iot_nx_client, STREAM_MAGNETOMETER, append_device_telemetry_magnetometer, telemetry_interval, 0);
+    azure_iot_nx_client_add_telemetry_stream(
+        &azure_iot_nx_client, STREAM_ACCELEROMETER, append_device_telemetry_accelerometer, telemetry_interval, 0);
+    azure_iot_nx_client_add_telemetry_stream(
+        &azure_iot_nx_client, STREAM_GYROSCOPE, append_device_telemetry_gyroscope, telemetry_interval, 0);
+
+    if ((status = tx_timer_create(&sample_timer,
+             "sample_timer",
+             sample_timer_entry,
+             0,
+             SAMPLE_INTERVAL_TICKS,
+             SAMPLE_INTERVAL_TICKS,
+             TX_AUTO_ACTIVATE)))
+    {
+        printf("ERROR: tx_timer_create failed (0x%08x)\r\n", status);
+        return status;
+    }
 
     // Setup authentication
 #ifdef ENABLE_X509
@@ -10,6 +10,7 @@
 
 #include "wiced_sdk.h"
 
+#include "mem_sections.h"
 #include "sntp_client.h"
 
 #define NETX_IP_STACK_SIZE   2048
@@ -28,9 +29,9 @@
 
 #define WIFI_COUNTRY WICED_COUNTRY_UNITED_STATES
 
-static UCHAR netx_ip_stack[NETX_IP_STACK_SIZE];
-static UCHAR netx_tx_pool_stack[NETX_TX_POOL_SIZE];
-static UCHAR netx_rx_pool_stack[NETX_RX_POOL_SIZE];
+static UCHAR netx_ip_stack[NETX_IP_STACK_SIZE] FAST_BSS;
+static UCHAR netx_tx_pool_stack[NETX_TX_POOL_SIZE] DMA_BUFFER;
+static UCHAR netx_rx_pool_stack[NETX_RX_POOL_SIZE] DMA_BUFFER;
 static UCHAR netx_arp_cache_area[NETX_ARP_CACHE_SIZE];
 
 static CHAR* netx_ssid;
@@ -16,6 +16,7 @@
 #include "azure_config.h"
 #include "azure_device_x509_cert_config.h"
 #include "azure_pnp_info.h"
+#include "mem_sections.h"
 
 #include "fsl_tempmon.h"
 
@@ -26,7 +27,7 @@
 #define LED_STATE_PROPERTY          "ledState"
 #define SET_LED_STATE_COMMAND       "setLedState"
 
-static AZURE_IOT_NX_CONTEXT azure_iot_nx_client;
+static AZURE_IOT_NX_CONTEXT azure_iot_nx_client FAST_BSS;
 
 static int32_t telemetry_interval = 10;
 
@@ -8,6 +8,7 @@
 #include "nx_driver_imxrt1062.h"
 
 #include "board_init.h"
+#include "mem_sections.h"
 #include "networking.h"
 #include "sntp_client.h"
 
@@ -18,7 +19,7 @@
 #define AZURE_THREAD_PRIORITY   4
 
 TX_THREAD azure_thread;
-ULONG azure_thread_stack[AZURE_THREAD_STACK_SIZE / sizeof(ULONG)];
+ULONG azure_thread_stack[AZURE_THREAD_STACK_SIZE / sizeof(ULONG)] FAST_BSS;
 
 static void azure_thread_entry(ULONG parameter)
 {
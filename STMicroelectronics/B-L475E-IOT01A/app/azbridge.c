@@ -0,0 +1,88 @@
+#include "azbridge.h"
+
+#include "stm32l4xx.h"
+#include "tx_api.h"
+
+// memory barriers make sure the slot contents are written before the index is
+// updated, and not read before the index was seen
+
+#define RAM2 __attribute__((section(".ram2,\"aw\",%nobits@")))
+
+// method calls are rare, and the Jacdac thread takes them off the queue on its next pass
+#define FROM_CLOUD_BLOCKS 2
+// ThreadX keeps a pointer in front of each block
+#define POOL_WORDS(n) ((n) * (AZBRIDGE_MSG_SIZE + sizeof(void *)) / sizeof(ULONG))
+
+azbridge_queue_t RAM2 azbridge_to_cloud;
+azbridge_queue_t RAM2 azbridge_from_cloud;
+
+static TX_BLOCK_POOL RAM2 to_cloud_pool;
+static TX_BLOCK_POOL RAM2 from_cloud_pool;
+static ULONG RAM2 to_cloud_blocks[POOL_WORDS(AZBRIDGE_SLOTS)];
+static ULONG RAM2 from_cloud_blocks[POOL_WORDS(FROM_CLOUD_BLOCKS)];
+
+static void queue_init(azbridge_queue_t *q, TX_BLOCK_POOL *pool, CHAR *name, ULONG *blocks,
+                       ULONG size) {
+    q->head = q->tail = 0;
+    q->pool = pool;
+    for (int i = 0; i < AZBRIDGE_SLOTS; ++i)
+        q->msgs[i].data = NULL;
+    tx_block_pool_create(pool, name, AZBRIDGE_MSG_SIZE, blocks, size);
+}
+
+void azbridge_init(void) {
+    // .ram2 is not cleared at startup
+    queue_init(&azbridge_to_cloud, &to_cloud_pool, "to cloud", to_cloud_blocks,
+               sizeof(to_cloud_blocks));
+    queue_init(&azbridge_from_cloud, &from_cloud_pool, "from cloud", from_cloud_blocks,
+               sizeof(from_cloud_blocks));
+}
+
+static void release_data(azbridge_msg_t *msg) {
+    if (msg->data) {
+        tx_block_release(msg->data);
+        msg->data = NULL;
+    }
+}
+
+azbridge_msg_t *azbridge_alloc(azbridge_queue_t *q) {
+    uint32_t head = q->head;
+    if (head - q->tail >= AZBRIDGE_SLOTS)
+        return NULL;
+    azbridge_msg_t *msg = &q->msgs[head % AZBRIDGE_SLOTS];
+    if (msg->data)
+        return msg; // allocated before, and neither pushed nor cancelled
+
+    // the pool is thread-safe, and TX_NO_WAIT keeps the producer from blocking
+    VOID *block;
+    if (tx_block_allocate(q->pool, &block, TX_NO_WAIT) != TX_SUCCESS)
+        return NULL;
+
+    msg->data = block;
+    msg->size = AZBRIDGE_MSG_SIZE;
+    msg->len = 0;
+    return msg;
+}
+
+void azbridge_cancel(azbridge_queue_t *q) {
+    release_data(&q->msgs[q->head % AZBRIDGE_SLOTS]);
+}
+
+void azbridge_push(azbridge_queue_t *q) {
+    __DMB();
+    q->head = q->head + 1;
+}
+
+azbridge_msg_t *azbridge_peek(azbridge_queue_t *q) {
+    uint32_t tail = q->tail;
+    if (tail == q->head)
+        return NULL;
+    __DMB();
+    return &q->msgs[tail % AZBRIDGE_SLOTS];
+}
+
+void azbridge_pop(azbridge_queue_t *q) {
+    release_data(&q->msgs[q->tail % AZBRIDGE_SLOTS]);
+    __DMB();
+    q->tail = q->tail + 1;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Queues between the Jacdac thread and the Azure IoT thread.
+//
+// Each queue has a single producer and a single consumer thread, so it needs no
+// locks: the producer only writes head, the consumer only writes tail.
+// The producer fills the slot returned by azbridge_alloc() in place, and publishes
+// it with azbridge_push(); the consumer does the same with azbridge_peek() and
+// azbridge_pop(). Neither side ever blocks on the other.
+//
+// Message data is a block from the queue's own pool, taken by azbridge_alloc() and
+// released by azbridge_pop(), so the queues only pass pointers. The pools are separate
+// from NetX's packet pool: messages waiting in the queues don't starve TLS and MQTT.
+// NetX still copies telemetry into a packet of its own when the Azure thread sends it.
+
+#define AZBRIDGE_SLOTS 4
+// max message size, '\0' included
+#define AZBRIDGE_MSG_SIZE 512
+// max size of the command request id kept by the Azure side
+#define AZBRIDGE_CONTEXT_SIZE 16
+
+// Jacdac -> Azure; data is a JSON object
+#define AZBRIDGE_TELEMETRY 1
+// Jacdac -> Azure; data is the JSON response payload
+#define AZBRIDGE_METHOD_RESPONSE 2
+// Azure -> Jacdac; data is the method name, '\0', and the JSON payload
+#define AZBRIDGE_METHOD_CALL 3
+
+typedef struct {
+    uint8_t type;
+    uint16_t len;
+    uint16_t size; // room in data, '\0' included
+    uint32_t method_id;
+    uint32_t status;
+    char *data; // NULL when the slot isn't allocated
+} azbridge_msg_t;
+
+typedef struct {
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    struct TX_BLOCK_POOL_STRUCT *pool;
+    azbridge_msg_t msgs[AZBRIDGE_SLOTS];
+} azbridge_queue_t;
+
+extern azbridge_queue_t azbridge_to_cloud;
+extern azbridge_queue_t azbridge_from_cloud;
+
+// creates the block pools; call from tx_application_define(), before the threads start
+void azbridge_init(void);
+
+// NULL when full, or when there is no free block
+azbridge_msg_t *azbridge_alloc(azbridge_queue_t *q);
+// releases the block of a slot from azbridge_alloc() that won't be pushed
+void azbridge_cancel(azbridge_queue_t *q);
+void azbridge_push(azbridge_queue_t *q);
+// NULL when empty
+azbridge_msg_t *azbridge_peek(azbridge_queue_t *q);
+void azbridge_pop(azbridge_queue_t *q);
+
+// implemented by the Azure side (nx_client.c)
+void azbridge_notify_cloud(void);
+bool azbridge_cloud_connected(void);
+
+// implemented by the Jacdac side (main.c)
+void jdaz_wake_main(void);
@@ -1,4 +1,8 @@
 #pragma once
 
 #include "jacscript.h"
-#include "jdstm.h"
\ No newline at end of file
+#include "jdstm.h"
+
+// azureiothub.c
+void azureiothub_init(void);
+extern const jacscloud_api_t azureiothub_cloud;
@@ -3,8 +3,20 @@
 #include "jacdac/dist/c/azureiothubhealth.h"
 #include "jacs_internal.h"
 
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdlib.h>
+
+#include "azbridge.h"
+#include "azure_config.h"
+#include "scratch.h"
+
 #define LOG(msg, ...) DMESG("aziot: " msg, ##__VA_ARGS__)
 
+// The connection itself is handled by the Azure IoT thread (nx_client.c), configured
+// in azure_config.h. This service only exposes its status to Jacdac, and passes
+// messages through the azbridge queues, so a slow TLS send never blocks the Jacdac thread.
+
 struct srv_state {
     SRV_COMMON;
 
@@ -14,18 +26,9 @@ struct srv_state {
     uint32_t push_watchdog_period_ms;
 
     // non-regs
-    bool waiting_for_net;
     uint32_t reconnect_timer;
     uint32_t flush_timer;
     uint32_t watchdog_timer_ms;
-
-    char *hub_name;
-    char *device_id;
-    char *sas_token;
-    char *pub_topic;
-
-    nvs_handle_t nvs_handle;
-    esp_mqtt_client_handle_t client;
 };
 
 REG_DEFINITION(                                                //
@@ -36,41 +39,118 @@ REG_DEFINITION(                                                //
     REG_U32(JD_AZURE_IOT_HUB_HEALTH_REG_PUSH_WATCHDOG_PERIOD), //
 )
 
+// the JSON is built in the scratch arena; NULL when it doesn't fit
+static char *double_array_to_json(int numvals, const double *vals) {
+    scratch_mark_t mark = scratch_mark();
+    char *r = scratch_append(NULL, "[");
+    for (int i = 0; r && i < numvals; ++i)
+        r = scratch_append(r, i ? ",%f" : "%f", vals[i]);
+    if (r)
+        r = scratch_append(r, "]");
+    if (!r)
+        scratch_release(mark);
+    return r;
+}
 
-char *extract_property(const char *property_bag, int plen, const char *key) {
-    int klen = strlen(key);
-    for (int ptr = 0; ptr + klen < plen;) {
-        int nextp = ptr;
-        while (nextp < plen && property_bag[nextp] != ';')
-            nextp++;
-        if (property_bag[ptr + klen] == '=' && memcmp(property_bag + ptr, key, klen) == 0) {
-            int sidx = ptr + klen + 1;
-            int rlen = nextp - sidx;
-            char *r = jd_alloc(rlen + 1);
-            memcpy(r, property_bag + sidx, rlen);
-            r[rlen] = 0;
-            return r;
-        }
-        if (nextp < plen)
-            nextp++;
-        ptr = nextp;
+static const char hex[] = "0123456789abcdef";
+
+// Outgoing messages are written straight into the bridge message.
+// Once something doesn't fit, len is -1 and the rest is skipped.
+typedef struct {
+    char *dst;
+    int len;
+    int size;
+} writer_t;
+
+static void writer_init(writer_t *w, azbridge_msg_t *msg) {
+    w->dst = msg->data;
+    w->len = 0;
+    w->size = msg->size;
+    w->dst[0] = 0;
+}
+
+// room for n more chars and the '\0'; marks the writer as failed otherwise
+static char *writer_reserve(writer_t *w, int n) {
+    if (w->len < 0)
+        return NULL;
+    if (w->len + n >= w->size) {
+        w->len = -1;
+        return NULL;
+    }
+    return w->dst + w->len;
+}
+
+static void write_str(writer_t *w, const char *s) {
+    int n = strlen(s);
+    char *d = writer_reserve(w, n);
+    if (d) {
+        memcpy(d, s, n + 1);
+        w->len += n;
     }
-    return NULL;
 }
 
-char *double_array_to_json(int numvals, const double *vals) {
-    if (numvals == 0)
-        return jd_strdup("[]");
+static void write_fmt(writer_t *w, const char *format, ...) {
+    if (w->len < 0)
+        return;
+    int avail = w->size - w->len;
+    va_list ap;
+    va_start(ap, format);
+    jd_vsprintf(w->dst + w->len, avail, format, ap);
+    va_end(ap);
+    int n = strlen(w->dst + w->len);
+    // the output is truncated to fit, so filling the space means it probably didn't
+    if (n >= avail - 1)
+        w->len = -1;
+    else
+        w->len += n;
+}
+
+static void write_hex(writer_t *w, const void *data, unsigned size) {
+    char *d = writer_reserve(w, size * 2);
+    if (!d)
+        return;
+    const uint8_t *p = data;
+    for (unsigned i = 0; i < size; ++i) {
+        *d++ = hex[p[i] >> 4];
+        *d++ = hex[p[i] & 0xf];
+    }
+    *d = 0;
+    w->len += size * 2;
+}
+
+// a JSON string literal, quotes included
+static void write_json_string(writer_t *w, const char *s) {
+    int len = 2;
+    for (const char *p = s; *p; ++p)
+        len += (uint8_t)*p < 0x20 ? 6 : *p == '"' || *p == '\\' ? 2 : 1;
+    char *d = writer_reserve(w, len);
+    if (!d)
+        return;
+
+    *d++ = '"';
+    for (; *s; ++s) {
+        uint8_t c = *s;
+        if (c < 0x20) {
+            memcpy(d, "\\u00", 4);
+            d[4] = hex[c >> 4];
+            d[5] = hex[c & 0xf];
+            d += 6;
+        } else {
+            if (c == '"' || c == '\\')
+                *d++ = '\\';
+            *d++ = c;
+        }
+    }
+    *d++ = '"';
+    *d = 0;
+    w->len += len;
+}
 
-    char **parts2 = jd_alloc(sizeof(char *) * (numvals + 2));
-    parts2[0] = "[";
+static void write_double_array(writer_t *w, int numvals, const double *vals) {
+    write_str(w, "[");
     for (int i = 0; i < numvals; ++i)
-        parts2[i + 1] = jd_sprintf_a("%f%s", vals[i], i == numvals - 1 ? "]" : ",");
-    parts2[numvals + 1] = NULL;
-    char *msg = jd_concat_many((const char **)parts2);
-    for (int i = 1; parts2[i]; ++i)
-        jd_free(parts2[i]);
-    return msg;
+        write_fmt(w, i ? ",%f" : "%f", vals[i]);
+    write_str(w, "]");
 }
 
 static int parse_json_array(unsigned len, const char *data, double *dst) {
@@ -130,132 +210,34 @@ static void set_status(srv_t *state, uint16_t status) {
                       &state->conn_status, sizeof(state->conn_status));
 }
 
-static void clear_conn_string(srv_t *state) {
-    jd_free(state->hub_name);
-    jd_free(state->device_id);
-    jd_free(state->sas_token);
-    jd_free(state->pub_topic);
-    state->hub_name = NULL;
-    state->device_id = NULL;
-    state->sas_token = NULL;
-    state->pub_topic = NULL;
-}
-
-static void on_command(srv_t *state, esp_mqtt_event_handle_t event) {
-    LOG("azureiot method: '%s' rid=%d", label, ridval);
+int azureiothub_respond_method(uint32_t method_id, uint32_t status, int numvals, double *vals);
 
-    int numvals = parse_json_array(event->data_len, event->data, NULL);
-    double *d = jd_alloc(numvals * 8 + 1);
-    parse_json_array(event->data_len, event->data, d);
+static void on_method(azbridge_msg_t *msg) {
+    const char *label = msg->data;
+    int labellen = strlen(label);
+    const char *payload = msg->data + labellen + 1;
+    int payloadlen = msg->len - labellen - 1;
 
-    DMESG("args=%-s", double_array_to_json(numvals, d));
+    LOG("azureiot method: '%s' rid=%d", label, (int)msg->method_id);
 
-    jacscloud_on_method(label, ridval, numvals, d);
-}
-
-static esp_err_t mqtt_event_handler_cb(srv_t *state, esp_mqtt_event_handle_t event) {
-    switch (event->event_id) {
-    case MQTT_EVENT_DISCONNECTED:
-        set_status(state, JD_AZURE_IOT_HUB_HEALTH_CONNECTION_STATUS_DISCONNECTED);
-        break;
-    }
-
-    return ESP_OK;
-}
-
-static void azureiothub_disconnect(srv_t *state) {
-    if (!state->client)
+    // the arguments only live until the handler returns
+    scratch_mark_t mark = scratch_mark();
+    int numvals = parse_json_array(payloadlen, payload, NULL);
+    double *d = scratch_alloc(numvals * sizeof(double) + 1);
+    if (!d) {
+        LOG("too many method args: %d", numvals);
+        azureiothub_respond_method(msg->method_id, 413, 0, NULL);
         return;
-
-    set_status(state, JD_AZURE_IOT_HUB_HEALTH_CONNECTION_STATUS_DISCONNECTING);
-    esp_mqtt_client_disconnect(state->client);
-}
-
-static void azureiothub_reconnect(srv_t *state) {
-    if (!state->hub_name || !wifi_is_connected()) {
-        azureiothub_disconnect(state);
-        return;
-    }
-
-    char *uri = jd_sprintf_a("mqtts://%s", state->hub_name);
-    char *username = jd_sprintf_a("%s/%-s/?api-version=2018-06-30", state->hub_name,
-                                  jd_urlencode(state->device_id));
-
-    LOG("connecting to %s/%s", uri, state->device_id);
-
-    const esp_mqtt_client_config_t mqtt_cfg = {
-        .uri = uri, //
-        .client_id = state->device_id,
-        .username = username,
-        .password = state->sas_token,
-        .crt_bundle_attach = esp_crt_bundle_attach,
-        // forward to default event loop, which will run on main task:
-        .event_handle = mqtt_event_handler_outer,
-        // .disable_auto_reconnect=true,
-        // .path = "/$iothub/websocket?iothub-no-client-cert=true" // for wss:// proto
-    };
-
-    if (!state->client) {
-        state->client = esp_mqtt_client_init(&mqtt_cfg);
-        JD_ASSERT(state->client != NULL);
-        CHK(esp_event_handler_instance_register(MY_MQTT_EVENTS, MQTT_EVENT_ANY, mqtt_event_handler,
-                                                state, NULL));
-        esp_mqtt_client_start(state->client);
-    } else {
-        CHK(esp_mqtt_set_config(state->client, &mqtt_cfg));
-        CHK(esp_mqtt_client_reconnect(state->client));
     }
+    parse_json_array(payloadlen, payload, d);
 
-    set_status(state, JD_AZURE_IOT_HUB_HEALTH_CONNECTION_STATUS_CONNECTING);
+    const char *args = double_array_to_json(numvals, d);
+    DMESG("args=%s", args ? args : "...");
 
-    jd_free(uri);
-    jd_free(username);
+    jacscloud_on_method(label, msg->method_id, numvals, d);
+    scratch_release(mark);
 }
 
-// TODO check if IoT SDK already has conn-string parsing
-static int set_conn_string(srv_t *state, const char *conn_str, int conn_len, int save) {
-    if (conn_len == 0) {
-        LOG("clear connection string");
-        clear_conn_string(state);
-        if (save) {
-            nvs_erase_key(state->nvs_handle, "conn_str");
-            nvs_commit(state->nvs_handle);
-        }
-        azureiothub_reconnect(state);
-        return 0;
-    }
-
-    char *hub_name_enc = NULL;
-    char *device_id_enc = NULL;
-
-    char *hub_name = extract_property(conn_str, conn_len, "HostName");
-    char *device_id = extract_property(conn_str, conn_len, "DeviceId");
-    char *sas_key = extract_property(conn_str, conn_len, "SharedAccessKey");
-
-    if (!hub_name || !device_id || !sas_key) {
-        LOG("failed parsing conn string: %s", conn_str);
-        goto fail;
-    }
-
-    if (save) {
-        // store conn string in flash
-        nvs_set_blob(state->nvs_handle, "conn_str", conn_str, conn_len);
-        nvs_commit(state->nvs_handle);
-    }
-    azureiothub_reconnect(state);
-
-    return 0;
-
-fail:
-    jd_free(hub_name);
-    jd_free(device_id);
-    jd_free(sas_key);
-    jd_free(hub_name_enc);
-    jd_free(device_id_enc);
-    return -1;
-}
-
-#if 1
 static const uint32_t glows[] = {
     [JD_AZURE_IOT_HUB_HEALTH_CONNECTION_STATUS_CONNECTED] = JD_GLOW_CLOUD_CONNECTED_TO_CLOUD,
     [JD_AZURE_IOT_HUB_HEALTH_CONNECTION_STATUS_DISCONNECTED] = JD_GLOW_CLOUD_NOT_CONNECTED_TO_CLOUD,
@@ -263,28 +245,25 @@ static const uint32_t glows[] = {
     [JD_AZURE_IOT_HUB_HEALTH_CONNECTION_STATUS_DISCONNECTING] =
         JD_GLOW_CLOUD_NOT_CONNECTED_TO_CLOUD,
 };
-#endif
 
 void azureiothub_process(srv_t *state) {
     if (state->push_watchdog_period_ms && in_past_ms(state->watchdog_timer_ms)) {
-        ESP_LOGE("JD", "cloud watchdog reset\n");
+        ERROR("cloud watchdog reset");
         target_reset();
     }
 
+    azbridge_msg_t *msg;
+    while ((msg = azbridge_peek(&azbridge_from_cloud)) != NULL) {
+        if (msg->type == AZBRIDGE_METHOD_CALL)
+            on_method(msg);
+        azbridge_pop(&azbridge_from_cloud);
+    }
+
     if (jd_should_sample(&state->reconnect_timer, 500000)) {
-#if 1
-        if (!wifi_is_connected())
-            jd_glow(JD_GLOW_CLOUD_CONNECTING_TO_NETWORK);
-        else
-            jd_glow(glows[state->conn_status]);
-#endif
-
-        if (wifi_is_connected() &&
-            state->conn_status == JD_AZURE_IOT_HUB_HEALTH_CONNECTION_STATUS_DISCONNECTED &&
-            state->hub_name && state->waiting_for_net) {
-            state->waiting_for_net = false;
-            azureiothub_reconnect(state);
-        }
+        set_status(state, azbridge_cloud_connected()
+                              ? JD_AZURE_IOT_HUB_HEALTH_CONNECTION_STATUS_CONNECTED
+                              : JD_AZURE_IOT_HUB_HEALTH_CONNECTION_STATUS_DISCONNECTED);
+        jd_glow(glows[state->conn_status]);
     }
 
     if (jd_should_sample_ms(&state->flush_timer, state->push_period_ms)) {
@@ -295,23 +274,17 @@ void azureiothub_process(srv_t *state) {
 void azureiothub_handle_packet(srv_t *state, jd_packet_t *pkt) {
     switch (pkt->service_command) {
     case JD_AZURE_IOT_HUB_HEALTH_CMD_SET_CONNECTION_STRING:
-        set_conn_string(state, (char *)pkt->data, pkt->service_size, 1);
-        return;
-
     case JD_AZURE_IOT_HUB_HEALTH_CMD_CONNECT:
-        azureiothub_reconnect(state);
-        return;
-
     case JD_AZURE_IOT_HUB_HEALTH_CMD_DISCONNECT:
-        azureiothub_disconnect(state);
+        LOG("connection is set up in azure_config.h");
         return;
 
     case JD_GET(JD_AZURE_IOT_HUB_HEALTH_REG_HUB_NAME):
-        jd_respond_string(pkt, state->hub_name);
+        jd_respond_string(pkt, IOT_HUB_HOSTNAME);
         return;
 
     case JD_GET(JD_AZURE_IOT_HUB_HEALTH_REG_HUB_DEVICE_ID):
-        jd_respond_string(pkt, state->device_id);
+        jd_respond_string(pkt, IOT_HUB_DEVICE_ID);
         return;
     }
 
@@ -341,89 +314,125 @@ void azureiothub_init(void) {
     aggbuffer_init(&azureiothub_cloud);
 
     state->conn_status = JD_AZURE_IOT_HUB_HEALTH_CONNECTION_STATUS_DISCONNECTED;
-    state->waiting_for_net = true;
     state->push_period_ms = 5000;
 
-#if 0
-    size_t connlen;
-    char *conn = nvs_get_blob_a(state->nvs_handle, "conn_str", &connlen);
-    if (conn)
-        set_conn_string(state, conn, connlen, 0);
-#endif
-
     _aziot_state = state;
+}
+
+int azureiothub_is_connected(void) {
+    srv_t *state = _aziot_state;
+    return state->conn_status == JD_AZURE_IOT_HUB_HEALTH_CONNECTION_STATUS_CONNECTED;
+}
 
+// a message for the Azure thread, to write with writer_init() and pass to enqueue()
+static azbridge_msg_t *start_message(void) {
+    azbridge_msg_t *msg = azbridge_alloc(&azbridge_to_cloud);
+    if (!msg)
+        LOG("no room for message");
+    return msg;
+}
+
+static int enqueue(azbridge_msg_t *msg, writer_t *w, uint8_t type, uint32_t method_id,
+                   uint32_t status) {
+    if (w->len < 0) {
+        LOG("message too long");
+        azbridge_cancel(&azbridge_to_cloud);
+        return -3;
+    }
+    msg->type = type;
+    msg->method_id = method_id;
+    msg->status = status;
+    msg->len = w->len;
+    azbridge_push(&azbridge_to_cloud);
+    azbridge_notify_cloud();
+    return 0;
 }
 
-int azureiothub_publish(const void *msg, unsigned len) {
+static int publish(azbridge_msg_t *msg, writer_t *w) {
     srv_t *state = _aziot_state;
-    if (state->conn_status != JD_AZURE_IOT_HUB_HEALTH_CONNECTION_STATUS_CONNECTED)
-        return -1;
-    int qos = 0;
-    int retain = 0;
-    bool store = true;
-    // TODO:
-    if (esp_mqtt_client_enqueue(state->client, topic, msg, len, qos, retain, store) < 0)
-        return -2;
+
+    int r = enqueue(msg, w, AZBRIDGE_TELEMETRY, 0, 0);
+    if (r)
+        return r;
 
     feed_watchdog(state);
-    LOG("send: >>%s<<", (const char *)msg);
+    LOG("send: >>%s<<", w->dst);
 
     jd_blink(JD_BLINK_CLOUD_UPLOADED);
 
     return 0;
 }
 
-static int publish_and_free(char *msg) {
-    int r = azureiothub_publish(msg, strlen(msg), NULL);
-    jd_free(msg);
-    return r;
+int azureiothub_publish(const void *data, unsigned len) {
+    if (!azureiothub_is_connected())
+        return -1;
+    azbridge_msg_t *msg = start_message();
+    if (!msg)
+        return -2;
+    writer_t w;
+    writer_init(&w, msg);
+    char *d = writer_reserve(&w, len);
+    if (d) {
+        memcpy(d, data, len);
+        d[len] = 0;
+        w.len += len;
+    }
+    return publish(msg, &w);
 }
 
 int azureiothub_publish_values(const char *label, int numvals, double *vals) {
+    if (!azureiothub_is_connected())
+        return -1;
+    azbridge_msg_t *msg = start_message();
+    if (!msg)
+        return -2;
+
     uint64_t self = jd_device_id();
-    char *msg = jd_sprintf_a("{\"device\":\"%-s\", \"label\":%-s, \"values\":%-s}",
-                             jd_to_hex_a(&self, sizeof(self)), jd_json_escape(label),
-                             double_array_to_json(numvals, vals));
-    return publish_and_free(msg);
+    writer_t w;
+    writer_init(&w, msg);
+    write_str(&w, "{\"device\":\"");
+    write_hex(&w, &self, sizeof(self));
+    write_str(&w, "\", \"label\":");
+    write_json_string(&w, label);
+    write_str(&w, ", \"values\":");
+    write_double_array(&w, numvals, vals);
+    write_str(&w, "}");
+    return publish(msg, &w);
 }
 
 int azureiothub_publish_bin(const void *data, unsigned datasize) {
-    char *hex = jd_to_hex_a(data, datasize);
-    return publish_and_free(hex);
-}
+    if (!azureiothub_is_connected())
+        return -1;
+    azbridge_msg_t *msg = start_message();
+    if (!msg)
+        return -2;
 
-int azureiothub_is_connected(void) {
-    srv_t *state = _aziot_state;
-    return state->conn_status == JD_AZURE_IOT_HUB_HEALTH_CONNECTION_STATUS_CONNECTED;
+    // telemetry is sent as JSON
+    writer_t w;
+    writer_init(&w, msg);
+    write_str(&w, "{\"bin\":\"");
+    write_hex(&w, data, datasize);
+    write_str(&w, "\"}");
+    return publish(msg, &w);
 }
 
 int azureiothub_respond_method(uint32_t method_id, uint32_t status, int numvals, double *vals) {
-    char *msg = double_array_to_json(numvals, vals);
-
-    nx_azure_iot_hub_client_command_message_response(
-                 &nx_context_ptr->iothub_client, status,
-                 context_ptr, context_length, 
-                 msg, strlen(msg), NX_WAIT_FOREVER)
-
-    char *topic = jd_sprintf_a("$iothub/methods/res/%d/?$rid=%d", status, method_id);
-
-// TODO
-    int r = azureiothub_publish(msg, strlen(msg), topic);
-
-    jd_free(msg);
-    jd_free(topic);
-
-    return r;
+    azbridge_msg_t *msg = start_message();
+    if (!msg)
+        return -2;
+    writer_t w;
+    writer_init(&w, msg);
+    write_double_array(&w, numvals, vals);
+    return enqueue(msg, &w, AZBRIDGE_METHOD_RESPONSE, method_id, status);
 }
 
-
 // for Cloud Adapter (jacscloud.c):
 const jacscloud_api_t azureiothub_cloud = {
     .upload = azureiothub_publish_values,
     .agg_upload = aggbuffer_upload,
     .bin_upload = azureiothub_publish_bin,
     .is_connected = azureiothub_is_connected,
-    .max_bin_upload_size = 1024, // just a guess
+    // hex encoded, with JSON wrapping
+    .max_bin_upload_size = (AZBRIDGE_MSG_SIZE - 16) / 2,
     .respond_method = azureiothub_respond_method,
-};
\ No newline at end of file
+};
@@ -9,6 +9,7 @@
 extern UART_HandleTypeDef UartHandle;
 
 void board_init(void);
+void UART_Console_DMA_Init(void);
 int hardware_rand(void);
 
 #endif // _BOARD_INIT_H
@@ -4,10 +4,12 @@
 #include "stm32l4xx_hal.h"
 
 #include "board_init.h"
+#include "console_buffer.h"
 
 int __io_putchar(int ch)
 {
-	HAL_UART_Transmit(&UartHandle, (uint8_t *)&ch, 1, HAL_MAX_DELAY);
+	UCHAR c = ch;
+	console_buffer_write(&c, 1);
 	return ch;
 }
 
@@ -17,12 +19,11 @@ int __io_getchar(void)
 	HAL_UART_Receive(&UartHandle, &ch, 1, HAL_MAX_DELAY);
 
 	/* Echo character back to console */
-	HAL_UART_Transmit(&UartHandle, &ch, 1, HAL_MAX_DELAY);
+	__io_putchar(ch);
 
 	/* And cope with Windows */
 	if (ch == '\r') {
-		uint8_t ret = '\n';
-		HAL_UART_Transmit(&UartHandle, &ret, 1, HAL_MAX_DELAY);
+		__io_putchar('\n');
 	}
 
 	return ch;
@@ -54,11 +55,48 @@ int _write(int file, char *ptr, int len)
 #error unknown compiler
 #endif
 {
-	int DataIdx;
-
-	for (DataIdx = 0; DataIdx < len; DataIdx++)
-	{
-		__io_putchar(*ptr++);
-	}
+	// returns as soon as the data is queued; see CONSOLE_OVERFLOW_POLICY
+	console_buffer_write((const UCHAR *)ptr, len);
 	return len;
 }
+
+static DMA_HandleTypeDef hdma_console_tx;
+
+static void console_start_tx(const UCHAR *data, UINT length)
+{
+	HAL_DMA_Start_IT(&hdma_console_tx, (uint32_t)data, (uint32_t)&UartHandle.Instance->TDR, length);
+}
+
+static void console_tx_complete(DMA_HandleTypeDef *hdma)
+{
+	console_buffer_tx_done();
+}
+
+void UART_Console_DMA_Init(void)
+{
+	__HAL_RCC_DMA1_CLK_ENABLE();
+
+	hdma_console_tx.Instance = DMA1_Channel4;
+	hdma_console_tx.Init.Request = DMA_REQUEST_2; // USART1_TX
+	hdma_console_tx.Init.Direction = DMA_MEMORY_TO_PERIPH;
+	hdma_console_tx.Init.PeriphInc = DMA_PINC_DISABLE;
+	hdma_console_tx.Init.MemInc = DMA_MINC_ENABLE;
+	hdma_console_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+	hdma_console_tx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+	hdma_console_tx.Init.Mode = DMA_NORMAL;
+	hdma_console_tx.Init.Priority = DMA_PRIORITY_LOW;
+	HAL_DMA_Init(&hdma_console_tx);
+	hdma_console_tx.XferCpltCallback = console_tx_complete;
+
+	SET_BIT(UartHandle.Instance->CR3, USART_CR3_DMAT);
+
+	HAL_NVIC_SetPriority(DMA1_Channel4_IRQn, 6, 0);
+	HAL_NVIC_EnableIRQ(DMA1_Channel4_IRQn);
+
+	console_buffer_init(console_start_tx);
+}
+
+void DMA1_Channel4_IRQHandler(void)
+{
+	HAL_DMA_IRQHandler(&hdma_console_tx);
+}
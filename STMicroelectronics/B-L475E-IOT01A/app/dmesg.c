@@ -1,33 +1,200 @@
 #include "jdstm.h"
+#include "logring.h"
 
 #if DEVICE_DMESG_BUFFER_SIZE > 0
 
-struct CodalLogStore codalLogStore;
+// Lock-free, so DMESG() can be used from any interrupt handler without masking anything.
+// When full, the oldest lines are dropped.
+static uint8_t dmesg_buf[DEVICE_DMESG_BUFFER_SIZE] __attribute__((aligned(8)));
+static logring_t dmesg_ring = LOGRING_INIT(dmesg_buf);
 
 static void logwriten(const char *msg, int l) {
-    target_disable_irq();
-    if (codalLogStore.ptr + l >= sizeof(codalLogStore.buffer)) {
-#if 1
-        codalLogStore.buffer[0] = '.';
-        codalLogStore.buffer[1] = '.';
-        codalLogStore.buffer[2] = '.';
-        codalLogStore.ptr = 3;
+    logring_write(&dmesg_ring, msg, l);
+}
+
+#if JD_DMESG_BINARY
+// Binary records store the format string address, a timestamp and the raw arguments,
+// instead of the formatted text; they are formatted in codal_dmesg_read(), or on the host
+// with tools/dmesg-decode.py. Layout (little endian):
+//   0x00 marker (text lines never start with NUL), 3 bytes 0
+//   uint32 format string address
+//   uint32 tim_get_micros()
+//   arguments in format order, unaligned: %d %u %x %X %p %c take 4 bytes,
+//   %s and %-s a length byte followed by the characters
+// Messages with other conversions, or too long, are formatted at the call site as before.
+#define BIN_HEADER_SIZE 12
+// so that the hex form fits in a DMESG line
+#define BIN_MAX_SIZE ((DMESG_LINE_SIZE - 4) / 2)
+#define BIN_MAX_STRING 32
+
+static const char *conv_end(const char *p) {
+    while (*p == '-' || (*p >= '0' && *p <= '9'))
+        p++;
+    return p;
+}
+
+// only format strings in flash (string literals) can be recorded by address
+static bool can_record(const char *format) {
+#ifdef FLASH_END
+    if ((uintptr_t)format < FLASH_BASE || (uintptr_t)format > FLASH_END)
+        return false;
+#endif
+    for (const char *p = format; *p; ++p) {
+        if (*p != '%')
+            continue;
+        p = conv_end(p + 1);
+        if (!*p || !strchr("duxXpcs%", *p))
+            return false;
+    }
+    return true;
+}
+
+// returns the record length, or 0 if the text has to be formatted now
+static int record_binary(uint8_t *rec, const char *format, va_list ap) {
+    if (!can_record(format))
+        return 0;
+
+    uint32_t hdr[3] = {0, (uintptr_t)format, (uint32_t)tim_get_micros()};
+    memcpy(rec, hdr, sizeof(hdr));
+    int len = BIN_HEADER_SIZE;
+    // with %-s the string is ours to free, see jd_vsprintf(); only done once recorded
+    void *to_free[4];
+    int num_free = 0;
+
+    for (const char *p = format; *p; ++p) {
+        if (*p != '%')
+            continue;
+        bool free_it = p[1] == '-';
+        p = conv_end(p + 1);
+        if (*p == '%')
+            continue;
+        if (*p == 's') {
+            const char *str = va_arg(ap, const char *);
+            int sl = str ? strlen(str) : 0;
+            if (sl > BIN_MAX_STRING)
+                sl = BIN_MAX_STRING;
+            if (len + 1 + sl <= BIN_MAX_SIZE) {
+                rec[len] = sl;
+                memcpy(rec + len + 1, str, sl);
+            }
+            len += 1 + sl;
+            if (free_it) {
+                if (num_free == sizeof(to_free) / sizeof(to_free[0]))
+                    return 0;
+                to_free[num_free++] = (void *)str;
+            }
+        } else {
+            uint32_t v = va_arg(ap, uint32_t);
+            if (len + 4 <= BIN_MAX_SIZE)
+                memcpy(rec + len, &v, 4);
+            len += 4;
+        }
+    }
+
+    if (len > BIN_MAX_SIZE)
+        return 0;
+    for (int i = 0; i < num_free; ++i)
+        jd_free(to_free[i]);
+    return len;
+}
+
+#if !JD_DMESG_HOST_DECODE
+// %s from a record is a copy, so it must never be freed again (%-s)
+static int format_conv(char *dst, unsigned size, const char *spec, int speclen,
+                       const uint8_t **args) {
+    char f[8];
+    if (speclen > (int)sizeof(f) - 1)
+        speclen = sizeof(f) - 1;
+    if (spec[speclen - 1] == 's') {
+        char str[BIN_MAX_STRING + 1];
+        int sl = **args;
+        memcpy(str, *args + 1, sl);
+        str[sl] = 0;
+        *args += 1 + sl;
+        jd_sprintf(dst, size, "%s", str);
+    } else {
+        uint32_t v;
+        memcpy(&v, *args, 4);
+        *args += 4;
+        memcpy(f, spec, speclen);
+        f[speclen] = 0;
+        jd_sprintf(dst, size, f, v);
+    }
+    return strlen(dst);
+}
+#endif
+
+// turns a binary record into a text line for the consumer
+static int format_binary(const uint8_t *rec, int reclen, char *dst, unsigned maxlen) {
+#if JD_DMESG_HOST_DECODE
+    static const char hex[] = "0123456789abcdef";
+    if (maxlen < (unsigned)reclen * 2 + 4)
+        return -1;
+    int n = 0;
+    dst[n++] = '#';
+    dst[n++] = 'B';
+    dst[n++] = ' ';
+    for (int i = 0; i < reclen; ++i) {
+        dst[n++] = hex[rec[i] >> 4];
+        dst[n++] = hex[rec[i] & 0xf];
+    }
+    dst[n++] = '\n';
+    return n;
 #else
-        // this messes with timings too much
-        const int jump = sizeof(codalLogStore.buffer) / 4;
-        codalLogStore.ptr -= jump;
-        memmove(codalLogStore.buffer, codalLogStore.buffer + jump, codalLogStore.ptr);
-        // zero-out the rest so it looks OK in the debugger
-        memset(codalLogStore.buffer + codalLogStore.ptr, 0,
-               sizeof(codalLogStore.buffer) - codalLogStore.ptr);
+    uint32_t hdr[3];
+    memcpy(hdr, rec, sizeof(hdr));
+    const char *format = (const char *)hdr[1];
+    const uint8_t *args = rec + BIN_HEADER_SIZE;
+    char tmp[DMESG_LINE_SIZE];
+    unsigned n;
+
+    jd_sprintf(tmp, sizeof(tmp), "%d.%d%d%d ", (int)(hdr[2] / 1000000),
+               (int)(hdr[2] / 100000 % 10), (int)(hdr[2] / 10000 % 10), (int)(hdr[2] / 1000 % 10));
+    n = strlen(tmp);
+    for (const char *p = format; *p && n < sizeof(tmp) - 2; ++p) {
+        if (*p != '%') {
+            tmp[n++] = *p;
+            continue;
+        }
+        const char *e = conv_end(p + 1);
+        if (*e == '%')
+            tmp[n++] = '%';
+        else
+            n += format_conv(tmp + n, sizeof(tmp) - 1 - n, p, e - p + 1, &args);
+        p = e;
+    }
+    tmp[n++] = '\n';
+    if (n > maxlen)
+        return -1;
+    memcpy(dst, tmp, n);
+    return n;
+#endif
+}
 #endif
+
+int codal_dmesg_read(char *dst, unsigned maxlen) {
+#if JD_DMESG_BINARY
+    uint8_t rec[DMESG_LINE_SIZE];
+    int len = logring_read(&dmesg_ring, rec, sizeof(rec));
+    if (len <= 0 || rec[0] != 0) {
+        if (len > (int)maxlen)
+            return -1;
+        if (len > 0)
+            memcpy(dst, rec, len);
+        return len;
     }
-    if (l + codalLogStore.ptr >= sizeof(codalLogStore.buffer))
-        return; // shouldn't happen
-    memcpy(codalLogStore.buffer + codalLogStore.ptr, msg, l);
-    codalLogStore.ptr += l;
-    codalLogStore.buffer[codalLogStore.ptr] = 0;
-    target_enable_irq();
+    return format_binary(rec, len, dst, maxlen);
+#else
+    return logring_read(&dmesg_ring, dst, maxlen);
+#endif
+}
+
+int codal_dmesg_read_record(void *dst, unsigned maxlen) {
+    return logring_read(&dmesg_ring, dst, maxlen);
+}
+
+uint32_t codal_dmesg_take_dropped(void) {
+    return logring_take_dropped(&dmesg_ring);
 }
 
 void codal_dmesg(const char *format, ...) {
@@ -46,7 +213,17 @@ void codal_dmesgf(const char *format, ...) {
 }
 
 void codal_vdmesg(const char *format, va_list ap) {
-    char tmp[160];
+    char tmp[DMESG_LINE_SIZE];
+#if JD_DMESG_BINARY
+    va_list ap2;
+    va_copy(ap2, ap);
+    int reclen = record_binary((uint8_t *)tmp, format, ap2);
+    va_end(ap2);
+    if (reclen > 0) {
+        logwriten(tmp, reclen);
+        return;
+    }
+#endif
     jd_vsprintf(tmp, sizeof(tmp) - 1, format, ap);
     int len = strlen(tmp);
     tmp[len] = '\n';
@@ -12,16 +12,36 @@
 #error "Too small DMESG buffer"
 #endif
 
+#if DEVICE_DMESG_BUFFER_SIZE & (DEVICE_DMESG_BUFFER_SIZE - 1)
+#error "DMESG buffer size has to be a power of 2"
+#endif
+
+// longest line written by codal_vdmesg(), including the '\n'
+#define DMESG_LINE_SIZE 160
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-struct CodalLogStore
-{
-    uint32_t ptr;
-    char buffer[DEVICE_DMESG_BUFFER_SIZE];
-};
-extern struct CodalLogStore codalLogStore;
+/**
+  * Copy the oldest buffered line into dst.
+  *
+  * Returns its length (it is not '\0'-terminated), 0 when there are no more lines,
+  * or -1 when the line didn't fit in maxlen and was dropped.
+  * Lines can be read from any thread while others keep logging.
+  */
+int codal_dmesg_read(char *dst, unsigned maxlen);
+
+/**
+  * Like codal_dmesg_read(), but binary records (JD_DMESG_BINARY) are copied as they are,
+  * for the host to format; they start with a 0 byte. Can be called from interrupts.
+  */
+int codal_dmesg_read_record(void *dst, unsigned maxlen);
+
+/**
+  * Number of bytes dropped since the last call, because the buffer was full.
+  */
+uint32_t codal_dmesg_take_dropped(void);
 
 /**
   * Log formatted message to an internal buffer.
@@ -2,7 +2,7 @@
 
 static cb_t callbacks[16];
 
-static void _check_line(int ln) {
+JD_RAMFUNC static void _check_line(int ln) {
 #if defined(STM32F0) || defined(STM32WL) || defined(STM32L4)
     LL_EXTI_ClearFlag_0_31(1 << ln);
 #else
@@ -25,28 +25,114 @@ static void _check_line(int ln) {
     _check_line(ln)
 
 #if defined(STM32WL) || defined(STM32L4)
+#ifdef UART_PIN
+#define UART_LINE (UART_PIN & 0xf)
+#else
+#define UART_LINE 16 // no line matches
+#endif
+#define UART_LINE_IN(lo, hi) (UART_LINE >= (lo) && UART_LINE <= (hi))
+
+#if JD_EXTI_PROBE
+#include "cmsis_utils.h"
+static uint32_t probe_start, probe_max, probe_sum, probe_count;
+
+static inline __attribute__((always_inline)) void probe_begin(void) {
+    PIN_PORT(PIN_EXTI_PROBE)->BSRR = PIN_MASK(PIN_EXTI_PROBE);
+    probe_start = dwt_cycles() | 1; // 0 means no measurement pending
+}
+
+void exti_probe_rx_started(void) {
+    uint32_t start = probe_start;
+    if (!start)
+        return;
+    uint32_t d = dwt_cycles() - start;
+    PIN_PORT(PIN_EXTI_PROBE)->BRR = PIN_MASK(PIN_EXTI_PROBE);
+    probe_start = 0;
+    if (d > probe_max)
+        probe_max = d;
+    probe_sum += d;
+    probe_count++;
+}
+
+void exti_probe_dump(void) {
+    if (!probe_count)
+        return;
+    DMESG("exti->rx: max %d avg %d cycles (%d samples)", (int)probe_max,
+          (int)(probe_sum / probe_count), (int)probe_count);
+    probe_max = probe_sum = probe_count = 0;
+}
+#else
+#define probe_begin() ((void)0)
+#endif
+
+// The Jacdac line skips rtc_sync_time() and the callback table: the receiver has to be
+// started before the first byte of the frame arrives.
+static inline __attribute__((always_inline)) void uart_line_falling(void) {
+    ISR_CYCLES(ISR_CYCLES_EXTI);
+    probe_begin();
+    EXTI->PR1 = 1 << UART_LINE;
+    jd_line_falling();
+}
+
 #define SINGLE(name, ln)                                                                           \
-    void name(void) {                                                                              \
+    JD_RAMFUNC void name(void) {                                                                   \
         rtc_sync_time();                                                                           \
         uint32_t lines = EXTI_LINES();                                                             \
         check_line(ln);                                                                            \
     }
+#define UART_SINGLE(name)                                                                          \
+    JD_RAMFUNC void name(void) {                                                                   \
+        uart_line_falling();                                                                       \
+    }
+
+#if UART_LINE == 0
+UART_SINGLE(EXTI0_IRQHandler)
+#else
 SINGLE(EXTI0_IRQHandler, 0)
+#endif
+#if UART_LINE == 1
+UART_SINGLE(EXTI1_IRQHandler)
+#else
 // SINGLE(EXTI1_IRQHandler, 1)
+#endif
+#if UART_LINE == 2
+UART_SINGLE(EXTI2_IRQHandler)
+#else
 SINGLE(EXTI2_IRQHandler, 2)
+#endif
+#if UART_LINE == 3
+UART_SINGLE(EXTI3_IRQHandler)
+#else
 SINGLE(EXTI3_IRQHandler, 3)
+#endif
+#if UART_LINE == 4
+UART_SINGLE(EXTI4_IRQHandler)
+#else
 SINGLE(EXTI4_IRQHandler, 4)
+#endif
 
-void EXTI9_5_IRQHandler(void) {
-    rtc_sync_time();
+JD_RAMFUNC void EXTI9_5_IRQHandler(void) {
     uint32_t lines = EXTI_LINES();
+#if UART_LINE_IN(5, 9)
+    if (lines & (1 << UART_LINE)) {
+        uart_line_falling();
+        lines &= ~(1 << UART_LINE);
+    }
+#endif
+    rtc_sync_time();
     for (int i = 5; i <= 9; ++i)
         check_line(i);
 }
 
-void EXTI15_10_IRQHandler(void) {
-    rtc_sync_time();
+JD_RAMFUNC void EXTI15_10_IRQHandler(void) {
     uint32_t lines = EXTI_LINES();
+#if UART_LINE_IN(10, 15)
+    if (lines & (1 << UART_LINE)) {
+        uart_line_falling();
+        lines &= ~(1 << UART_LINE);
+    }
+#endif
+    rtc_sync_time();
     for (int i = 10; i <= 15; ++i)
         check_line(i);
 }
@@ -92,8 +178,14 @@ static const uint32_t cfgs[] = {LL_EXTI_CONFIG_PORTA, LL_EXTI_CONFIG_PORTB, LL_E
 void exti_set_callback(uint8_t pin, cb_t callback, uint32_t flags) {
     uint32_t extiport = 0;
 
+#if defined(STM32L4)
+    // up to GPIOE, like the LSM6DSL interrupt on PD11
+    if (pin >> 4 > 4)
+        jd_panic();
+#else
     if (pin >> 4 > 2)
         jd_panic();
+#endif
 #if defined(STM32F0) || defined(STM32WL) || defined(STM32L4)
     extiport = pin >> 4;
 #elif defined(STM32G0)
@@ -122,6 +214,11 @@ void exti_set_callback(uint8_t pin, cb_t callback, uint32_t flags) {
 
     callbacks[pos] = callback;
 
+#if JD_EXTI_PROBE && (defined(STM32WL) || defined(STM32L4))
+    if (pos == UART_LINE)
+        pin_setup_output(PIN_EXTI_PROBE);
+#endif
+
 #define SETUP(irq)                                                                                 \
     NVIC_SetPriority(irq, IRQ_PRIORITY_EXTI);                                                      \
     NVIC_EnableIRQ(irq)
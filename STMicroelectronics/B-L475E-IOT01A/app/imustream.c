@@ -0,0 +1,118 @@
+#include "jdstm.h"
+#include "sensor_sched.h"
+
+#define LOG(msg, ...) DMESG("imustream: " msg, ##__VA_ARGS__)
+
+// Batched accelerometer and gyroscope samples, from the LSM6DSL FIFO (see sensor_sched.h).
+// The accelerometer and gyroscope services send one reading per report, which doesn't go
+// anywhere near the rates vibration monitoring needs; this one sends each FIFO burst, many
+// samples per report. There is no standard service for that, so it has a class of its own.
+//
+// Streaming works like for the sensor services: the client sets streaming_samples and keeps
+// refreshing it, each report uses up one. Once it's 0, the FIFO is turned off and the other
+// two services go back to polled samples.
+
+#define JD_SERVICE_CLASS_IMU_STREAM 0x1e3b6a27
+// rw u16 Hz: rounded up to a rate the chip supports
+#define JD_IMU_STREAM_REG_RATE 0x80
+// ro u16 Hz: the rate in use
+#define JD_IMU_STREAM_REG_ACTUAL_RATE 0x180
+// ro u32: scale of the raw samples, µg/LSB and µdps/LSB
+#define JD_IMU_STREAM_REG_ACC_SCALE 0x181
+#define JD_IMU_STREAM_REG_GYRO_SCALE 0x182
+
+// JD_GET(JD_REG_READING) report; the samples are sensor_imu_raw_t, in the chip's axes
+typedef struct {
+    uint32_t time_us;   // of the first sample, low bits of tim_get_micros()
+    uint32_t period_us; // between samples
+    sensor_imu_raw_t samples[];
+} imu_stream_report_t;
+
+#define SAMPLES_PER_REPORT                                                                         \
+    ((JD_SERIAL_PAYLOAD_SIZE - sizeof(imu_stream_report_t)) / sizeof(sensor_imu_raw_t))
+
+struct srv_state {
+    SRV_COMMON;
+
+    // regs
+    uint8_t streaming_samples;
+    uint16_t rate;
+    uint16_t actual_rate;
+    uint32_t acc_scale;
+    uint32_t gyro_scale;
+
+    // non-regs
+    bool running;
+};
+
+REG_DEFINITION(                             //
+    imustream_regs,                         //
+    REG_SRV_COMMON,                         //
+    REG_U8(JD_REG_STREAMING_SAMPLES),       //
+    REG_U16(JD_IMU_STREAM_REG_RATE),        //
+    REG_U16(JD_IMU_STREAM_REG_ACTUAL_RATE), //
+    REG_U32(JD_IMU_STREAM_REG_ACC_SCALE),   //
+    REG_U32(JD_IMU_STREAM_REG_GYRO_SCALE),  //
+)
+
+static srv_t *_imu_state;
+
+static void on_samples(const sensor_imu_raw_t *samples, unsigned num, uint64_t last_us,
+                       uint32_t period_us) {
+    srv_t *state = _imu_state;
+    static uint8_t buf[JD_SERIAL_PAYLOAD_SIZE];
+    imu_stream_report_t *r = (imu_stream_report_t *)buf;
+
+    if (!state->streaming_samples)
+        return;
+
+    uint32_t time_us = (uint32_t)last_us - (num - 1) * period_us;
+    while (num) {
+        unsigned n = num < SAMPLES_PER_REPORT ? num : SAMPLES_PER_REPORT;
+        r->time_us = time_us;
+        r->period_us = period_us;
+        memcpy(r->samples, samples, n * sizeof(sensor_imu_raw_t));
+        jd_send(state->service_index, JD_GET(JD_REG_READING), r,
+                sizeof(*r) + n * sizeof(sensor_imu_raw_t));
+        samples += n;
+        num -= n;
+        time_us += n * period_us;
+    }
+
+    state->streaming_samples--;
+}
+
+static void start(srv_t *state) {
+    state->actual_rate = sensor_fifo_start(state->rate, on_samples);
+    sensor_fifo_get_scale(&state->acc_scale, &state->gyro_scale);
+    state->running = true;
+    LOG("%d Hz", state->actual_rate);
+}
+
+void imustream_process(srv_t *state) {
+    if (state->streaming_samples && !state->running) {
+        start(state);
+    } else if (!state->streaming_samples && state->running) {
+        sensor_fifo_stop();
+        state->running = false;
+    }
+}
+
+void imustream_handle_packet(srv_t *state, jd_packet_t *pkt) {
+    switch (service_handle_register_final(state, pkt, imustream_regs)) {
+    case JD_IMU_STREAM_REG_RATE:
+        if (state->running)
+            start(state);
+        break;
+    }
+}
+
+SRV_DEF(imustream, JD_SERVICE_CLASS_IMU_STREAM);
+void imustream_init(void) {
+    SRV_ALLOC(imustream);
+
+    state->rate = 416;
+    sensor_fifo_get_scale(&state->acc_scale, &state->gyro_scale);
+
+    _imu_state = state;
+}
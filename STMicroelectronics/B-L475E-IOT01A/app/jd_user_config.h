@@ -3,6 +3,12 @@
 
 #define DEVICE_DMESG_BUFFER_SIZE 1024
 
+// store DMESG() format address and arguments, and format them when the log is read
+#define JD_DMESG_BINARY 0
+// instead of formatting on the device, print binary records as "#B <hex>" lines for
+// tools/dmesg-decode.py
+#define JD_DMESG_HOST_DECODE 0
+
 #include "dmesg.h"
 
 #define JD_LOG DMESG
@@ -24,6 +30,9 @@
 #define JD_FLASH_PAGE_SIZE 1024
 
 #define JD_USB_BRIDGE 1
+// send DMESG as frames of their own on the USB link, when it's up, instead of the console;
+// see usbd_cdc_if.c and tools/usb-dmesg.py
+#define JD_USB_DMESG 1
 
 // probably not so useful on brains...
 #define JD_CONFIG_WATCHDOG 0
@@ -34,11 +43,36 @@ void jdaz_wake_main(void);
 #define JD_WAKE_MAIN() jdaz_wake_main()
 
 #define JD_SIMPLE_ALLOC 0
+// jd_alloc() arena, in SRAM1 .bss; see tlsf.h and platform.c
+#define JD_HEAP_SIZE (20 * 1024)
+// clear jd_alloc() blocks, like calloc(); the Jacdac stack relies on it
+#define JD_ALLOC_ZERO 1
+// per-pass arena for formatting in the Jacdac thread, see scratch.h
+#define JD_SCRATCH_SIZE 2048
+// log heap and scratch use with the other stats, see jd_alloc_stats_dump()
+#define JD_HEAP_STATS 0
 
 #define PIN_JACDAC 0
 #define USART_IDX 4
 #define UART_PIN PIN_JACDAC
 #define UART_PIN_AF 8
+// TIM2_CH1 on PA0, used to generate the end-of-frame break
+#define UART_PIN_TIM_AF 1
+// keep the receiver running on a circular DMA buffer, instead of starting it from EXTI
+#define JD_UART_RX_RING 0
+// record the longest time interrupts were masked per call site, see target_irq_stats_dump()
+#define JD_IRQ_STATS 0
+// raise PIN_EXTI_PROBE in the Jacdac EXTI handler and drop it once uart_start_rx() is done;
+// the latency is also measured with the cycle counter, see exti_probe_dump()
+#define JD_EXTI_PROBE 0
+#define PIN_EXTI_PROBE 0x04 // PA4, ARD.D7
+// run the Jacdac interrupt handlers from SRAM, see JD_RAMFUNC
+#define JD_ISR_IN_RAM 1
+// record cycles spent in each of these handlers, see isr_cycles_dump()
+#define JD_ISR_CYCLES 0
+
+// LSM6DSL INT1, the FIFO watermark interrupt; see sensor_fifo_start()
+#define PIN_IMU_INT1 0x3B // PD11
 
 #define STM32L4
 
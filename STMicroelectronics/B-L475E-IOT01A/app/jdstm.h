@@ -20,6 +20,7 @@
 #endif
 
 #include "lib.h"
+#include "timerq.h"
 
 #define IRQ_PRIORITY_LORA 3
 #define IRQ_PRIORITY_TIM 2
@@ -37,10 +38,75 @@ extern uint8_t cpu_mhz;
 #define EXTI_FALLING 0x01
 #define EXTI_RISING 0x02
 void exti_set_callback(uint8_t pin, cb_t callback, uint32_t flags);
+#if JD_EXTI_PROBE
+// called at the end of uart_start_rx(); records the time since the EXTI handler was entered
+void exti_probe_rx_started(void);
+// DMESG the EXTI to uart_start_rx() latency, and reset it
+void exti_probe_dump(void);
+#endif
+
+// Code that runs from SRAM, without flash wait states; the startup code copies it
+// together with .data. Used for the interrupt handlers on the Jacdac timing path;
+// set JD_ISR_IN_RAM to 0 to run them from flash, e.g. to compare with JD_ISR_CYCLES.
+#if !JD_ISR_IN_RAM
+#define JD_RAMFUNC
+#elif defined(__ICCARM__)
+#define JD_RAMFUNC __ramfunc
+#else
+#define JD_RAMFUNC __attribute__((section(".ramfunc")))
+#endif
+
+#if JD_ISR_CYCLES
+// Cycles spent in the handlers on the Jacdac timing path (excluding entry latency).
+enum {
+    ISR_CYCLES_EXTI,
+    ISR_CYCLES_DMA,
+    ISR_CYCLES_UART,
+    ISR_CYCLES_SEQ_TIM,
+    ISR_CYCLES_TIM,
+    ISR_CYCLES_START_TX,
+    ISR_CYCLES_START_RX,
+    ISR_CYCLES_NUM
+};
+typedef struct {
+    uint8_t slot;
+    uint32_t start;
+} isr_cycles_t;
+void isr_cycles_record(isr_cycles_t *c);
+// DMESG max/average cycles per handler, and reset them
+void isr_cycles_dump(void);
+// records the time until the end of the enclosing scope; GCC only
+#define ISR_CYCLES(s)                                                                              \
+    isr_cycles_t _isr_cycles __attribute__((cleanup(isr_cycles_record))) = {(s), DWT->CYCCNT}
+#else
+#define ISR_CYCLES(s) ((void)0)
+#endif
 
 
 void tim_set_micros(uint64_t us);
+// when set, replaces the default 10ms stack tick
+extern uint16_t tim_max_sleep;
+// Timers independent of tim_set_timer(); cb is called from the timer IRQ.
+// Starting a pending timer again moves it.
+// Unlike tim_set_timer(), these can't be called from above IRQ_PRIORITY_TIM.
+void tim_timer_start(timerq_entry_t *t, uint32_t delta_us, timerq_cb_t cb);
+void tim_timer_cancel(timerq_entry_t *t);
 cb_t tim_steal_callback(uint32_t *usec);
+// Masks interrupts with priority prio or lower (numerically >= prio), and returns
+// the previous mask for target_restore_irq(); these calls nest.
+// Priority 0 interrupts (EXTI, UART) stay enabled - use target_disable_irq() when
+// they need to be masked too.
+uint32_t target_mask_irq_from(uint8_t prio);
+void target_restore_irq(uint32_t prev);
+#if JD_IRQ_STATS
+// DMESG the longest masked time per call site
+void target_irq_stats_dump(void);
+#endif
+#if JD_HEAP_STATS
+// DMESG jd_alloc() use and fragmentation
+void jd_alloc_stats_dump(void);
+#endif
+
 void rtc_sync_time(void);
 void rtc_cancel_cb(void);
 
@@ -87,7 +153,11 @@ static inline bool dma_has_flag(int ch, int flag) {
 #endif
 
 void init_sensors(void);
+// imustream.c
+void imustream_init(void);
 
 void usb_init(void);
+// true when DMESG goes over the USB link instead of the console, see JD_USB_DMESG
+bool jd_usb_dmesg_active(void);
 
 #endif
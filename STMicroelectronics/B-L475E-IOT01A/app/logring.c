@@ -0,0 +1,123 @@
+#include "logring.h"
+
+#include <string.h>
+
+// Records are 8-byte aligned, so the header never wraps around the end of the buffer.
+typedef struct {
+    uint32_t commit; // ~pos once committed, so a zeroed buffer has no committed records
+    uint16_t len;
+    uint16_t reserved;
+} logring_hdr_t;
+
+#define ALIGN8(n) (((n) + 7) & ~7)
+#define RECORD_SIZE(len) (sizeof(logring_hdr_t) + ALIGN8(len))
+
+#define LOAD(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define CAS(p, expected, desired)                                                                  \
+    __atomic_compare_exchange_n(p, &(expected), desired, false, __ATOMIC_ACQ_REL,                  \
+                                __ATOMIC_ACQUIRE)
+
+static inline logring_hdr_t *hdr_at(logring_t *r, uint32_t pos) {
+    return (logring_hdr_t *)(r->buf + (pos & (r->size - 1)));
+}
+
+static void copy_in(logring_t *r, uint32_t pos, const void *src, uint32_t len) {
+    uint32_t off = pos & (r->size - 1);
+    uint32_t n = r->size - off;
+    if (n > len)
+        n = len;
+    memcpy(r->buf + off, src, n);
+    memcpy(r->buf, (const uint8_t *)src + n, len - n);
+}
+
+static void copy_out(logring_t *r, uint32_t pos, void *dst, uint32_t len) {
+    uint32_t off = pos & (r->size - 1);
+    uint32_t n = r->size - off;
+    if (n > len)
+        n = len;
+    memcpy(dst, r->buf + off, n);
+    memcpy((uint8_t *)dst + n, r->buf, len - n);
+}
+
+void logring_init(logring_t *r, void *buf, uint32_t size) {
+    r->buf = buf;
+    r->size = size;
+    r->rd = 0;
+    r->wr = 0;
+    r->dropped = 0;
+    memset(buf, 0, size);
+}
+
+// Drops the oldest record; returns false when it is not committed yet.
+static bool drop_oldest(logring_t *r, uint32_t rd) {
+    logring_hdr_t *h = hdr_at(r, rd);
+    if (LOAD(&h->commit) != ~rd)
+        return false;
+    uint32_t len = h->len;
+    // if this fails, someone else has moved rd already, and len may be garbage
+    if (CAS(&r->rd, rd, rd + RECORD_SIZE(len)))
+        __atomic_fetch_add(&r->dropped, len, __ATOMIC_RELAXED);
+    return true;
+}
+
+bool logring_write(logring_t *r, const void *data, uint32_t len) {
+    uint32_t need = RECORD_SIZE(len);
+    if (len > 0xffff || need > r->size) {
+        __atomic_fetch_add(&r->dropped, len, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    uint32_t wr = LOAD(&r->wr);
+    for (;;) {
+        uint32_t rd = LOAD(&r->rd);
+        if (wr + need - rd > r->size) {
+            if (!drop_oldest(r, rd)) {
+                __atomic_fetch_add(&r->dropped, len, __ATOMIC_RELAXED);
+                return false;
+            }
+            wr = LOAD(&r->wr);
+            continue;
+        }
+        if (CAS(&r->wr, wr, wr + need))
+            break;
+    }
+
+    logring_hdr_t *h = hdr_at(r, wr);
+    h->len = len;
+    h->reserved = 0;
+    copy_in(r, wr + sizeof(logring_hdr_t), data, len);
+    __atomic_store_n(&h->commit, ~wr, __ATOMIC_RELEASE);
+    return true;
+}
+
+int logring_read(logring_t *r, void *dst, uint32_t maxlen) {
+    for (;;) {
+        uint32_t rd = LOAD(&r->rd);
+        if (rd == LOAD(&r->wr))
+            return 0;
+        logring_hdr_t *h = hdr_at(r, rd);
+        if (LOAD(&h->commit) != ~rd) {
+            // either still being written, or was just dropped
+            if (LOAD(&r->rd) == rd)
+                return 0;
+            continue;
+        }
+        uint32_t len = h->len;
+        if (len > maxlen) {
+            // skip it, so the reader doesn't get stuck
+            if (CAS(&r->rd, rd, rd + RECORD_SIZE(len))) {
+                __atomic_fetch_add(&r->dropped, len, __ATOMIC_RELAXED);
+                return -1;
+            }
+            continue;
+        }
+        copy_out(r, rd + sizeof(logring_hdr_t), dst, len);
+        // fails when a producer dropped the record while we were copying it
+        if (CAS(&r->rd, rd, rd + RECORD_SIZE(len)))
+            return len;
+    }
+}
+
+uint32_t logring_take_dropped(logring_t *r) {
+    return __atomic_exchange_n(&r->dropped, 0, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Lock-free ring buffer of variable-length records, used for DMESG.
+//
+// Any number of producers (threads and interrupt handlers at any priority) and consumers
+// can use it at the same time; there is no masking of interrupts. Space is reserved with
+// a compare-and-swap on the write position, the record is copied in, and then committed
+// by storing its (inverted) position in the record header.
+//
+// When the buffer is full, the oldest committed records are dropped to make room, and their
+// size is added to the dropped byte count. If the oldest record is still being written
+// (its producer was preempted), the new record is dropped instead.
+//
+// A consumer copies a record out, and then claims it by moving the read position; if a
+// producer has dropped the record in the meantime, the copy is discarded and it retries.
+//
+// This has no hardware dependencies, beyond the GCC __atomic builtins.
+
+typedef struct {
+    uint8_t *buf;
+    uint32_t size; // power of 2, multiple of 8
+    // free-running byte positions; the buffer offset is (pos & (size - 1))
+    uint32_t rd;
+    uint32_t wr;
+    uint32_t dropped;
+} logring_t;
+
+// A zeroed buffer is a valid empty ring, so it can also be set up statically with this.
+#define LOGRING_INIT(buf) {(uint8_t *)(buf), sizeof(buf), 0, 0, 0}
+
+// buf has to be 8-byte aligned
+void logring_init(logring_t *r, void *buf, uint32_t size);
+
+// Returns false when the record was dropped.
+bool logring_write(logring_t *r, const void *data, uint32_t len);
+
+// Copies out the oldest committed record, if it fits in maxlen.
+// Returns its length, 0 when there is nothing to read (or the oldest record is still being
+// written), and -1 when the record was longer than maxlen; it is then dropped.
+int logring_read(logring_t *r, void *dst, uint32_t maxlen);
+
+// Returns the number of bytes dropped since the last call, and resets it.
+uint32_t logring_take_dropped(logring_t *r);
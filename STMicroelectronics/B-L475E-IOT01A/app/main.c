@@ -14,13 +14,21 @@
 #include "azure_config.h"
 
 #include "azjacdac.h"
+#include "azbridge.h"
+#include "sensor_sched.h"
+#include "interfaces/jd_usb.h"
+#include "scratch.h"
 
 #define AZURE_THREAD_STACK_SIZE 4096
 #define AZURE_THREAD_PRIORITY   4
 
-#define AZ 0
+// Jacdac runs above the Azure thread, so TLS traffic never delays the bus
+#define JACDAC_THREAD_PRIORITY 3
+
+#define AZ 1
 
 TX_THREAD azure_thread;
+TX_THREAD jacdac_thread;
 ULONG azure_thread_stack[AZURE_THREAD_STACK_SIZE / sizeof(ULONG)];
 __attribute__((section(".ram2,\"aw\",%nobits@"))) ULONG jacdac_thread_stack[4096 / 4];
 
@@ -45,30 +53,86 @@ static void azure_thread_entry(ULONG parameter)
 #endif
 
 TX_SEMAPHORE jd_sem;
+
+// copy DMESG lines to the console; the Jacdac stack and interrupts keep logging meanwhile
+static void dmesg_drain(void)
+{
+    static char line[DMESG_LINE_SIZE];
+    int len;
+
+#if JD_USB_DMESG
+    if (jd_usb_dmesg_active())
+    {
+        // sent from the USB interrupt, between Jacdac frames
+        jd_usb_pull_ready();
+        return;
+    }
+#endif
+
+    uint32_t dropped = codal_dmesg_take_dropped();
+    if (dropped)
+    {
+        printf("[dmesg: %lu bytes dropped]\r\n", (unsigned long)dropped);
+    }
+
+    while ((len = codal_dmesg_read(line, sizeof(line))) != 0)
+    {
+        if (len > 0)
+        {
+            fwrite(line, len, 1, stdout);
+        }
+    }
+}
+
 static void jd_loop(ULONG parameter)
 {
     while (1)
     {
-        tx_semaphore_get(&jd_sem, 1);
+        // woken up by jdaz_wake_main(): from the stack, when its timer expires (see timer.c),
+        // or by the sensor scheduler
+        tx_semaphore_get(&jd_sem, TX_WAIT_FOREVER);
+        sensor_sched_process();
         jd_process_everything();
+        // nothing allocated there outlives the pass
+        scratch_reset();
 
-        if (codalLogStore.ptr)
+#if JD_IRQ_STATS || JD_EXTI_PROBE || JD_ISR_CYCLES || JD_HEAP_STATS
+        static uint64_t next_stats;
+        if (tim_get_micros() >= next_stats)
         {
-            fwrite(codalLogStore.buffer, codalLogStore.ptr, 1, stdout);
-            codalLogStore.ptr = 0;
+            next_stats = tim_get_micros() + 10000000;
+#if JD_IRQ_STATS
+            target_irq_stats_dump();
+#endif
+#if JD_EXTI_PROBE
+            exti_probe_dump();
+#endif
+#if JD_ISR_CYCLES
+            isr_cycles_dump();
+#endif
+#if JD_HEAP_STATS
+            jd_alloc_stats_dump();
+            scratch_stats_dump();
+#endif
         }
+#endif
+
+        dmesg_drain();
     }
 }
 
 void jdaz_wake_main(void)
 {
-    tx_semaphore_put(&jd_sem);
+    // any number of wakeups before the loop runs only need one pass
+    tx_semaphore_ceiling_put(&jd_sem, 1);
 }
 
 void tx_application_define(void* first_unused_memory)
 {
     UINT status = TX_SUCCESS;
 
+    azbridge_init();
+
 #if AZ
     // Create Azure thread
     status = tx_thread_create(&azure_thread,
@@ -88,14 +152,14 @@ void tx_application_define(void* first_unused_memory)
     }
 #endif
 
-    status = tx_thread_create(&azure_thread,
+    status = tx_thread_create(&jacdac_thread,
         "Jacdac Thread",
         jd_loop,
         0,
         jacdac_thread_stack,
         sizeof(jacdac_thread_stack),
-        AZURE_THREAD_PRIORITY,
-        AZURE_THREAD_PRIORITY,
+        JACDAC_THREAD_PRIORITY,
+        JACDAC_THREAD_PRIORITY,
         TX_NO_TIME_SLICE,
         TX_AUTO_START);
 
@@ -122,14 +186,12 @@ void app_init_services(void)
 #endif
     init_sensors();
 
-#if 0
-    wifi_init();
+    // the network itself is brought up by the Azure thread
     azureiothub_init();
     jacscloud_init(&azureiothub_cloud);
 #ifndef NO_JACSCRIPT
     tsagg_init(&azureiothub_cloud);
 #endif
-#endif
 }
 
 uint8_t cpu_mhz;
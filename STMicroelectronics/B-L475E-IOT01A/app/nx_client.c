@@ -6,12 +6,6 @@
 #include <stdio.h>
 
 #include "stm32l475e_iot01.h"
-#include "stm32l475e_iot01_accelero.h"
-#include "stm32l475e_iot01_gyro.h"
-#include "stm32l475e_iot01_hsensor.h"
-#include "stm32l475e_iot01_magneto.h"
-#include "stm32l475e_iot01_psensor.h"
-#include "stm32l475e_iot01_tsensor.h"
 
 #include "nx_api.h"
 #include "nx_azure_iot_hub_client.h"
@@ -23,6 +17,8 @@
 #include "azure_config.h"
 #include "azure_device_x509_cert_config.h"
 #include "azure_pnp_info.h"
+#include "azbridge.h"
+#include "sensor_sched.h"
 #include "stm_networking.h"
 
 #define IOT_MODEL_ID "dtmi:azurertos:devkit:gsgstml4s5;2"
@@ -43,6 +39,10 @@
 #define LED_STATE_PROPERTY          "ledState"
 #define SET_LED_STATE_COMMAND       "setLedState"
 
+// The hub stops waiting for a method response after 30s by default; a forwarded method that
+// Jacdac hasn't answered by then gets a 504, and its slot is reused
+#define METHOD_TIMEOUT_TICKS (30 * TX_TIMER_TICKS_PER_SECOND)
+
 typedef enum TELEMETRY_STATE_ENUM
 {
     TELEMETRY_STATE_DEFAULT,
@@ -56,6 +56,19 @@ static AZURE_IOT_NX_CONTEXT __attribute__((section(".ram2,\"aw\",%nobits@"))) az
 
 static int32_t telemetry_interval = 10;
 
+// Jacdac cloud bridge, see azbridge.h
+typedef struct PENDING_METHOD_STRUCT
+{
+    uint32_t method_id;
+    ULONG start_tick;
+    USHORT context_length;
+    UCHAR context[AZBRIDGE_CONTEXT_SIZE];
+} PENDING_METHOD;
+
+static PENDING_METHOD pending_methods[AZBRIDGE_SLOTS];
+static uint32_t last_method_id;
+static volatile bool bridge_ready;
+
 static UINT append_device_info_properties(NX_AZURE_IOT_JSON_WRITER* json_writer)
 {
     if (nx_azure_iot_json_writer_append_property_with_string_value(json_writer,
@@ -105,36 +118,37 @@ static UINT append_device_info_properties(NX_AZURE_IOT_JSON_WRITER* json_writer)
     return NX_AZURE_IOT_SUCCESS;
 }
 
-static UINT append_device_telemetry(NX_AZURE_IOT_JSON_WRITER* json_writer)
+// the sensors are sampled by the Jacdac thread, see sensor_sched.h
+static UINT append_sample(NX_AZURE_IOT_JSON_WRITER* json_writer, sensor_id_t id, const CHAR* const names[], UINT count)
 {
-    if (nx_azure_iot_json_writer_append_property_with_double_value(
-            json_writer, (UCHAR*)TELEMETRY_HUMIDITY, sizeof(TELEMETRY_HUMIDITY) - 1, BSP_HSENSOR_ReadHumidity(), 2) ||
+    sensor_sample_t sample;
 
-        nx_azure_iot_json_writer_append_property_with_double_value(
-            json_writer, (UCHAR*)TELEMETRY_TEMPERATURE, sizeof(TELEMETRY_TEMPERATURE) - 1, BSP_TSENSOR_ReadTemp(), 2) ||
+    if (!sensor_sched_get(id, &sample))
+    {
+        return NX_AZURE_IOT_SUCCESS;
+    }
 
-        nx_azure_iot_json_writer_append_property_with_double_value(
-            json_writer, (UCHAR*)TELEMETRY_PRESSURE, sizeof(TELEMETRY_PRESSURE) - 1, BSP_PSENSOR_ReadPressure(), 2))
+    for (UINT i = 0; i < count; ++i)
     {
-        return NX_NOT_SUCCESSFUL;
+        if (nx_azure_iot_json_writer_append_property_with_double_value(
+                json_writer, (UCHAR*)names[i], strlen(names[i]), sample.value[i] / 1024.0, 2))
+        {
+            return NX_NOT_SUCCESSFUL;
+        }
     }
 
     return NX_AZURE_IOT_SUCCESS;
 }
 
-static UINT append_device_telemetry_magnetometer(NX_AZURE_IOT_JSON_WRITER* json_writer)
+static UINT append_device_telemetry(NX_AZURE_IOT_JSON_WRITER* json_writer)
 {
-    int16_t data[3];
-    BSP_MAGNETO_GetXYZ(data);
-
-    if (nx_azure_iot_json_writer_append_property_with_double_value(
-            json_writer, (UCHAR*)TELEMETRY_MAGNETOMETERX, sizeof(TELEMETRY_MAGNETOMETERX) - 1, data[0], 2) ||
-
-        nx_azure_iot_json_writer_append_property_with_double_value(
-            json_writer, (UCHAR*)TELEMETRY_MAGNETOMETERY, sizeof(TELEMETRY_MAGNETOMETERY) - 1, data[1], 2) ||
+    static const CHAR* const humidity[]    = {TELEMETRY_HUMIDITY};
+    static const CHAR* const temperature[] = {TELEMETRY_TEMPERATURE};
+    static const CHAR* const pressure[]    = {TELEMETRY_PRESSURE};
 
-        nx_azure_iot_json_writer_append_property_with_double_value(
-            json_writer, (UCHAR*)TELEMETRY_MAGNETOMETERZ, sizeof(TELEMETRY_MAGNETOMETERZ) - 1, data[2], 2))
+    if (append_sample(json_writer, SENSOR_HUMIDITY, humidity, 1) ||
+        append_sample(json_writer, SENSOR_TEMPERATURE, temperature, 1) ||
+        append_sample(json_writer, SENSOR_PRESSURE, pressure, 1))
     {
         return NX_NOT_SUCCESSFUL;
     }
@@ -142,44 +156,25 @@ static UINT append_device_telemetry_magnetometer(NX_AZURE_IOT_JSON_WRITER* json_
     return NX_AZURE_IOT_SUCCESS;
 }
 
-static UINT append_device_telemetry_accelerometer(NX_AZURE_IOT_JSON_WRITER* json_writer)
+static UINT append_device_telemetry_magnetometer(NX_AZURE_IOT_JSON_WRITER* json_writer)
 {
-    int16_t data[3];
-    BSP_ACCELERO_AccGetXYZ(data);
+    static const CHAR* const names[] = {TELEMETRY_MAGNETOMETERX, TELEMETRY_MAGNETOMETERY, TELEMETRY_MAGNETOMETERZ};
 
-    if (nx_azure_iot_json_writer_append_property_with_double_value(
-            json_writer, (UCHAR*)TELEMETRY_ACCELEROMETERX, sizeof(TELEMETRY_ACCELEROMETERX) - 1, data[0], 2) ||
-
-        nx_azure_iot_json_writer_append_property_with_double_value(
-            json_writer, (UCHAR*)TELEMETRY_ACCELEROMETERY, sizeof(TELEMETRY_ACCELEROMETERY) - 1, data[1], 2) ||
+    return append_sample(json_writer, SENSOR_MAGNETOMETER, names, 3);
+}
 
-        nx_azure_iot_json_writer_append_property_with_double_value(
-            json_writer, (UCHAR*)TELEMETRY_ACCELEROMETERZ, sizeof(TELEMETRY_ACCELEROMETERZ) - 1, data[2], 2))
-    {
-        return NX_NOT_SUCCESSFUL;
-    }
+static UINT append_device_telemetry_accelerometer(NX_AZURE_IOT_JSON_WRITER* json_writer)
+{
+    static const CHAR* const names[] = {TELEMETRY_ACCELEROMETERX, TELEMETRY_ACCELEROMETERY, TELEMETRY_ACCELEROMETERZ};
 
-    return NX_AZURE_IOT_SUCCESS;
+    return append_sample(json_writer, SENSOR_ACCELEROMETER, names, 3);
 }
 
 static UINT append_device_telemetry_gyroscope(NX_AZURE_IOT_JSON_WRITER* json_writer)
 {
-    float data[3];
-    BSP_GYRO_GetXYZ(data);
-
-    if (nx_azure_iot_json_writer_append_property_with_double_value(
-            json_writer, (UCHAR*)TELEMETRY_GYROSCOPEX, sizeof(TELEMETRY_GYROSCOPEX) - 1, data[0], 2) ||
-
-        nx_azure_iot_json_writer_append_property_with_double_value(
-            json_writer, (UCHAR*)TELEMETRY_GYROSCOPEY, sizeof(TELEMETRY_GYROSCOPEY) - 1, data[1], 2) ||
-
-        nx_azure_iot_json_writer_append_property_with_double_value(
-            json_writer, (UCHAR*)TELEMETRY_GYROSCOPEZ, sizeof(TELEMETRY_GYROSCOPEZ) - 1, data[2], 2))
-    {
-        return NX_NOT_SUCCESSFUL;
-    }
+    static const CHAR* const names[] = {TELEMETRY_GYROSCOPEX, TELEMETRY_GYROSCOPEY, TELEMETRY_GYROSCOPEZ};
 
-    return NX_AZURE_IOT_SUCCESS;
+    return append_sample(json_writer, SENSOR_GYROSCOPE, names, 3);
 }
 
 static void set_led_state(bool level)
@@ -196,6 +191,107 @@ static void set_led_state(bool level)
     }
 }
 
+static void method_response(AZURE_IOT_NX_CONTEXT* nx_context,
+    PENDING_METHOD* pending,
+    UINT http_status,
+    const UCHAR* payload,
+    UINT payload_length)
+{
+    UINT status;
+
+    if ((status = nx_azure_iot_hub_client_command_message_response(&nx_context->iothub_client,
+             http_status,
+             pending->context,
+             pending->context_length,
+             payload,
+             payload_length,
+             NX_WAIT_FOREVER)))
+    {
+        printf("Direct method response failed! (0x%08x)\r\n", status);
+    }
+
+    pending->method_id = 0;
+}
+
+// Answers the methods Jacdac didn't respond to in time, e.g. with no handler or after a reset
+static void expire_methods(AZURE_IOT_NX_CONTEXT* nx_context)
+{
+    ULONG now = tx_time_get();
+
+    for (int i = 0; i < AZBRIDGE_SLOTS; ++i)
+    {
+        PENDING_METHOD* pending = &pending_methods[i];
+        if (pending->method_id != 0 && now - pending->start_tick >= METHOD_TIMEOUT_TICKS)
+        {
+            printf("Direct method %lu timed out\r\n", pending->method_id);
+            method_response(nx_context, pending, 504, NULL, 0);
+        }
+    }
+}
+
+// The request ids are only valid on the connection they came from
+static void disconnected_cb(AZURE_IOT_NX_CONTEXT* nx_context)
+{
+    memset(pending_methods, 0, sizeof(pending_methods));
+}
+
+static UINT forward_command(AZURE_IOT_NX_CONTEXT* nx_context,
+    const UCHAR* method,
+    USHORT method_length,
+    const UCHAR* payload,
+    USHORT payload_length,
+    const VOID* context_ptr,
+    USHORT context_length)
+{
+    PENDING_METHOD* pending = NULL;
+    azbridge_msg_t* msg;
+
+    expire_methods(nx_context);
+
+    for (int i = 0; i < AZBRIDGE_SLOTS; ++i)
+    {
+        if (pending_methods[i].method_id == 0)
+        {
+            pending = &pending_methods[i];
+            break;
+        }
+    }
+
+    if (pending == NULL || context_length > AZBRIDGE_CONTEXT_SIZE ||
+        (msg = azbridge_alloc(&azbridge_from_cloud)) == NULL)
+    {
+        return NX_NOT_SUCCESSFUL;
+    }
+
+    if (method_length + 1 + payload_length > msg->size)
+    {
+        azbridge_cancel(&azbridge_from_cloud);
+        return NX_NOT_SUCCESSFUL;
+    }
+
+    // the request id lives in the command packet, which is released after the callback
+    if (++last_method_id == 0)
+    {
+        last_method_id = 1;
+    }
+    pending->method_id      = last_method_id;
+    pending->start_tick     = tx_time_get();
+    pending->context_length = context_length;
+    memcpy(pending->context, context_ptr, context_length);
+
+    msg->type      = AZBRIDGE_METHOD_CALL;
+    msg->method_id = pending->method_id;
+    msg->len       = method_length + 1 + payload_length;
+    memcpy(msg->data, method, method_length);
+    msg->data[method_length] = 0;
+    memcpy(msg->data + method_length + 1, payload, payload_length);
+    azbridge_push(&azbridge_from_cloud);
+
+    jdaz_wake_main();
+
+    return NX_SUCCESS;
+}
+
 static void command_received_cb(AZURE_IOT_NX_CONTEXT* nx_context_ptr,
     const UCHAR* component,
     USHORT component_length,
@@ -222,12 +318,14 @@ static void command_received_cb(AZURE_IOT_NX_CONTEXT* nx_context_ptr,
 
         azure_iot_nx_client_publish_bool_property(&azure_iot_nx_client, NULL, LED_STATE_PROPERTY, arg);
     }
-    else
+    else if (forward_command(
+                 nx_context_ptr, method, method_length, payload, payload_length, context_ptr, context_length))
     {
-        printf("Direct method is not for this device\r\n");
+        // Jacdac responds through the bridge, unless it's busy
+        printf("Direct method can't be forwarded to Jacdac\r\n");
 
         if ((status = nx_azure_iot_hub_client_command_message_response(
-                 &nx_context_ptr->iothub_client, 501, context_ptr, context_length, NULL, 0, NX_WAIT_FOREVER)))
+                 &nx_context_ptr->iothub_client, 503, context_ptr, context_length, NULL, 0, NX_WAIT_FOREVER)))
         {
             printf("Direct method response failed! (0x%08x)\r\n", status);
             return;
@@ -235,6 +333,61 @@ static void command_received_cb(AZURE_IOT_NX_CONTEXT* nx_context_ptr,
     }
 }
 
+static void respond_method(AZURE_IOT_NX_CONTEXT* nx_context, azbridge_msg_t* msg)
+{
+    for (int i = 0; i < AZBRIDGE_SLOTS; ++i)
+    {
+        PENDING_METHOD* pending = &pending_methods[i];
+        if (pending->method_id == msg->method_id)
+        {
+            method_response(nx_context, pending, msg->status, (UCHAR*)msg->data, msg->len);
+            return;
+        }
+    }
+
+    // timed out, or from before a reconnection
+    printf("Direct method response for unknown method %lu\r\n", msg->method_id);
+}
+
+static void cloud_bridge_cb(AZURE_IOT_NX_CONTEXT* nx_context)
+{
+    azbridge_msg_t* msg;
+
+    while ((msg = azbridge_peek(&azbridge_to_cloud)) != NULL)
+    {
+        switch (msg->type)
+        {
+            case AZBRIDGE_TELEMETRY:
+                azure_iot_nx_client_publish_telemetry_raw(nx_context, NULL, (UCHAR*)msg->data, msg->len);
+                break;
+
+            case AZBRIDGE_METHOD_RESPONSE:
+                respond_method(nx_context, msg);
+                break;
+
+            default:
+                break;
+        }
+
+        azbridge_pop(&azbridge_to_cloud);
+    }
+
+    expire_methods(nx_context);
+}
+
+void azbridge_notify_cloud(void)
+{
+    if (bridge_ready)
+    {
+        azure_iot_nx_client_app_event_set(&azure_iot_nx_client);
+    }
+}
+
+bool azbridge_cloud_connected(void)
+{
+    return bridge_ready && azure_iot_nx_client.azure_iot_connection_status == NX_SUCCESS;
+}
+
 static void writable_property_received_cb(AZURE_IOT_NX_CONTEXT* nx_context,
     const UCHAR* component_name,
     UINT component_name_len,
@@ -297,6 +450,8 @@ static void telemetry_cb(AZURE_IOT_NX_CONTEXT* nx_context)
 {
     static TELEMETRY_STATE telemetry_state = TELEMETRY_STATE_DEFAULT;
 
+    expire_methods(nx_context);
+
     switch (telemetry_state)
     {
         case TELEMETRY_STATE_DEFAULT:
@@ -345,6 +500,11 @@ UINT azure_iot_nx_client_entry(
     azure_iot_nx_client_register_property_callback(&azure_iot_nx_client, property_received_cb);
     azure_iot_nx_client_register_properties_complete_callback(&azure_iot_nx_client, properties_complete_cb);
     azure_iot_nx_client_register_timer_callback(&azure_iot_nx_client, telemetry_cb, telemetry_interval);
+    azure_iot_nx_client_register_app_event_callback(&azure_iot_nx_client, cloud_bridge_cb);
+    azure_iot_nx_client_register_disconnected_callback(&azure_iot_nx_client, disconnected_cb);
+
+    memset(pending_methods, 0, sizeof(pending_methods));
+    bridge_ready = true;
 
     // Setup authentication
 #ifdef ENABLE_X509
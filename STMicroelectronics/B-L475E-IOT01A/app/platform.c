@@ -1,5 +1,8 @@
 #include "azjacdac.h"
 #include "wifi.h"
+#include "cmsis_utils.h"
+#include "tlsf.h"
+#include "newlib_nano.h"
 #include <stdlib.h>
 
 int jd_pin_num(void) {
@@ -18,18 +21,77 @@ uint64_t hw_device_id(void) {
     return addr;
 }
 
+// jd_alloc() has its own arena, so a leak or fragmentation there doesn't take newlib's heap
+// (and printf) down with it. It is in SRAM1 .bss, where calloc() used to serve it from;
+// SRAM2 is full with the Jacdac thread stack, the Azure IoT context and the newlib heap.
+static tlsf_t jd_heap;
+#if JD_HEAP_STATS
+static uint32_t num_jd_allocs;
+#endif
+static uint8_t jd_heap_arena[JD_HEAP_SIZE] __attribute__((aligned(TLSF_ALIGN)));
+
 void jd_alloc_stack_check(void) {}
 
-void jd_alloc_init(void) {}
+void jd_alloc_init(void) {
+    uint32_t prev = target_mask_irq_from(IRQ_PRIORITY_DMA);
+    if (!jd_heap.end)
+        tlsf_init(&jd_heap, jd_heap_arena, sizeof(jd_heap_arena));
+    target_restore_irq(prev);
+}
 
 void *jd_alloc(uint32_t size) {
-    return calloc(size, 1);
+    if (!jd_heap.end)
+        jd_alloc_init();
+
+    // allocating and freeing are constant time, so this is short; nothing allocates from
+    // the EXTI and UART interrupts, so they stay enabled
+    uint32_t prev = target_mask_irq_from(IRQ_PRIORITY_DMA);
+    void *r = tlsf_malloc(&jd_heap, size);
+#if JD_HEAP_STATS
+    num_jd_allocs++;
+#endif
+    target_restore_irq(prev);
+
+    if (!r) {
+        DMESG("OOM: %d bytes", (int)size);
+        jd_panic();
+    }
+#if JD_ALLOC_ZERO
+    memset(r, 0, size);
+#endif
+    return r;
 }
 
 void jd_free(void *ptr) {
-    free(ptr);
+    uint32_t prev = target_mask_irq_from(IRQ_PRIORITY_DMA);
+    bool ok = tlsf_free(&jd_heap, ptr);
+    target_restore_irq(prev);
+
+    if (!ok) {
+        DMESG("bad free: %p", ptr);
+        jd_panic();
+    }
 }
 
+#if JD_HEAP_STATS
+void jd_alloc_stats_dump(void) {
+    tlsf_stats_t s;
+    uint32_t prev = target_mask_irq_from(IRQ_PRIORITY_DMA);
+    tlsf_get_stats(&jd_heap, &s);
+    target_restore_irq(prev);
+    // the share of free memory that can't be allocated in one block
+    int frag = s.free ? 100 - (int)((uint64_t)s.largest_free * 100 / s.free) : 0;
+    DMESG("heap: %d used in %d blocks, peak %d, %d free, largest %d (%d%% fragmented), "
+          "%d failed",
+          (int)s.in_use, (int)s.num_allocs, (int)s.peak, (int)s.free, (int)s.largest_free, frag,
+          (int)s.num_failed);
+    DMESG("heap: %d allocs since last time", (int)num_jd_allocs);
+    num_jd_allocs = 0;
+    DMESG("newlib heap: high water %d of %d", (int)heap_high_water(), (int)heap_size());
+}
+#endif
+
+// separate from the jd_alloc() arena, which may be what ran out
 void *jd_alloc_emergency_area(uint32_t size) {
     return calloc(size, 1);
 }
@@ -39,27 +101,132 @@ void target_reset() {
 }
 
 void target_wait_us(uint32_t us) {
-    int64_t later = tim_get_micros() + us;
-    while (tim_get_micros() < later) {
-        ;
-    }
+    dwt_delay_us(us);
 }
 
 static int8_t irq_disabled;
 
+#if JD_IRQ_STATS
+// longest time interrupts were masked, per call site
+#define IRQ_STATS_SITES 16
+typedef struct {
+    void *site;
+    uint32_t max_cycles;
+    uint32_t count;
+} irq_site_t;
+static irq_site_t irq_sites[IRQ_STATS_SITES];
+static uint32_t irq_off_start, basepri_start;
+static void *irq_off_site, *basepri_site;
+
+// has to be called with PRIMASK set
+static void irq_stats_record(void *site, uint32_t cycles) {
+    for (int i = 0; i < IRQ_STATS_SITES; ++i) {
+        irq_site_t *s = &irq_sites[i];
+        if (s->site == NULL)
+            s->site = site;
+        if (s->site == site) {
+            s->count++;
+            if (cycles > s->max_cycles)
+                s->max_cycles = cycles;
+            return;
+        }
+    }
+}
+
+void target_irq_stats_dump(void) {
+    for (int i = 0; i < IRQ_STATS_SITES; ++i) {
+        irq_site_t *s = &irq_sites[i];
+        if (!s->site)
+            break;
+        DMESG("IRQ masked at %p: max %d cycles (%d us), %d times", s->site, (int)s->max_cycles,
+              (int)dwt_cycles_to_us(s->max_cycles), (int)s->count);
+    }
+}
+#endif
+
+#if JD_ISR_CYCLES
+static const char *const isr_cycles_names[ISR_CYCLES_NUM] = {
+    "EXTI", "DMA", "UART", "SEQ_TIM", "TIM", "start_tx", "start_rx",
+};
+static struct {
+    uint32_t max_cycles;
+    uint32_t sum;
+    uint32_t count;
+} isr_cycles[ISR_CYCLES_NUM];
+
+// each slot is only updated from a single priority level, so there is no locking
+void isr_cycles_record(isr_cycles_t *c) {
+    uint32_t d = dwt_cycles() - c->start;
+    if (d > isr_cycles[c->slot].max_cycles)
+        isr_cycles[c->slot].max_cycles = d;
+    isr_cycles[c->slot].sum += d;
+    isr_cycles[c->slot].count++;
+}
+
+void isr_cycles_dump(void) {
+    DMESG("ISR cycles (%s):", JD_ISR_IN_RAM ? "SRAM" : "flash");
+    for (int i = 0; i < ISR_CYCLES_NUM; ++i) {
+        if (!isr_cycles[i].count)
+            continue;
+        DMESG("  %s: max %d avg %d, %d times", isr_cycles_names[i],
+              (int)isr_cycles[i].max_cycles, (int)(isr_cycles[i].sum / isr_cycles[i].count),
+              (int)isr_cycles[i].count);
+    }
+    memset(isr_cycles, 0, sizeof(isr_cycles));
+}
+#endif
+
 void target_enable_irq(void) {
     irq_disabled--;
     if (irq_disabled <= 0) {
         irq_disabled = 0;
+#if JD_IRQ_STATS
+        irq_stats_record(irq_off_site, dwt_cycles() - irq_off_start);
+#endif
         asm volatile("cpsie i" : : : "memory");
     }
 }
 
-void target_disable_irq(void) {
+__attribute__((noinline)) void target_disable_irq(void) {
     asm volatile("cpsid i" : : : "memory");
+#if JD_IRQ_STATS
+    if (irq_disabled == 0) {
+        irq_off_site = __builtin_return_address(0);
+        irq_off_start = dwt_cycles();
+    }
+#endif
     irq_disabled++;
 }
 
+#define PRIO_TO_BASEPRI(prio) ((prio) << (8 - __NVIC_PRIO_BITS))
+
+__attribute__((noinline)) uint32_t target_mask_irq_from(uint8_t prio) {
+    // BASEPRI of 0 means no masking, priority 0 can only be masked with PRIMASK
+    if (prio == 0)
+        jd_panic();
+    uint32_t prev = __get_BASEPRI();
+    __set_BASEPRI_MAX(PRIO_TO_BASEPRI(prio));
+#if JD_IRQ_STATS
+    if (prev == 0) {
+        basepri_site = __builtin_return_address(0);
+        basepri_start = dwt_cycles();
+    }
+#endif
+    return prev;
+}
+
+void target_restore_irq(uint32_t prev) {
+#if JD_IRQ_STATS
+    if (prev == 0) {
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        irq_stats_record(basepri_site, dwt_cycles() - basepri_start);
+        __set_PRIMASK(primask);
+    }
+#endif
+    __set_BASEPRI(prev);
+}
+
 int target_in_irq(void) {
     return (SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk) != 0;
 }
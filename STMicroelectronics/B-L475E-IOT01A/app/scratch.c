@@ -0,0 +1,108 @@
+#include "jdstm.h"
+#include "scratch.h"
+
+#define ALIGN8(n) (((n) + 7) & ~7)
+
+static uint8_t scratch_buf[JD_SCRATCH_SIZE] __attribute__((aligned(8)));
+// offset of the first free byte, and of the last allocation (for scratch_append())
+static uint32_t scratch_top, scratch_last;
+
+#if JD_HEAP_STATS
+static uint32_t num_allocs, num_failed, peak;
+#define STAT(x) x
+#else
+#define STAT(x) ((void)0)
+#endif
+
+void *scratch_alloc(uint32_t size) {
+    if (size > JD_SCRATCH_SIZE - scratch_top) {
+        STAT(num_failed++);
+        return NULL;
+    }
+    void *r = scratch_buf + scratch_top;
+    scratch_last = scratch_top;
+    scratch_top += ALIGN8(size);
+    STAT(num_allocs++);
+    STAT(peak = scratch_top > peak ? scratch_top : peak);
+    return r;
+}
+
+// formats at dst, up to the end of the arena; returns the length or -1 when it doesn't fit
+static int format_at(char *dst, const char *format, va_list ap) {
+    int avail = scratch_buf + JD_SCRATCH_SIZE - (uint8_t *)dst;
+    if (avail < 2)
+        return -1;
+    jd_vsprintf(dst, avail, format, ap);
+    int len = strlen(dst);
+    // the output is truncated to fit, so filling the space means it probably didn't
+    if (len >= avail - 1)
+        return -1;
+    return len;
+}
+
+char *scratch_vsprintf(const char *format, va_list ap) {
+    char *dst = (char *)scratch_buf + scratch_top;
+    int len = format_at(dst, format, ap);
+    if (len < 0) {
+        STAT(num_failed++);
+        return NULL;
+    }
+    return scratch_alloc(len + 1);
+}
+
+char *scratch_sprintf(const char *format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    char *r = scratch_vsprintf(format, ap);
+    va_end(ap);
+    return r;
+}
+
+char *scratch_append(char *str, const char *format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    char *r;
+    if (str == NULL) {
+        r = scratch_vsprintf(format, ap);
+    } else if ((uint8_t *)str != scratch_buf + scratch_last) {
+        jd_panic();
+    } else {
+        int prev = strlen(str);
+        int len = format_at(str + prev, format, ap);
+        if (len < 0) {
+            str[prev] = 0;
+            STAT(num_failed++);
+            r = NULL;
+        } else {
+            scratch_top = scratch_last + ALIGN8(prev + len + 1);
+            STAT(peak = scratch_top > peak ? scratch_top : peak);
+            r = str;
+        }
+    }
+    va_end(ap);
+    return r;
+}
+
+scratch_mark_t scratch_mark(void) {
+    return scratch_top;
+}
+
+void scratch_release(scratch_mark_t mark) {
+    if (mark > scratch_top)
+        jd_panic();
+    scratch_top = mark;
+    // appending to whatever was before the mark isn't allowed any more
+    scratch_last = JD_SCRATCH_SIZE;
+}
+
+void scratch_reset(void) {
+    scratch_release(0);
+}
+
+#if JD_HEAP_STATS
+void scratch_stats_dump(void) {
+    DMESG("scratch: %d allocs, %d failed, peak %d of %d", (int)num_allocs, (int)num_failed,
+          (int)peak, JD_SCRATCH_SIZE);
+    num_allocs = num_failed = peak = 0;
+}
+#endif
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdarg.h>
+
+// Bump-pointer arena for short-lived data in the Jacdac thread, like the arguments of a cloud
+// method and their log line.
+//
+// Everything allocated here is released at the end of each jd_process_everything() pass, in
+// jd_loop(); scratch_mark()/scratch_release() release it earlier, and can be nested.
+// There is no locking, so only use it from the Jacdac thread.
+
+typedef uint32_t scratch_mark_t;
+
+// 8-byte aligned, not cleared; NULL when the arena is full
+void *scratch_alloc(uint32_t size);
+
+// jd_sprintf() into the arena; NULL when it doesn't fit.
+// Don't pass scratch strings as %-s, that would jd_free() them.
+char *scratch_sprintf(const char *format, ...);
+char *scratch_vsprintf(const char *format, va_list ap);
+
+// Appends to str, which has to be the last thing allocated (or NULL, to start a new string),
+// and returns it. Returns NULL when it doesn't fit; the arena is then left as it was.
+char *scratch_append(char *str, const char *format, ...);
+
+scratch_mark_t scratch_mark(void);
+// frees everything allocated since the mark was taken
+void scratch_release(scratch_mark_t mark);
+// frees everything; called from jd_loop()
+void scratch_reset(void);
+
+#if JD_HEAP_STATS
+// DMESG the arena use since the last call
+void scratch_stats_dump(void);
+#endif
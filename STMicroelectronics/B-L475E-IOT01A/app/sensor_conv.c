@@ -0,0 +1,89 @@
+#include "sensor_conv.h"
+
+static inline int16_t le16(const uint8_t *p) {
+    return (int16_t)(p[0] | (p[1] << 8));
+}
+
+// v * scale, rounded to 22.10; saturated, the gyroscope's 2000 dps range goes up to 2293 dps
+static inline int32_t scale(int32_t v, int64_t s) {
+    int64_t r = (v * s + (1 << (SENSOR_SCALE_SHIFT - 1))) >> SENSOR_SCALE_SHIFT;
+    return r > INT32_MAX ? INT32_MAX : r < INT32_MIN ? INT32_MIN : (int32_t)r;
+}
+
+// n / d, rounded to nearest; d can't be 0
+static int64_t div_round(int64_t n, int32_t d) {
+    if (d < 0) {
+        n = -n;
+        d = -d;
+    }
+    return (n >= 0 ? n + d / 2 : n - d / 2) / d;
+}
+
+// (v1 - v0) / (out1 - out0), scaled; v is in 1/div units
+static int64_t cal_slope(int32_t v0, int32_t v1, int16_t out0, int16_t out1, int div) {
+    if (out1 == out0)
+        return 0;
+    return div_round((int64_t)(v1 - v0) * (1024 / div) << SENSOR_SCALE_SHIFT, out1 - out0);
+}
+
+void hts221_cal_init(hts221_cal_t *cal, const uint8_t regs[HTS221_CAL_LEN]) {
+    // interpolation points, in °C * 8 and %RH * 2; register offsets from 0x30
+    int32_t h0_x2 = regs[0x0];
+    int32_t h1_x2 = regs[0x1];
+    int32_t t0_x8 = regs[0x2] | ((regs[0x5] & 0x03) << 8);
+    int32_t t1_x8 = regs[0x3] | ((regs[0x5] & 0x0C) << 6);
+
+    cal->t0_out = le16(regs + 0xC);
+    cal->t0 = t0_x8 * (1024 / 8);
+    cal->t_slope = cal_slope(t0_x8, t1_x8, cal->t0_out, le16(regs + 0xE), 8);
+
+    cal->h0_out = le16(regs + 0x6);
+    cal->h0 = h0_x2 * (1024 / 2);
+    cal->h_slope = cal_slope(h0_x2, h1_x2, cal->h0_out, le16(regs + 0xA), 2);
+}
+
+int32_t hts221_temperature(const hts221_cal_t *cal, const uint8_t *raw) {
+    return cal->t0 + scale(le16(raw) - cal->t0_out, cal->t_slope);
+}
+
+int32_t hts221_humidity(const hts221_cal_t *cal, const uint8_t *raw) {
+    int32_t h = cal->h0 + scale(le16(raw) - cal->h0_out, cal->h_slope);
+    return h < 0 ? 0 : h > 100 * 1024 ? 100 * 1024 : h;
+}
+
+int32_t lps22hb_pressure(const uint8_t *raw) {
+    // 24 bit two's complement, 4096 LSB/hPa
+    int32_t p = (int32_t)((raw[0] << 8) | (raw[1] << 16) | ((uint32_t)raw[2] << 24)) >> 8;
+    return (p + 2) >> 2;
+}
+
+// the sensitivities of the BSP component drivers (lsm6dsl.h, lis3mdl.h), by FS code
+int64_t lsm6dsl_acc_scale(uint8_t ctrl1_xl) {
+    // FS_XL: 2g, 16g, 4g, 8g
+    static const int64_t scales[4] = {SENSOR_SCALE(0.061f), SENSOR_SCALE(0.488f),
+                                      SENSOR_SCALE(0.122f), SENSOR_SCALE(0.244f)};
+    return scales[(ctrl1_xl >> 2) & 3];
+}
+
+int64_t lsm6dsl_gyro_scale(uint8_t ctrl2_g) {
+    // FS_G: 245, 500, 1000, 2000 dps
+    static const int64_t scales[4] = {SENSOR_SCALE(8.750f), SENSOR_SCALE(17.50f),
+                                      SENSOR_SCALE(35.00f), SENSOR_SCALE(70.00f)};
+    return scales[(ctrl2_g >> 2) & 3];
+}
+
+int64_t lis3mdl_mag_scale(uint8_t ctrl_reg2) {
+    // FS: 4, 8, 12, 16 gauss
+    static const int64_t scales[4] = {SENSOR_SCALE(0.14f), SENSOR_SCALE(0.29f),
+                                      SENSOR_SCALE(0.43f), SENSOR_SCALE(0.58f)};
+    return scales[(ctrl_reg2 >> 5) & 3];
+}
+
+void sensor_convert_xyz(const uint8_t *raw, int32_t *value, int64_t s) {
+    for (int i = 0; i < 3; ++i)
+        value[i] = scale(le16(raw + 2 * i), s);
+}
+
+uint32_t sensor_micro_per_lsb(int64_t s) {
+    return (uint32_t)((s * 1000 + (1LL << (SENSOR_SCALE_SHIFT + 9))) >> (SENSOR_SCALE_SHIFT + 10));
+}
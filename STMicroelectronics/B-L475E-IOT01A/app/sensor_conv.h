@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+
+// Conversion of the on-board sensors' raw readings to 22.10 fixed point, for sensor_sched.c.
+//
+// Integer only: scales are in 22.10 units per LSB, with SENSOR_SCALE_SHIFT more fractional
+// bits, so that the result is within 1/1024 over the whole 16 bit range. That's a 64 bit
+// multiply per value, and no division. No hardware dependencies.
+
+#define SENSOR_SCALE_SHIFT 24
+// for float sensitivities; a constant expression, no float code is generated
+#define SENSOR_SCALE(sensitivity)                                                                  \
+    ((int64_t)((sensitivity) * (1024.0 * (1 << SENSOR_SCALE_SHIFT)) + 0.5))
+
+// HTS221 calibration registers, H0_RH_X2 (0x30) to T1_OUT_H (0x3F)
+#define HTS221_CAL_LEN 16
+
+// HTS221 interpolation, as an offset and a slope
+typedef struct {
+    int16_t t0_out;
+    int32_t t0;      // °C
+    int64_t t_slope; // °C per LSB, scaled
+    int16_t h0_out;
+    int32_t h0;      // %RH
+    int64_t h_slope; // %RH per LSB, scaled
+} hts221_cal_t;
+
+void hts221_cal_init(hts221_cal_t *cal, const uint8_t regs[HTS221_CAL_LEN]);
+// raw is TEMP_OUT_L/H, °C
+int32_t hts221_temperature(const hts221_cal_t *cal, const uint8_t *raw);
+// raw is HUMIDITY_OUT_L/H, %RH, clamped to 0..100
+int32_t hts221_humidity(const hts221_cal_t *cal, const uint8_t *raw);
+
+// raw is PRESS_OUT_XL/L/H, hPa
+int32_t lps22hb_pressure(const uint8_t *raw);
+
+// Scales for the full scale bits of the control registers, as set up by the BSP.
+// LSM6DSL CTRL1_XL, mg per LSB
+int64_t lsm6dsl_acc_scale(uint8_t ctrl1_xl);
+// LSM6DSL CTRL2_G, mdps per LSB
+int64_t lsm6dsl_gyro_scale(uint8_t ctrl2_g);
+// LIS3MDL CTRL_REG2, mgauss per LSB
+int64_t lis3mdl_mag_scale(uint8_t ctrl_reg2);
+
+// three little-endian 16 bit values, times scale
+void sensor_convert_xyz(const uint8_t *raw, int32_t *value, int64_t scale);
+
+// the scale in milli-units, times 1000
+uint32_t sensor_micro_per_lsb(int64_t scale);
@@ -0,0 +1,537 @@
+#include "jdstm.h"
+#include "sensor_sched.h"
+#include "sensor_conv.h"
+
+#include "stm32l475e_iot01_accelero.h"
+#include "stm32l475e_iot01_hsensor.h"
+#include "stm32l475e_iot01_magneto.h"
+#include "stm32l475e_iot01_psensor.h"
+#include "stm32l475e_iot01_tsensor.h"
+
+#include "mem_sections.h"
+
+#define LOG(msg, ...) DMESG("sensors: " msg, ##__VA_ARGS__)
+
+// longest register block read
+#define MAX_READ 6
+// a transfer takes well under 1ms at 400kHz; this only catches lost interrupts
+#define XFER_TIMEOUT_US 20000
+// added to the timeout per byte read, for the FIFO bursts (100kHz)
+#define XFER_BYTE_US 100
+// keeps timer deadlines close, see timerq.h
+#define MAX_SLEEP_US 1000000
+
+// set in the multi-byte reads of the HTS221 and LIS3MDL, which don't auto-increment otherwise
+#define AUTO_INC 0x80
+
+#define IMU_ADDR LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW
+// a FIFO set is gyroscope x/y/z, then accelerometer x/y/z
+#define FIFO_SET_WORDS 6
+#define FIFO_SET_BYTES (FIFO_SET_WORDS * 2)
+// read per burst; about 40ms at the highest rate, the FIFO itself holds 341 sets
+#define FIFO_MAX_SETS 32
+// watermark at about 50ms of samples
+#define FIFO_BURSTS_PER_SEC 20
+#define FIFO_MAX_ODR 7 // 833Hz
+// FIFO_CTRL3: both sensors in the FIFO, without decimation
+#define FIFO_CTRL3_NO_DEC 0x09
+#define FIFO_MODE_BYPASS 0x00
+#define FIFO_MODE_CONTINUOUS 0x06
+#define FIFO_STATUS2_OVER_RUN 0x40
+#define INT1_FTH 0x08
+
+extern I2C_HandleTypeDef hI2cHandler; // from the BSP
+
+typedef struct {
+    uint8_t addr;
+    uint8_t reg;
+    uint8_t len;
+    void (*convert)(const uint8_t *raw, int32_t *value);
+    uint32_t period_ms;
+} sensor_desc_t;
+
+// Samples are double-buffered: the writer fills buf[(seq + 1) & 1], then bumps seq. A reader
+// copies buf[seq & 1], and starts over if seq changed meanwhile, so it never waits for a
+// writer that was preempted half-way.
+typedef struct {
+    uint32_t period_ms;
+    uint64_t next_us;
+    volatile uint32_t seq; // number of samples so far
+    sensor_sample_t buf[2];
+} sensor_state_t;
+
+enum { XFER_IDLE, XFER_BUSY, XFER_DONE, XFER_ERROR };
+// xfer_sensor values for the FIFO reads, past the sensor ids
+enum { XFER_FIFO_STATUS = SENSOR_NUM, XFER_FIFO_DATA };
+
+static sensor_state_t sensor_state[SENSOR_NUM];
+
+// the next transfer goes to the buffer not being converted
+static uint8_t rx_buf[2][MAX_READ] DMA_BUFFER;
+static uint8_t xfer_buf;
+static uint8_t xfer_sensor;
+static uint64_t xfer_start_us;
+static uint32_t xfer_timeout_us;
+static volatile uint8_t xfer_state;
+static volatile uint64_t xfer_done_us;
+
+static DMA_HandleTypeDef hdma_i2c_rx;
+static timerq_entry_t wakeup_timer;
+
+// sample rates of the ODR_XL/ODR_G/ODR_FIFO codes
+static const uint16_t odr_hz[FIFO_MAX_ODR + 1] = {0, 13, 26, 52, 104, 208, 416, 833};
+
+static struct {
+    sensor_fifo_cb_t cb;
+    uint8_t req_odr; // set by sensor_fifo_start(), 0 to stop
+    uint8_t odr;     // what the chip is set to
+    bool exti_ready;
+    uint8_t ctrl1_xl, ctrl2_g; // as set by the BSP, restored when streaming stops
+    uint16_t sets;             // watermark
+    uint32_t period_us;
+    volatile bool irq;
+    // drained then even without an interrupt, in case an edge was missed
+    uint64_t poll_us;
+    // the burst read after a status read; read_len is 0 when there is none
+    uint16_t read_len;
+    uint16_t skip_words;
+    uint16_t read_sets;
+    uint64_t last_us;
+} fifo;
+
+// words left over from a partial set come first
+static uint8_t fifo_buf[(FIFO_SET_WORDS - 1) * 2 + FIFO_MAX_SETS * FIFO_SET_BYTES] DMA_BUFFER;
+
+// the FIFO data is cast to this; the core is little-endian, like the chip
+_Static_assert(sizeof(sensor_imu_raw_t) == FIFO_SET_BYTES, "FIFO set");
+
+// calibration and full scales, read once; see sensor_conv.h
+static hts221_cal_t hts221_cal;
+static int64_t acc_scale, gyro_scale, mag_scale;
+
+static void convert_temperature(const uint8_t *raw, int32_t *value) {
+    value[0] = hts221_temperature(&hts221_cal, raw);
+}
+
+static void convert_humidity(const uint8_t *raw, int32_t *value) {
+    value[0] = hts221_humidity(&hts221_cal, raw);
+}
+
+static void convert_pressure(const uint8_t *raw, int32_t *value) {
+    value[0] = lps22hb_pressure(raw);
+}
+
+static void convert_accelerometer(const uint8_t *raw, int32_t *value) {
+    sensor_convert_xyz(raw, value, acc_scale);
+}
+
+static void convert_gyroscope(const uint8_t *raw, int32_t *value) {
+    sensor_convert_xyz(raw, value, gyro_scale);
+}
+
+static void convert_magnetometer(const uint8_t *raw, int32_t *value) {
+    sensor_convert_xyz(raw, value, mag_scale);
+}
+
+static const sensor_desc_t sensors[SENSOR_NUM] = {
+    [SENSOR_TEMPERATURE] = {HTS221_I2C_ADDRESS, HTS221_TEMP_OUT_L_REG | AUTO_INC, 2,
+                            convert_temperature, 1000},
+    [SENSOR_HUMIDITY] = {HTS221_I2C_ADDRESS, HTS221_HR_OUT_L_REG | AUTO_INC, 2, convert_humidity,
+                         1000},
+    [SENSOR_PRESSURE] = {LPS22HB_I2C_ADDRESS, LPS22HB_PRESS_OUT_XL_REG, 3, convert_pressure, 1000},
+    [SENSOR_ACCELEROMETER] = {LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_OUTX_L_XL, 6,
+                              convert_accelerometer, 20},
+    [SENSOR_GYROSCOPE] = {LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_OUTX_L_G, 6,
+                          convert_gyroscope, 20},
+    [SENSOR_MAGNETOMETER] = {LIS3MDL_MAG_I2C_ADDRESS_HIGH, LIS3MDL_MAG_OUTX_L | AUTO_INC, 6,
+                             convert_magnetometer, 100},
+};
+
+static void publish(int id, const uint8_t *raw, uint64_t time_us) {
+    sensor_state_t *s = &sensor_state[id];
+    uint32_t seq = s->seq + 1;
+    sensor_sample_t *dst = &s->buf[seq & 1];
+    sensors[id].convert(raw, dst->value);
+    dst->time_us = time_us;
+    __DMB();
+    s->seq = seq;
+}
+
+bool sensor_sched_get(sensor_id_t id, sensor_sample_t *dst) {
+    sensor_state_t *s = &sensor_state[id];
+    for (;;) {
+        uint32_t seq = s->seq;
+        if (seq == 0)
+            return false;
+        __DMB();
+        *dst = s->buf[seq & 1];
+        __DMB();
+        if (s->seq == seq)
+            return true;
+    }
+}
+
+void sensor_sched_set_period(sensor_id_t id, uint32_t period_ms) {
+    sensor_state_t *s = &sensor_state[id];
+    s->period_ms = period_ms;
+    s->next_us = tim_get_micros();
+    jdaz_wake_main();
+}
+
+static void xfer_done(int state) {
+    if (xfer_state != XFER_BUSY)
+        return;
+    xfer_done_us = tim_get_micros();
+    xfer_state = state;
+    jdaz_wake_main();
+}
+
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c) {
+    if (hi2c == &hI2cHandler)
+        xfer_done(XFER_DONE);
+}
+
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c) {
+    if (hi2c == &hI2cHandler)
+        xfer_done(XFER_ERROR);
+}
+
+void I2C2_EV_IRQHandler(void) {
+    HAL_I2C_EV_IRQHandler(&hI2cHandler);
+}
+
+void I2C2_ER_IRQHandler(void) {
+    HAL_I2C_ER_IRQHandler(&hI2cHandler);
+}
+
+void DMA1_Channel5_IRQHandler(void) {
+    HAL_DMA_IRQHandler(&hdma_i2c_rx);
+}
+
+static void fifo_irq(void) {
+    fifo.irq = true;
+    jdaz_wake_main();
+}
+
+uint32_t sensor_fifo_start(uint32_t rate_hz, sensor_fifo_cb_t cb) {
+    uint8_t odr = 1;
+    while (odr < FIFO_MAX_ODR && odr_hz[odr] < rate_hz)
+        odr++;
+    fifo.cb = cb;
+    fifo.req_odr = odr;
+    jdaz_wake_main();
+    return odr_hz[odr];
+}
+
+void sensor_fifo_stop(void) {
+    fifo.req_odr = 0;
+    jdaz_wake_main();
+}
+
+void sensor_fifo_get_scale(uint32_t *acc_ug, uint32_t *gyro_udps) {
+    *acc_ug = sensor_micro_per_lsb(acc_scale);
+    *gyro_udps = sensor_micro_per_lsb(gyro_scale);
+}
+
+// the accelerometer and gyroscope aren't polled while the FIFO runs
+static bool is_polled(int id) {
+    return !fifo.odr || (id != SENSOR_ACCELEROMETER && id != SENSOR_GYROSCOPE);
+}
+
+static void imu_write(uint8_t reg, uint8_t value) {
+    SENSOR_IO_Write(IMU_ADDR, reg, value);
+}
+
+static uint8_t imu_read(uint8_t reg) {
+    return SENSOR_IO_Read(IMU_ADDR, reg);
+}
+
+// Applies fifo.req_odr, with blocking writes; only called when no transfer is running.
+static void fifo_config(uint64_t now) {
+    uint8_t odr = fifo.req_odr;
+
+    // bypass mode also empties the FIFO
+    imu_write(LSM6DSL_ACC_GYRO_FIFO_CTRL5, FIFO_MODE_BYPASS);
+    fifo.read_len = 0;
+    fifo.irq = false;
+
+    if (!odr) {
+        exti_disable(PIN_MASK(PIN_IMU_INT1));
+        imu_write(LSM6DSL_ACC_GYRO_INT1_CTRL, imu_read(LSM6DSL_ACC_GYRO_INT1_CTRL) & ~INT1_FTH);
+        imu_write(LSM6DSL_ACC_GYRO_CTRL1_XL, fifo.ctrl1_xl);
+        imu_write(LSM6DSL_ACC_GYRO_CTRL2_G, fifo.ctrl2_g);
+        fifo.odr = 0;
+        sensor_state[SENSOR_ACCELEROMETER].next_us = now;
+        sensor_state[SENSOR_GYROSCOPE].next_us = now;
+        LOG("FIFO off");
+        return;
+    }
+
+    if (!fifo.odr) {
+        fifo.ctrl1_xl = imu_read(LSM6DSL_ACC_GYRO_CTRL1_XL);
+        fifo.ctrl2_g = imu_read(LSM6DSL_ACC_GYRO_CTRL2_G);
+    }
+
+    uint32_t hz = odr_hz[odr];
+    uint32_t sets = hz / FIFO_BURSTS_PER_SEC;
+    if (sets < 1)
+        sets = 1;
+    if (sets > FIFO_MAX_SETS)
+        sets = FIFO_MAX_SETS;
+    uint32_t watermark = sets * FIFO_SET_WORDS;
+
+    // same rate for both sensors and the FIFO, full scales unchanged
+    imu_write(LSM6DSL_ACC_GYRO_CTRL1_XL, (fifo.ctrl1_xl & 0x0F) | (odr << 4));
+    imu_write(LSM6DSL_ACC_GYRO_CTRL2_G, (fifo.ctrl2_g & 0x0F) | (odr << 4));
+    imu_write(LSM6DSL_ACC_GYRO_FIFO_CTRL1, watermark & 0xFF);
+    imu_write(LSM6DSL_ACC_GYRO_FIFO_CTRL2, watermark >> 8);
+    imu_write(LSM6DSL_ACC_GYRO_FIFO_CTRL3, FIFO_CTRL3_NO_DEC);
+    imu_write(LSM6DSL_ACC_GYRO_INT1_CTRL, imu_read(LSM6DSL_ACC_GYRO_INT1_CTRL) | INT1_FTH);
+    imu_write(LSM6DSL_ACC_GYRO_FIFO_CTRL5, (odr << 3) | FIFO_MODE_CONTINUOUS);
+
+    fifo.odr = odr;
+    fifo.sets = sets;
+    fifo.period_us = 1000000 / hz;
+    fifo.poll_us = now + 2 * sets * fifo.period_us;
+
+    if (!fifo.exti_ready) {
+        __HAL_RCC_GPIOD_CLK_ENABLE();
+        pin_setup_input(PIN_IMU_INT1, 0);
+        exti_set_callback(PIN_IMU_INT1, fifo_irq, EXTI_RISING);
+        fifo.exti_ready = true;
+    } else {
+        exti_enable(PIN_MASK(PIN_IMU_INT1));
+    }
+
+    LOG("FIFO at %dHz, %d samples per burst", (int)hz, (int)sets);
+}
+
+// FIFO_STATUS1..4: sets up the burst read of what's there
+static void fifo_status(const uint8_t *raw, uint64_t time_us) {
+    uint32_t words = raw[0] | ((raw[1] & 0x07) << 8);
+    // the next word to read, within a set
+    uint32_t pattern = raw[2] | ((raw[3] & 0x03) << 8);
+    uint32_t skip = pattern ? FIFO_SET_WORDS - pattern : 0;
+
+    if (raw[1] & FIFO_STATUS2_OVER_RUN)
+        LOG("FIFO overrun");
+    if (words < skip + FIFO_SET_WORDS)
+        return;
+
+    uint32_t avail = (words - skip) / FIFO_SET_WORDS;
+    uint32_t sets = avail < FIFO_MAX_SETS ? avail : FIFO_MAX_SETS;
+    fifo.skip_words = skip;
+    fifo.read_sets = sets;
+    fifo.read_len = (skip + sets * FIFO_SET_WORDS) * 2;
+    // the newest set was about done when the status was read
+    fifo.last_us = time_us - (avail - sets) * fifo.period_us;
+    // the rest is read right after
+    if (avail > sets)
+        fifo.irq = true;
+}
+
+static void fifo_data(void) {
+    const sensor_imu_raw_t *samples =
+        (const sensor_imu_raw_t *)(fifo_buf + fifo.skip_words * 2);
+    unsigned num = fifo.read_sets;
+    const uint8_t *last = (const uint8_t *)&samples[num - 1];
+
+    publish(SENSOR_GYROSCOPE, last, fifo.last_us);
+    publish(SENSOR_ACCELEROMETER, last + 6, fifo.last_us);
+    if (fifo.cb)
+        fifo.cb(samples, num, fifo.last_us, fifo.period_us);
+
+    // INT1 is a level; if the FIFO is above the watermark again, there is no new edge
+    if (LL_GPIO_IsInputPinSet(PIN_PORT(PIN_IMU_INT1), PIN_MASK(PIN_IMU_INT1)))
+        fifo.irq = true;
+}
+
+static void bus_reset(void) {
+    HAL_DMA_Abort(&hdma_i2c_rx);
+    HAL_I2C_DeInit(&hI2cHandler);
+    SENSOR_IO_Init();
+}
+
+// the due sensor with the earliest deadline, or -1
+static int next_due(uint64_t now) {
+    int r = -1;
+    for (int i = 0; i < SENSOR_NUM; ++i) {
+        sensor_state_t *s = &sensor_state[i];
+        if (s->period_ms && is_polled(i) && s->next_us <= now &&
+            (r < 0 || s->next_us < sensor_state[r].next_us))
+            r = i;
+    }
+    return r;
+}
+
+static bool start_read(int id, uint8_t addr, uint8_t reg, uint8_t *dst, uint16_t len,
+                       uint64_t now) {
+    xfer_sensor = id;
+    xfer_start_us = now;
+    xfer_timeout_us = XFER_TIMEOUT_US + len * XFER_BYTE_US;
+    // set before starting, the completion can come right away
+    xfer_state = XFER_BUSY;
+    if (HAL_I2C_Mem_Read_DMA(&hI2cHandler, addr, reg, I2C_MEMADD_SIZE_8BIT, dst, len) != HAL_OK) {
+        // retried on the next pass
+        xfer_state = XFER_IDLE;
+        return false;
+    }
+    return true;
+}
+
+// the FIFO goes before the polled sensors; true when it needed the bus
+static bool fifo_start_next(uint64_t now) {
+    if (!fifo.odr)
+        return false;
+
+    if (fifo.read_len) {
+        // FIFO_DATA_OUT_H rolls back to FIFO_DATA_OUT_L, so this reads consecutive words
+        if (start_read(XFER_FIFO_DATA, IMU_ADDR, LSM6DSL_ACC_GYRO_FIFO_DATA_OUT_L, fifo_buf,
+                       fifo.read_len, now))
+            fifo.read_len = 0;
+        return true;
+    }
+
+    if (!fifo.irq && now < fifo.poll_us)
+        return false;
+    // cleared first, so that an edge during the read isn't lost
+    fifo.irq = false;
+    fifo.poll_us = now + 2 * fifo.sets * fifo.period_us;
+    xfer_buf ^= 1;
+    if (!start_read(XFER_FIFO_STATUS, IMU_ADDR, LSM6DSL_ACC_GYRO_FIFO_STATUS1, rx_buf[xfer_buf], 4,
+                    now))
+        fifo.irq = true;
+    return true;
+}
+
+static void start_next(uint64_t now) {
+    if (fifo_start_next(now))
+        return;
+
+    int id = next_due(now);
+    if (id < 0)
+        return;
+
+    const sensor_desc_t *d = &sensors[id];
+    xfer_buf ^= 1;
+    if (!start_read(id, d->addr, d->reg, rx_buf[xfer_buf], d->len, now))
+        return;
+
+    sensor_state_t *s = &sensor_state[id];
+    s->next_us += s->period_ms * 1000;
+    // don't try to catch up after a stall
+    if (s->next_us <= now)
+        s->next_us = now + s->period_ms * 1000;
+}
+
+static void schedule_wakeup(uint64_t now) {
+    uint64_t next = now + MAX_SLEEP_US;
+    if (xfer_state == XFER_BUSY) {
+        next = xfer_start_us + xfer_timeout_us;
+    } else {
+        if (fifo.odr)
+            next = fifo.read_len || fifo.irq ? now : fifo.poll_us;
+        for (int i = 0; i < SENSOR_NUM; ++i) {
+            sensor_state_t *s = &sensor_state[i];
+            if (s->period_ms && is_polled(i) && s->next_us < next)
+                next = s->next_us;
+        }
+    }
+    tim_timer_start(&wakeup_timer, next > now ? next - now : 0, jdaz_wake_main);
+}
+
+void sensor_sched_process(void) {
+    uint64_t now = tim_get_micros();
+    int done = -1;
+    const uint8_t *raw = NULL;
+    uint64_t done_us = 0;
+
+    switch (xfer_state) {
+    case XFER_BUSY:
+        if (now - xfer_start_us > xfer_timeout_us) {
+            LOG("timeout reading %d", xfer_sensor);
+            xfer_state = XFER_IDLE;
+            bus_reset();
+        }
+        break;
+    case XFER_DONE:
+        done = xfer_sensor;
+        raw = rx_buf[xfer_buf];
+        done_us = xfer_done_us;
+        xfer_state = XFER_IDLE;
+        break;
+    case XFER_ERROR:
+        LOG("error %x reading %d", (unsigned)hI2cHandler.ErrorCode, xfer_sensor);
+        xfer_state = XFER_IDLE;
+        break;
+    }
+
+    // the FIFO reads are handled before the next transfer, which depends on them
+    if (done == XFER_FIFO_STATUS) {
+        fifo_status(raw, done_us);
+        done = -1;
+    } else if (done == XFER_FIFO_DATA) {
+        fifo_data();
+        done = -1;
+    }
+
+    if (xfer_state == XFER_IDLE && fifo.req_odr != fifo.odr)
+        fifo_config(now);
+
+    // the next transfer runs while the last one is converted
+    if (xfer_state == XFER_IDLE)
+        start_next(now);
+    if (done >= 0)
+        publish(done, raw, done_us);
+
+    schedule_wakeup(now);
+}
+
+static void dma_init(void) {
+    __HAL_RCC_DMA1_CLK_ENABLE();
+
+    hdma_i2c_rx.Instance = DMA1_Channel5;
+    hdma_i2c_rx.Init.Request = DMA_REQUEST_3; // I2C2_RX
+    hdma_i2c_rx.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma_i2c_rx.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_i2c_rx.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_i2c_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
+    hdma_i2c_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
+    hdma_i2c_rx.Init.Mode = DMA_NORMAL;
+    hdma_i2c_rx.Init.Priority = DMA_PRIORITY_LOW;
+    HAL_DMA_Init(&hdma_i2c_rx);
+    __HAL_LINKDMA(&hI2cHandler, hdmarx, hdma_i2c_rx);
+
+    // same priority as the I2C interrupts the BSP set up, so they don't preempt each other
+    HAL_NVIC_SetPriority(DMA1_Channel5_IRQn, 0x0F, 0);
+    HAL_NVIC_EnableIRQ(DMA1_Channel5_IRQn);
+}
+
+static void read_calibration(void) {
+    uint8_t regs[HTS221_CAL_LEN];
+    SENSOR_IO_ReadMultiple(HTS221_I2C_ADDRESS, HTS221_H0_RH_X2 | AUTO_INC, regs, sizeof(regs));
+    hts221_cal_init(&hts221_cal, regs);
+
+    // full scales, as set by the BSP init
+    acc_scale = lsm6dsl_acc_scale(imu_read(LSM6DSL_ACC_GYRO_CTRL1_XL));
+    gyro_scale = lsm6dsl_gyro_scale(imu_read(LSM6DSL_ACC_GYRO_CTRL2_G));
+    mag_scale =
+        lis3mdl_mag_scale(SENSOR_IO_Read(LIS3MDL_MAG_I2C_ADDRESS_HIGH, LIS3MDL_MAG_CTRL_REG2));
+}
+
+void sensor_sched_init(void) {
+    read_calibration();
+
+    // first samples with blocking reads, so that readers always have one
+    uint64_t now = tim_get_micros();
+    for (int i = 0; i < SENSOR_NUM; ++i) {
+        const sensor_desc_t *d = &sensors[i];
+        if (SENSOR_IO_ReadMultiple(d->addr, d->reg, rx_buf[0], d->len) == HAL_OK)
+            publish(i, rx_buf[0], now);
+        sensor_state[i].period_ms = d->period_ms;
+        sensor_state[i].next_us = now + d->period_ms * 1000;
+    }
+
+    dma_init();
+    schedule_wakeup(now);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Background sampling of the on-board I2C2 sensors.
+//
+// Each sensor is read at its own period with an interrupt driven transfer (DMA for the data),
+// and the converted sample is cached; readers only copy the cache, so they never wait for
+// the bus. Transfers are started from sensor_sched_process(), in the Jacdac thread; the
+// completion interrupt wakes that thread up. Once sensor_sched_init() has run, this module
+// owns I2C2: the blocking BSP sensor functions must not be used anymore.
+
+typedef enum {
+    SENSOR_TEMPERATURE,   // °C
+    SENSOR_HUMIDITY,      // %RH
+    SENSOR_PRESSURE,      // hPa
+    SENSOR_ACCELEROMETER, // mg, x/y/z
+    SENSOR_GYROSCOPE,     // mdps, x/y/z
+    SENSOR_MAGNETOMETER,  // mgauss, x/y/z
+    SENSOR_NUM
+} sensor_id_t;
+
+typedef struct {
+    int32_t value[3]; // 22.10 fixed point; only value[0] for single-axis sensors
+    uint64_t time_us; // tim_get_micros() when the transfer completed
+} sensor_sample_t;
+
+// reads the calibration data (blocking), and starts sampling; call from the Jacdac thread,
+// after the BSP sensor init
+void sensor_sched_init(void);
+// called from jd_loop()
+void sensor_sched_process(void);
+
+// 0 stops sampling the sensor; its last sample stays available
+void sensor_sched_set_period(sensor_id_t id, uint32_t period_ms);
+
+// The latest sample; false when there isn't one yet. Can be called from any thread.
+bool sensor_sched_get(sensor_id_t id, sensor_sample_t *dst);
+
+// LSM6DSL FIFO streaming
+//
+// The accelerometer and gyroscope samples are collected by the chip's FIFO; the watermark
+// interrupt (INT1) wakes the Jacdac thread, which drains the FIFO with one burst read and
+// hands the samples to the callback. Polled sampling of the two is suspended meanwhile,
+// their cached sample is the last one of each burst.
+
+// one FIFO entry, as the chip stores it; raw values, see sensor_fifo_get_scale()
+typedef struct {
+    int16_t gyro[3];
+    int16_t acc[3];
+} sensor_imu_raw_t;
+
+// Called from sensor_sched_process(); samples is only valid during the call. last_us is
+// the time of the last sample, they are period_us apart.
+typedef void (*sensor_fifo_cb_t)(const sensor_imu_raw_t *samples, unsigned num, uint64_t last_us,
+                                 uint32_t period_us);
+
+// Starts (or changes the rate of) FIFO streaming; the chip is set up on the next
+// sensor_sched_process(). The rate is rounded up to one the chip supports, at most 833Hz;
+// returns it.
+uint32_t sensor_fifo_start(uint32_t rate_hz, sensor_fifo_cb_t cb);
+void sensor_fifo_stop(void);
+// µg/LSB and µdps/LSB of the raw samples
+void sensor_fifo_get_scale(uint32_t *acc_ug, uint32_t *gyro_udps);
@@ -2,12 +2,7 @@
 
 #include "jd_drivers.h"
 #include "services/jd_services.h"
-#include "stm32l475e_iot01_tsensor.h"
-#include "stm32l475e_iot01_accelero.h"
-#include "stm32l475e_iot01_gyro.h"
-#include "stm32l475e_iot01_hsensor.h"
-#include "stm32l475e_iot01_psensor.h"
-#include <math.h>
+#include "sensor_sched.h"
 
 static env_reading_t temp_r = {0, 512, -40 * 1024, 125 * 1024};
 static env_reading_t humi_r = {0, 3584, 0, 100 * 1024};
@@ -25,49 +20,50 @@ void accelerometer_data_transform(int32_t sample[3])
 
 static void void_sensor_func(void) { }
 
+// The sensors are sampled in the background (sensor_sched.c); these only copy the latest
+// sample, and keep the previous value if there is none.
+
+static void* l475_get_env(sensor_id_t id, env_reading_t* r)
+{
+    sensor_sample_t sample;
+    if (sensor_sched_get(id, &sample))
+        r->value = sample.value[0];
+    return r;
+}
+
 static void* l475_get_temperature(void)
 {
-    temp_r.value = (int32_t) round(BSP_TSENSOR_ReadTemp() * 1024);
-    return &temp_r;
+    return l475_get_env(SENSOR_TEMPERATURE, &temp_r);
 }
 
 static void* l475_get_humidity(void)
 {
-    humi_r.value = (int32_t) round(BSP_HSENSOR_ReadHumidity() * 1024);
-    return &humi_r;
+    return l475_get_env(SENSOR_HUMIDITY, &humi_r);
 }
 
 static void* l475_get_barometer(void)
 {
-    baro_r.value = (int32_t) round(BSP_PSENSOR_ReadPressure() * 1024);
-    return &baro_r;
+    return l475_get_env(SENSOR_PRESSURE, &baro_r);
 }
 
+static void* l475_get_xyz(sensor_id_t id, int32_t* sample)
+{
+    sensor_sample_t s;
+    if (sensor_sched_get(id, &s))
+        memcpy(sample, s.value, sizeof(s.value));
+    return sample;
+}
 
 static void* l475_get_accelerometer(void)
 {
-    int16_t data[3];
     static int32_t sample[3];
-    BSP_ACCELERO_AccGetXYZ(data);
-
-    sample[0] = data[0] * 1024;
-    sample[1] = data[1] * 1024;
-    sample[2] = data[2] * 1024;
-
-    return sample;
+    return l475_get_xyz(SENSOR_ACCELEROMETER, sample);
 }
 
 static void* l475_get_gyroscope(void)
 {
-    float data[3];
     static int32_t sample[3];
-    BSP_GYRO_GetXYZ(data);
-
-    sample[0] = ((int32_t)round(data[0])) * 1024;
-    sample[1] = ((int32_t)round(data[1])) * 1024;
-    sample[2] = ((int32_t)round(data[2])) * 1024;
-
-    return sample;
+    return l475_get_xyz(SENSOR_GYROSCOPE, sample);
 }
 
 const env_sensor_api_t temperature_l475 = {
@@ -103,9 +99,12 @@ const gyroscope_api_t l475_gyroscope = {
 
 void init_sensors(void)
 {
+    sensor_sched_init();
+
     temperature_init(&temperature_l475);
     accelerometer_init(&l475_accelerometer);
     gyroscope_init(&l475_gyroscope);
+    imustream_init();
     humidity_init(&l475_humidity);
     barometer_init(&l475_barometer);
 }
\ No newline at end of file
@@ -10,6 +10,7 @@
 
 #include "wifi.h"
 
+#include "mem_sections.h"
 #include "sntp_client.h"
 
 #define NETX_IP_STACK_SIZE 2048
@@ -20,8 +21,8 @@
 #define NETX_IPV4_ADDRESS IP_ADDRESS(0, 0, 0, 0)
 #define NETX_IPV4_MASK    IP_ADDRESS(255, 255, 255, 0)
 
-static UCHAR netx_ip_stack[NETX_IP_STACK_SIZE];
-static UCHAR netx_ip_pool[NETX_POOL_SIZE];
+static UCHAR netx_ip_stack[NETX_IP_STACK_SIZE] FAST_BSS;
+static UCHAR netx_ip_pool[NETX_POOL_SIZE] DMA_BUFFER;
 
 static CHAR* netx_ssid;
 static CHAR* netx_password;
@@ -0,0 +1,77 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "tx_api.h"
+
+#include "azjacdac.h"
+
+// ThreadX low power hooks, see tx_user.h.
+// ThreadX calls these from the idle loop with interrupts disabled. SysTick is stopped
+// for the duration of the sleep, and the system timer (which keeps running) wakes the
+// core up for the next ThreadX timer expiration. On wakeup, the slept time is handed
+// back to ThreadX as ticks; the remainder is carried over to the next sleep.
+
+#define US_PER_TICK (1000000 / TX_TIMER_TICKS_PER_SECOND)
+// keeps the wakeup deadline within the range of the timer queue (see timerq.h); after an
+// early wakeup, ThreadX goes back to sleep for the rest
+#define MAX_SLEEP_US 1000000
+
+static timerq_entry_t wakeup_timer;
+static uint64_t sleep_start;
+static uint32_t residual_us;
+static bool sleeping;
+
+static void tickless_wakeup(void)
+{
+    // nothing to do, the interrupt has already woken the core up
+}
+
+void tickless_enter(void)
+{
+    SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+
+    // part of the current tick that has already elapsed
+    residual_us += (SysTick->LOAD - SysTick->VAL) / cpu_mhz;
+    sleep_start = tim_get_micros();
+    sleeping    = true;
+}
+
+void tickless_timer_setup(unsigned long ticks)
+{
+    uint64_t us = (uint64_t)ticks * US_PER_TICK;
+
+    if (us > residual_us)
+    {
+        us -= residual_us;
+    }
+    else
+    {
+        us = 0;
+    }
+
+    if (us > MAX_SLEEP_US)
+    {
+        us = MAX_SLEEP_US;
+    }
+
+    tim_timer_start(&wakeup_timer, (uint32_t)us, tickless_wakeup);
+}
+
+unsigned long tickless_timer_adjust(void)
+{
+    if (!sleeping)
+    {
+        return 0;
+    }
+
+    sleeping = false;
+    tim_timer_cancel(&wakeup_timer);
+
+    uint64_t slept = tim_get_micros() - sleep_start + residual_us;
+    residual_us    = slept % US_PER_TICK;
+
+    SysTick->VAL = 0;
+    SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+
+    return slept / US_PER_TICK;
+}
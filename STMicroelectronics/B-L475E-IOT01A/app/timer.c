@@ -1,7 +1,14 @@
 #include "jdstm.h"
 #include "azjacdac.h"
-
-#ifdef SYSTIM_ON_TIM14
+#include "timerq.h"
+
+#if defined(SYSTIM_ON_TIM5)
+#define TIMx TIM5
+#define TIMx_IRQn TIM5_IRQn
+#define TIMx_IRQHandler TIM5_IRQHandler
+#define TIMx_CLK_EN() __HAL_RCC_TIM5_CLK_ENABLE()
+#define TIM_32BIT 1
+#elif defined(SYSTIM_ON_TIM14)
 #define TIMx TIM14
 #define TIMx_IRQn TIM14_IRQn
 #define TIMx_IRQHandler TIM14_IRQHandler
@@ -13,12 +20,39 @@
 #define TIMx_CLK_EN() __HAL_RCC_TIM17_CLK_ENABLE()
 #endif
 
-static volatile int64_t timeoff;
-static volatile cb_t timer_cb;
+#ifndef TIM_32BIT
+#define TIM_32BIT 0
+#endif
+
+#if TIM_32BIT
+#define TIM_PERIOD 0x100000000ULL
+// how far ahead CC1 can be set
+#define TIM_MAX_DELTA 0x40000000
+#else
+#define TIM_PERIOD 0x10000
+#define TIM_MAX_DELTA 0x8000
+#endif
+
+// ticks of the free-running counter before its current period
+static volatile uint64_t timeoff;
+// difference between tim_get_micros() and the counter, see tim_set_micros()
+static volatile int64_t timebase;
+
+static timerq_t timers;
+// the single timer used by the Jacdac stack through tim_set_timer()
+static timerq_entry_t jd_timer;
+static cb_t jd_timer_cb;
+
+// tim_set_timer() is also called from the UART interrupts, which run above
+// IRQ_PRIORITY_TIM. It only stores the request here, and raises CC1 so that
+// TIMx_IRQHandler() moves it into the queue.
+static volatile cb_t jd_req_cb;
+static volatile uint32_t jd_req_deadline;
+static volatile bool jd_req_pending;
 
 uint16_t tim_max_sleep;
 
-uint64_t tim_get_micros(void) {
+static uint64_t tim_get_ticks(void) {
     while (1) {
         uint32_t v0 = TIMx->CNT;
         uint64_t off = timeoff;
@@ -27,12 +61,74 @@ uint64_t tim_get_micros(void) {
         if (v0 <= v1) {
             // ovr can be set when the our interrupt is masked
             if (ovr)
-                off += 0x10000;
+                off += TIM_PERIOD;
             return off + v1;
         }
     }
 }
 
+uint64_t tim_get_micros(void) {
+    return timebase + tim_get_ticks();
+}
+
+// the time base of the timer queue
+static inline uint32_t tim_now(void) {
+#if TIM_32BIT
+    return TIMx->CNT;
+#else
+    return (uint32_t)tim_get_ticks();
+#endif
+}
+
+// Set CC1 for the first timer in queue.
+// Has to be called from TIMx_IRQHandler() or with IRQ_PRIORITY_TIM masked.
+JD_RAMFUNC static void tim_program(void) {
+    timerq_entry_t *e = timerq_peek(&timers);
+    bool due = false;
+
+    if (e) {
+        int32_t delta = e->deadline - tim_now();
+        if (delta > TIM_MAX_DELTA)
+            delta = TIM_MAX_DELTA; // CC1 will fire early, and we'll come back here
+        if (delta > 0) {
+            LL_TIM_OC_SetCompareCH1(TIMx, TIMx->CNT + (uint32_t)delta);
+            LL_TIM_ClearFlag_CC1(TIMx);
+            // the compare could have been missed between reading CNT and clearing the flag
+            due = !timerq_before(tim_now(), e->deadline);
+        } else {
+            due = true;
+        }
+    }
+
+    // a tim_set_timer() could have raised CC1 just before we cleared it
+    if (due || jd_req_pending)
+        LL_TIM_GenerateEvent_CC1(TIMx);
+}
+
+// The stack's timer is its next deadline, which is also when the Jacdac loop has work to do:
+// the loop doesn't keep a timer of its own.
+JD_RAMFUNC static void jd_timer_expired(void) {
+    if (jd_timer_cb)
+        jd_timer_cb();
+    jdaz_wake_main();
+}
+
+JD_RAMFUNC static void tim_take_request(void) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    bool pending = jd_req_pending;
+    cb_t cb = jd_req_cb;
+    uint32_t deadline = jd_req_deadline;
+    jd_req_pending = false;
+    __set_PRIMASK(primask);
+
+    if (pending) {
+        jd_timer_cb = cb;
+        jd_timer.cb = jd_timer_expired;
+        timerq_insert(&timers, &jd_timer, deadline);
+    }
+}
+
 #if 0
 cb_t tim_steal_callback(uint32_t *usec) {
     cb_t f;
@@ -51,11 +147,10 @@ cb_t tim_steal_callback(uint32_t *usec) {
 #endif
 
 void tim_set_micros(uint64_t us) {
-    timeoff = us;
-    LL_TIM_DisableCounter(TIMx);
-    TIMx->CNT = 0;
-    LL_TIM_EnableCounter(TIMx);
-    LL_TIM_ClearFlag_UPDATE(TIMx);
+    // the counter keeps running, so that pending timers are not affected
+    target_disable_irq();
+    timebase = us - tim_get_ticks();
+    target_enable_irq();
 }
 
 void tim_set_timer(int delta, cb_t cb) {
@@ -66,12 +161,32 @@ void tim_set_timer(int delta, cb_t cb) {
         delta = tim_max_sleep;
 
     rtc_cancel_cb();
-    target_disable_irq();
-    timer_cb = cb;
-    uint16_t nextTrig = TIMx->CNT + (unsigned)delta;
-    LL_TIM_OC_SetCompareCH1(TIMx, nextTrig);
-    LL_TIM_ClearFlag_CC1(TIMx);
-    target_enable_irq();
+    uint32_t deadline = tim_now() + (unsigned)delta;
+
+    // a new call replaces the previous one; only the stores need to be atomic
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    jd_req_cb = cb;
+    jd_req_deadline = deadline;
+    jd_req_pending = true;
+    __set_PRIMASK(primask);
+
+    LL_TIM_GenerateEvent_CC1(TIMx);
+}
+
+void tim_timer_start(timerq_entry_t *t, uint32_t delta, timerq_cb_t cb) {
+    uint32_t prev = target_mask_irq_from(IRQ_PRIORITY_TIM);
+    t->cb = cb;
+    timerq_insert(&timers, t, tim_now() + delta);
+    tim_program();
+    target_restore_irq(prev);
+}
+
+void tim_timer_cancel(timerq_entry_t *t) {
+    uint32_t prev = target_mask_irq_from(IRQ_PRIORITY_TIM);
+    // CC1 may be left set for the cancelled timer; that just results in a spurious IRQ
+    timerq_remove(&timers, t);
+    target_restore_irq(prev);
 }
 
 void tim_init(void) {
@@ -81,7 +196,7 @@ void tim_init(void) {
     NVIC_SetPriority(TIMx_IRQn, IRQ_PRIORITY_TIM);
     NVIC_EnableIRQ(TIMx_IRQn);
 
-    LL_TIM_SetAutoReload(TIMx, 0xffff);
+    LL_TIM_SetAutoReload(TIMx, TIM_PERIOD - 1);
     LL_TIM_SetPrescaler(TIMx, cpu_mhz - 1);
     LL_TIM_GenerateEvent_UPDATE(TIMx);
 
@@ -103,28 +218,30 @@ void tim_init(void) {
     tim_set_timer(5000, NULL);
 }
 
-void TIMx_IRQHandler(void) {
+JD_RAMFUNC void TIMx_IRQHandler(void) {
+    ISR_CYCLES(ISR_CYCLES_TIM);
     /* Check whether update interrupt is pending */
     if (LL_TIM_IsActiveFlag_UPDATE(TIMx) == 1) {
         /* Clear the update interrupt flag */
         LL_TIM_ClearFlag_UPDATE(TIMx);
-        timeoff += 0x10000;
+        timeoff += TIM_PERIOD;
     }
 
-    cb_t f = NULL;
+    if (LL_TIM_IsActiveFlag_CC1(TIMx) == 0)
+        return;
+    LL_TIM_ClearFlag_CC1(TIMx);
 
-    // need to disable IRQ while checking flags, otherwise we can get IRQ after
-    // check, which can in turn set the timer_cb
-    target_disable_irq();
-    if (LL_TIM_IsActiveFlag_CC1(TIMx) == 1) {
-        f = timer_cb;
-        timer_cb = NULL;
-        LL_TIM_ClearFlag_CC1(TIMx);
+    // the queue is only modified at IRQ_PRIORITY_TIM or below, so no masking is needed here
+    for (;;) {
+        tim_take_request();
+        timerq_entry_t *e = timerq_pop_expired(&timers, tim_now());
+        if (!e)
+            break;
+        if (e->cb)
+            e->cb();
     }
-    target_enable_irq();
 
-    if (f)
-        f();
+    tim_program();
 }
 
 void tim_update_prescaler(void) {
@@ -0,0 +1,40 @@
+#include "timerq.h"
+
+#include <stddef.h>
+
+void timerq_insert(timerq_t *q, timerq_entry_t *e, uint32_t deadline) {
+    if (e->pending)
+        timerq_remove(q, e);
+
+    e->deadline = deadline;
+    timerq_entry_t **p = &q->head;
+    while (*p && !timerq_before(deadline, (*p)->deadline))
+        p = &(*p)->next;
+    e->next = *p;
+    *p = e;
+    e->pending = true;
+}
+
+bool timerq_remove(timerq_t *q, timerq_entry_t *e) {
+    if (!e->pending)
+        return false;
+    for (timerq_entry_t **p = &q->head; *p; p = &(*p)->next) {
+        if (*p == e) {
+            *p = e->next;
+            e->next = NULL;
+            e->pending = false;
+            return true;
+        }
+    }
+    return false;
+}
+
+timerq_entry_t *timerq_pop_expired(timerq_t *q, uint32_t now) {
+    timerq_entry_t *e = q->head;
+    if (!e || timerq_before(now, e->deadline))
+        return NULL;
+    q->head = e->next;
+    e->next = NULL;
+    e->pending = false;
+    return e;
+}
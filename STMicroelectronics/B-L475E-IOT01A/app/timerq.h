@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Sorted queue of timers with 32-bit microsecond deadlines.
+// Deadlines are compared modulo 2^32, so they have to be within ~35 minutes of
+// each other, which is always the case when they are set relative to the current time.
+// Entries are owned by the callers (no allocation), and the queue has no locking;
+// it has no hardware dependencies.
+
+typedef void (*timerq_cb_t)(void);
+
+typedef struct timerq_entry {
+    struct timerq_entry *next;
+    uint32_t deadline;
+    timerq_cb_t cb;
+    bool pending;
+} timerq_entry_t;
+
+typedef struct {
+    timerq_entry_t *head;
+} timerq_t;
+
+static inline bool timerq_before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+}
+
+// (re-)inserts e, after any entries with the same deadline
+void timerq_insert(timerq_t *q, timerq_entry_t *e, uint32_t deadline);
+// returns false if e wasn't pending
+bool timerq_remove(timerq_t *q, timerq_entry_t *e);
+// removes and returns the first entry with deadline <= now, or NULL
+timerq_entry_t *timerq_pop_expired(timerq_t *q, uint32_t now);
+
+static inline timerq_entry_t *timerq_peek(timerq_t *q) {
+    return q->head;
+}
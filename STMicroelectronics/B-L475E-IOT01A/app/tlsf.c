@@ -0,0 +1,233 @@
+#include "tlsf.h"
+
+#include <stddef.h>
+#include <string.h>
+
+// Blocks follow each other in the arena, each with a header in front of the payload. The arena
+// ends with a zero-size used block, so that merging with the next block stops there.
+struct tlsf_block {
+    tlsf_block_t *prev_phys; // only valid when BLOCK_PREV_FREE is set
+    uint32_t size;           // payload size, with the BLOCK_* flags in the low bits
+    // these two are only used in free blocks, they are in the payload otherwise
+    tlsf_block_t *next_free;
+    tlsf_block_t *prev_free;
+};
+
+#define BLOCK_FREE 1
+#define BLOCK_PREV_FREE 2
+#define BLOCK_FLAGS (BLOCK_FREE | BLOCK_PREV_FREE)
+
+#define BLOCK_OVERHEAD ((uint32_t)offsetof(tlsf_block_t, next_free))
+// a free block has to hold the list pointers
+#define BLOCK_MIN ((uint32_t)sizeof(tlsf_block_t) - BLOCK_OVERHEAD)
+#define BLOCK_MAX ((1u << TLSF_FL_MAX) - TLSF_ALIGN)
+
+#define ALIGN_UP(n) (((n) + TLSF_ALIGN - 1) & ~(TLSF_ALIGN - 1))
+
+static inline uint32_t block_size(tlsf_block_t *b) {
+    return b->size & ~BLOCK_FLAGS;
+}
+
+static inline void *block_payload(tlsf_block_t *b) {
+    return (uint8_t *)b + BLOCK_OVERHEAD;
+}
+
+static inline tlsf_block_t *block_from_payload(void *ptr) {
+    return (tlsf_block_t *)((uint8_t *)ptr - BLOCK_OVERHEAD);
+}
+
+static inline tlsf_block_t *block_next(tlsf_block_t *b) {
+    return (tlsf_block_t *)((uint8_t *)block_payload(b) + block_size(b));
+}
+
+// index of the highest/lowest bit set; v can't be 0
+static inline int fls32(uint32_t v) {
+    return 31 - __builtin_clz(v);
+}
+
+static inline int ffs32(uint32_t v) {
+    return __builtin_ctz(v);
+}
+
+static void mapping(uint32_t size, int *fl, int *sl) {
+    if (size < (1u << TLSF_FL_SHIFT)) {
+        *fl = 0;
+        *sl = size >> TLSF_ALIGN_SHIFT;
+    } else {
+        int f = fls32(size);
+        *sl = (size >> (f - TLSF_SL_SHIFT)) ^ TLSF_SL_COUNT;
+        *fl = f - TLSF_FL_SHIFT + 1;
+    }
+}
+
+// rounds up to the next class, so that any block in the class found is large enough
+static void mapping_search(uint32_t size, int *fl, int *sl) {
+    if (size >= (1u << TLSF_FL_SHIFT))
+        size += (1u << (fls32(size) - TLSF_SL_SHIFT)) - 1;
+    mapping(size, fl, sl);
+}
+
+static tlsf_block_t *find_free(tlsf_t *t, int *fl, int *sl) {
+    uint32_t sl_map = t->sl_bitmap[*fl] & (~0u << *sl);
+    if (!sl_map) {
+        uint32_t fl_map = t->fl_bitmap & (~0u << (*fl + 1));
+        if (!fl_map)
+            return NULL;
+        *fl = ffs32(fl_map);
+        sl_map = t->sl_bitmap[*fl];
+    }
+    *sl = ffs32(sl_map);
+    return t->free_lists[*fl][*sl];
+}
+
+static void insert_free(tlsf_t *t, tlsf_block_t *b) {
+    int fl, sl;
+    mapping(block_size(b), &fl, &sl);
+    tlsf_block_t *head = t->free_lists[fl][sl];
+    b->next_free = head;
+    b->prev_free = NULL;
+    if (head)
+        head->prev_free = b;
+    t->free_lists[fl][sl] = b;
+    t->fl_bitmap |= 1u << fl;
+    t->sl_bitmap[fl] |= 1 << sl;
+    t->free += block_size(b);
+}
+
+static void remove_free(tlsf_t *t, tlsf_block_t *b) {
+    int fl, sl;
+    mapping(block_size(b), &fl, &sl);
+    if (b->next_free)
+        b->next_free->prev_free = b->prev_free;
+    if (b->prev_free) {
+        b->prev_free->next_free = b->next_free;
+    } else {
+        t->free_lists[fl][sl] = b->next_free;
+        if (!b->next_free) {
+            t->sl_bitmap[fl] &= ~(1 << sl);
+            if (!t->sl_bitmap[fl])
+                t->fl_bitmap &= ~(1u << fl);
+        }
+    }
+    t->free -= block_size(b);
+}
+
+static void mark_free(tlsf_block_t *b) {
+    tlsf_block_t *next = block_next(b);
+    b->size |= BLOCK_FREE;
+    next->size |= BLOCK_PREV_FREE;
+    next->prev_phys = b;
+}
+
+static void mark_used(tlsf_block_t *b) {
+    b->size &= ~BLOCK_FREE;
+    block_next(b)->size &= ~BLOCK_PREV_FREE;
+}
+
+// b is in use; if it's large enough, whatever follows the first size bytes is freed
+static void split(tlsf_t *t, tlsf_block_t *b, uint32_t size) {
+    uint32_t bsize = block_size(b);
+    if (bsize < size + BLOCK_OVERHEAD + BLOCK_MIN)
+        return;
+    tlsf_block_t *rest = (tlsf_block_t *)((uint8_t *)block_payload(b) + size);
+    // the block after b was in use, otherwise it would have been merged with b
+    rest->size = bsize - size - BLOCK_OVERHEAD;
+    b->size = size | (b->size & BLOCK_FLAGS);
+    mark_free(rest);
+    insert_free(t, rest);
+}
+
+void tlsf_init(tlsf_t *t, void *mem, uint32_t size) {
+    memset(t, 0, sizeof(*t));
+    size &= ~(TLSF_ALIGN - 1);
+    if (size > BLOCK_MAX + 2 * BLOCK_OVERHEAD)
+        size = BLOCK_MAX + 2 * BLOCK_OVERHEAD;
+    t->start = mem;
+    t->end = t->start + size;
+
+    tlsf_block_t *b = mem;
+    b->size = size - 2 * BLOCK_OVERHEAD;
+    block_next(b)->size = 0;
+    mark_free(b);
+    insert_free(t, b);
+}
+
+void *tlsf_malloc(tlsf_t *t, uint32_t size) {
+    tlsf_block_t *b = NULL;
+    int fl, sl;
+
+    if (size < BLOCK_MIN)
+        size = BLOCK_MIN;
+    if (size <= BLOCK_MAX) {
+        size = ALIGN_UP(size);
+        mapping_search(size, &fl, &sl);
+        if (fl < TLSF_FL_COUNT)
+            b = find_free(t, &fl, &sl);
+    }
+    if (!b) {
+        t->num_failed++;
+        return NULL;
+    }
+
+    remove_free(t, b);
+    mark_used(b);
+    split(t, b, size);
+
+    t->in_use += block_size(b);
+    if (t->in_use > t->peak)
+        t->peak = t->in_use;
+    t->num_allocs++;
+    return block_payload(b);
+}
+
+bool tlsf_free(tlsf_t *t, void *ptr) {
+    if (!ptr)
+        return true;
+    if ((uint8_t *)ptr < t->start + BLOCK_OVERHEAD || (uint8_t *)ptr >= t->end ||
+        ((uintptr_t)ptr & (TLSF_ALIGN - 1)))
+        return false;
+    tlsf_block_t *b = block_from_payload(ptr);
+    if (b->size & BLOCK_FREE)
+        return false;
+
+    t->in_use -= block_size(b);
+    t->num_allocs--;
+
+    tlsf_block_t *next = block_next(b);
+    if (next->size & BLOCK_FREE) {
+        remove_free(t, next);
+        b->size += block_size(next) + BLOCK_OVERHEAD;
+    }
+    if (b->size & BLOCK_PREV_FREE) {
+        tlsf_block_t *prev = b->prev_phys;
+        remove_free(t, prev);
+        prev->size += block_size(b) + BLOCK_OVERHEAD;
+        b = prev;
+    }
+    mark_free(b);
+    insert_free(t, b);
+    return true;
+}
+
+uint32_t tlsf_block_size(void *ptr) {
+    return block_size(block_from_payload(ptr));
+}
+
+void tlsf_get_stats(tlsf_t *t, tlsf_stats_t *stats) {
+    uint32_t largest = 0;
+    if (t->fl_bitmap) {
+        // all the candidates are in the highest non-empty list
+        int fl = fls32(t->fl_bitmap);
+        int sl = fls32(t->sl_bitmap[fl]);
+        for (tlsf_block_t *b = t->free_lists[fl][sl]; b; b = b->next_free)
+            if (block_size(b) > largest)
+                largest = block_size(b);
+    }
+
+    stats->in_use = t->in_use;
+    stats->peak = t->peak;
+    stats->free = t->free;
+    stats->largest_free = largest;
+    stats->num_allocs = t->num_allocs;
+    stats->num_failed = t->num_failed;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Two-level segregated fit allocator, on a fixed arena.
+//
+// Free blocks are kept in lists by size class: the first level is the power of 2, the second
+// level splits each power of 2 in TLSF_SL_COUNT ranges; two bitmaps record which lists are
+// non-empty. Allocating and freeing take constant time, independent of the number of blocks,
+// and neighbouring free blocks are merged right away.
+//
+// There is no locking here; see jd_alloc() for that. No hardware dependencies.
+
+#define TLSF_ALIGN_SHIFT 3
+#define TLSF_ALIGN (1 << TLSF_ALIGN_SHIFT)
+#define TLSF_SL_SHIFT 3
+#define TLSF_SL_COUNT (1 << TLSF_SL_SHIFT)
+// below this, the classes are linear (TLSF_ALIGN apart)
+#define TLSF_FL_SHIFT (TLSF_SL_SHIFT + TLSF_ALIGN_SHIFT)
+// blocks have to be smaller than (1 << TLSF_FL_MAX)
+#define TLSF_FL_MAX 17
+#define TLSF_FL_COUNT (TLSF_FL_MAX - TLSF_FL_SHIFT + 1)
+
+typedef struct tlsf_block tlsf_block_t;
+
+typedef struct {
+    uint32_t in_use;       // payload bytes allocated
+    uint32_t peak;         // highest in_use so far
+    uint32_t free;         // payload bytes in free blocks
+    uint32_t largest_free; // largest block that can be allocated
+    uint32_t num_allocs;   // live allocations
+    uint32_t num_failed;   // allocations that didn't fit
+} tlsf_stats_t;
+
+typedef struct {
+    uint8_t *start, *end;
+    uint32_t fl_bitmap;
+    uint8_t sl_bitmap[TLSF_FL_COUNT];
+    tlsf_block_t *free_lists[TLSF_FL_COUNT][TLSF_SL_COUNT];
+    uint32_t in_use;
+    uint32_t peak;
+    uint32_t free;
+    uint32_t num_allocs;
+    uint32_t num_failed;
+} tlsf_t;
+
+// mem has to be TLSF_ALIGN aligned; the arena is trimmed to the largest block size
+void tlsf_init(tlsf_t *t, void *mem, uint32_t size);
+
+// Returns NULL when there is no free block large enough. The memory is not cleared.
+void *tlsf_malloc(tlsf_t *t, uint32_t size);
+
+// ptr can be NULL. Returns false when ptr isn't an allocated block (and does nothing).
+bool tlsf_free(tlsf_t *t, void *ptr);
+
+// Usable size of an allocated block, at least what was asked for.
+uint32_t tlsf_block_size(void *ptr);
+
+void tlsf_get_stats(tlsf_t *t, tlsf_stats_t *stats);
@@ -1,4 +1,5 @@
 #include "jdstm.h"
+#include "cmsis_utils.h"
 
 #ifdef UART_PIN
 
@@ -59,23 +60,75 @@
 #define DMAx DMA1
 #endif
 
+// one-shot timer used to sequence the start of frame (low pulse, gap, DMA enable)
+// without busy-waiting in uart_start_tx()
+#ifndef SEQ_TIM
+#define SEQ_TIM TIM2
+#define SEQ_TIM_IRQn TIM2_IRQn
+#define SEQ_TIM_IRQHandler TIM2_IRQHandler
+#define SEQ_TIM_CLK_EN() __HAL_RCC_TIM2_CLK_ENABLE()
+#endif
+
+#define TX_STEP_IDLE 0
+#define TX_STEP_LO_PULSE 1
+#define TX_STEP_GAP 2
+#define TX_STEP_BREAK 3
+
+// When enabled, the receiver is left running all the time, with the DMA writing
+// into a circular buffer; frames are split out of it on idle-line events.
+// This avoids re-arming the USART from EXTI at the start of every frame.
+#ifndef JD_UART_RX_RING
+#define JD_UART_RX_RING 0
+#endif
+
+#if JD_UART_RX_RING
+#include "uart_ring.h"
+#ifndef JD_UART_RX_RING_FRAMES
+#define JD_UART_RX_RING_FRAMES 4
+#endif
+static uint8_t rx_ring_buf[JD_UART_RX_RING_FRAMES * sizeof(jd_frame_t)];
+static uart_ring_t rx_ring;
+static jd_frame_t rx_frame;
+#endif
+
 // DMA Channel 4 - TX
 // DMA Channel 5 - RX
 
 // This is extracted to a function to make sure the compiler doesn't
 // insert stuff between checking the input pin and setting the mode.
 // This results in a collision window of around 90ns
-__attribute__((noinline)) void gpio_probe_and_set(GPIO_TypeDef *gpio, uint32_t pin, uint32_t mode) {
+JD_RAMFUNC __attribute__((noinline)) void gpio_probe_and_set(GPIO_TypeDef *gpio, uint32_t pin, uint32_t mode) {
     if (gpio->IDR & pin)
         gpio->MODER = mode;
 }
 
-static void uartOwnsPin(int doesIt) {
+static volatile uint8_t tx_step;
+static const void *tx_data;
+static uint32_t tx_numbytes;
+
+JD_RAMFUNC static void seq_start(uint32_t us) {
+    SEQ_TIM->ARR = us - 1;
+    SEQ_TIM->CNT = 0;
+    LL_TIM_ClearFlag_UPDATE(SEQ_TIM);
+    LL_TIM_EnableCounter(SEQ_TIM);
+}
+
+JD_RAMFUNC static void seq_stop(void) {
+    LL_TIM_DisableCounter(SEQ_TIM);
+    LL_TIM_ClearFlag_UPDATE(SEQ_TIM);
+    tx_step = TX_STEP_IDLE;
+}
+
+JD_RAMFUNC static void setPinAF(uint32_t af) {
+    if ((UART_PIN & 0xf) <= 7)
+        LL_GPIO_SetAFPin_0_7(PIN_PORT(UART_PIN), PIN_MASK(UART_PIN), af);
+    else
+        LL_GPIO_SetAFPin_8_15(PIN_PORT(UART_PIN), PIN_MASK(UART_PIN), af);
+}
+
+JD_RAMFUNC static void uartOwnsPin(int doesIt) {
     if (doesIt) {
-        if ((UART_PIN & 0xf) <= 7)
-            LL_GPIO_SetAFPin_0_7(PIN_PORT(UART_PIN), PIN_MASK(UART_PIN), UART_PIN_AF);
-        else
-            LL_GPIO_SetAFPin_8_15(PIN_PORT(UART_PIN), PIN_MASK(UART_PIN), UART_PIN_AF);
+        setPinAF(UART_PIN_AF);
         LL_GPIO_SetPinMode(PIN_PORT(UART_PIN), PIN_MASK(UART_PIN), LL_GPIO_MODE_ALTERNATE);
     } else {
         LL_GPIO_SetPinMode(PIN_PORT(UART_PIN), PIN_MASK(UART_PIN), LL_GPIO_MODE_INPUT);
@@ -84,24 +137,79 @@ static void uartOwnsPin(int doesIt) {
     }
 }
 
-void uart_disable() {
+#if JD_UART_RX_RING
+static void ring_start_rx(void) {
+    uartOwnsPin(1);
+    LL_USART_DisableDirectionTx(USARTx);
+    LL_USART_EnableDirectionRx(USARTx);
+    USARTx->ICR = USART_ISR_FE | USART_ISR_NE | USART_ISR_ORE | USART_ISR_IDLE;
+    LL_USART_EnableIT_IDLE(USARTx);
+    LL_USART_Enable(USARTx);
+
+    uart_ring_init(&rx_ring, rx_ring_buf, sizeof(rx_ring_buf));
+    LL_DMA_SetMode(DMAx, DMA_CH_RX, LL_DMA_MODE_CIRCULAR);
+    LL_DMA_ConfigAddresses(DMAx, DMA_CH_RX, (uint32_t) & (USARTx->RDR), (uint32_t)rx_ring_buf,
+                           LL_DMA_DIRECTION_PERIPH_TO_MEMORY);
+    LL_DMA_SetDataLength(DMAx, DMA_CH_RX, sizeof(rx_ring_buf));
+    LL_USART_EnableDMAReq_RX(USARTx);
+    LL_DMA_EnableChannel(DMAx, DMA_CH_RX);
+}
+
+static uint32_t ring_pos(void) {
+    return sizeof(rx_ring_buf) - LL_DMA_GetDataLength(DMAx, DMA_CH_RX);
+}
+#endif
+
+JD_RAMFUNC void uart_disable() {
+    seq_stop();
+
     LL_DMA_ClearFlag_GI5(DMAx);
     LL_DMA_DisableChannel(DMAx, DMA_CH_RX);
 
     LL_DMA_ClearFlag_GI3(DMAx);
     LL_DMA_DisableChannel(DMAx, DMA_CH_TX);
 
+    LL_USART_DisableIT_TC(USARTx);
     LL_USART_Disable(USARTx);
 
+#if JD_UART_RX_RING
+    // in ring mode, the idle state is listening on the ring
+    ring_start_rx();
+#else
     uartOwnsPin(0);
+#endif
     // pulse_log_pin();
 }
 
-void DMA_Handler(void) {
+// the standard BRK signal is too short - it's 10uS - to be detected as break at least on NRF52
+// Instead, SEQ_TIM channel 1 (PWM mode 2, active low, one pulse) drives the line
+// low for 12us, and its update IRQ tells us when the break is done.
+JD_RAMFUNC static void start_break(void) {
+    // the output stays high while CNT < CCR1, just like the idle USART line
+    SEQ_TIM->CNT = 0;
+    setPinAF(UART_PIN_TIM_AF);
+    LL_USART_Disable(USARTx);
+
+    tx_step = TX_STEP_BREAK;
+    // low from CNT == 1 to CNT == 12
+    SEQ_TIM->ARR = 12;
+    LL_TIM_ClearFlag_UPDATE(SEQ_TIM);
+    LL_TIM_EnableCounter(SEQ_TIM);
+}
+
+JD_RAMFUNC void DMA_Handler(void) {
+    ISR_CYCLES(ISR_CYCLES_DMA);
     uint32_t isr = DMAx->ISR;
 
     // DMESG("DMA irq %x", (unsigned) isr);
 
+#if JD_UART_RX_RING
+    // the ring wraps around on TC; only errors are of interest
+    if (isr & DMA_ISR_TEIF5) {
+        ERROR("RX err");
+        uart_disable();
+    }
+#else
     if (isr & (DMA_ISR_TCIF5 | DMA_ISR_TEIF5)) {
         uart_disable();
         if (isr & DMA_ISR_TCIF5) {
@@ -113,36 +221,20 @@ void DMA_Handler(void) {
             jd_rx_completed(-2);
         }
     }
+#endif
 
     if (isr & (DMA_ISR_TCIF3 | DMA_ISR_TEIF3)) {
         LL_DMA_ClearFlag_GI3(DMAx);
         LL_DMA_DisableChannel(DMAx, DMA_CH_TX);
 
-        int errCode = 0;
         if (isr & DMA_ISR_TCIF3) {
-            while (!LL_USART_IsActiveFlag_TC(USARTx))
-                ;
-// the standard BRK signal is too short - it's 10uS - to be detected as break at least on NRF52
-#if 1
-            LL_USART_Disable(USARTx);
-            LL_GPIO_SetPinMode(PIN_PORT(UART_PIN), PIN_MASK(UART_PIN), LL_GPIO_MODE_OUTPUT);
-            LL_GPIO_ResetOutputPin(PIN_PORT(UART_PIN), PIN_MASK(UART_PIN));
-            target_wait_us(12);
-            LL_GPIO_SetOutputPin(PIN_PORT(UART_PIN), PIN_MASK(UART_PIN));
-#else
-            LL_USART_RequestBreakSending(USARTx);
-            // DMESG("USARTx %x", USARTx->ISR);
-            while (LL_USART_IsActiveFlag_SBK(USARTx))
-                ;
-#endif
+            // wait for the last byte to leave the shift register; see IRQHandler()
+            LL_USART_EnableIT_TC(USARTx);
         } else {
             ERROR("TX err");
-            errCode = -1;
+            uart_disable();
+            jd_tx_completed(-1);
         }
-
-        uart_disable();
-
-        jd_tx_completed(errCode);
     }
 }
 
@@ -156,10 +248,10 @@ void DMA1_Channel5_IRQHandler(void) {
 #endif
 
 #ifdef STM32L4
-void DMA2_Channel3_IRQHandler(void) {
+JD_RAMFUNC void DMA2_Channel3_IRQHandler(void) {
     DMA_Handler();
 }
-void DMA2_Channel5_IRQHandler(void) {
+JD_RAMFUNC void DMA2_Channel5_IRQHandler(void) {
     DMA_Handler();
 }
 #endif
@@ -178,6 +270,27 @@ static void DMA_Init(void) {
 #endif
 }
 
+static void SEQ_TIM_Init(void) {
+    SEQ_TIM_CLK_EN();
+
+    LL_TIM_SetPrescaler(SEQ_TIM, cpu_mhz - 1);
+    LL_TIM_SetOnePulseMode(SEQ_TIM, LL_TIM_ONEPULSEMODE_SINGLE);
+    // only counter overflow raises the update IRQ, not the UG below
+    LL_TIM_SetUpdateSource(SEQ_TIM, LL_TIM_UPDATESOURCE_COUNTER);
+    LL_TIM_GenerateEvent_UPDATE(SEQ_TIM);
+    LL_TIM_ClearFlag_UPDATE(SEQ_TIM);
+    LL_TIM_EnableIT_UPDATE(SEQ_TIM);
+
+    // channel 1 generates the end-of-frame break, when UART_PIN is switched to it
+    LL_TIM_OC_SetMode(SEQ_TIM, LL_TIM_CHANNEL_CH1, LL_TIM_OCMODE_PWM2);
+    LL_TIM_OC_SetPolarity(SEQ_TIM, LL_TIM_CHANNEL_CH1, LL_TIM_OCPOLARITY_LOW);
+    LL_TIM_OC_SetCompareCH1(SEQ_TIM, 1);
+    LL_TIM_CC_EnableChannel(SEQ_TIM, LL_TIM_CHANNEL_CH1);
+
+    NVIC_SetPriority(SEQ_TIM_IRQn, IRQ_PRIORITY_UART);
+    NVIC_EnableIRQ(SEQ_TIM_IRQn);
+}
+
 static void USART_UART_Init(void) {
 #if USART_IDX == 2
     __HAL_RCC_USART2_CLK_ENABLE();
@@ -237,7 +350,9 @@ static void USART_UART_Init(void) {
     /* Enable DMA transfer complete/error interrupts  */
     LL_DMA_EnableIT_TC(DMAx, DMA_CH_TX);
     LL_DMA_EnableIT_TE(DMAx, DMA_CH_TX);
+#if !JD_UART_RX_RING
     LL_DMA_EnableIT_TC(DMAx, DMA_CH_RX);
+#endif
     LL_DMA_EnableIT_TE(DMAx, DMA_CH_RX);
 
 #if NEW_UART
@@ -263,11 +378,16 @@ static void USART_UART_Init(void) {
 
     // while (!(LL_USART_IsActiveFlag_REACK(USARTx)))
     //    ;
+#if JD_UART_RX_RING
+    ring_start_rx();
+#else
     exti_set_callback(UART_PIN, jd_line_falling, EXTI_FALLING);
+#endif
 }
 
 void uart_init_() {
     DMA_Init();
+    SEQ_TIM_Init();
     USART_UART_Init();
 }
 
@@ -277,17 +397,31 @@ void uart_init_() {
 //}
 
 int uart_wait_high() {
-    int timeout = 5000;
-    while (timeout-- > 0 && !LL_GPIO_IsInputPinSet(PIN_PORT(UART_PIN), PIN_MASK(UART_PIN)))
-        ;
-    if (timeout <= 0)
-        return -1;
-    else
-        return 0;
+    uint32_t start = dwt_cycles();
+    uint32_t timeout = 250 * cpu_mhz;
+    while (!LL_GPIO_IsInputPinSet(PIN_PORT(UART_PIN), PIN_MASK(UART_PIN))) {
+        if (dwt_cycles() - start > timeout)
+            return -1;
+    }
+    return 0;
 }
 
-int uart_start_tx(const void *data, uint32_t numbytes) {
+JD_RAMFUNC int uart_start_tx(const void *data, uint32_t numbytes) {
+    ISR_CYCLES(ISR_CYCLES_START_TX);
     // DMESG("tx %d", (int)numbytes);
+    if (tx_step != TX_STEP_IDLE)
+        jd_panic();
+
+#if JD_UART_RX_RING
+    // anything received since the last idle line means someone else is transmitting
+    if (uart_ring_busy(&rx_ring, ring_pos()))
+        return -1;
+    LL_USART_Disable(USARTx);
+    LL_USART_DisableDMAReq_RX(USARTx);
+    LL_DMA_DisableChannel(DMAx, DMA_CH_RX);
+    // gpio_probe_and_set() below expects the pin in input mode
+    LL_GPIO_SetPinMode(PIN_PORT(UART_PIN), PIN_MASK(UART_PIN), LL_GPIO_MODE_INPUT);
+#else
     exti_disable(PIN_MASK(UART_PIN));
     exti_clear_falling(PIN_MASK(UART_PIN));
     // We assume EXTI runs at higher priority than us
@@ -300,46 +434,80 @@ int uart_start_tx(const void *data, uint32_t numbytes) {
         // we don't re-enable EXTI - the RX complete will do it
         return -1;
     }
+#endif
 
     LL_GPIO_ResetOutputPin(PIN_PORT(UART_PIN), PIN_MASK(UART_PIN));
     gpio_probe_and_set(PIN_PORT(UART_PIN), PIN_MASK(UART_PIN),
                        PIN_MODER | PIN_PORT(UART_PIN)->MODER);
     if (!(PIN_PORT(UART_PIN)->MODER & PIN_MODER)) {
+#if JD_UART_RX_RING
+        // someone else started a frame; go back to listening
+        ring_start_rx();
+#else
         // this is equivalent to irq priority when running from EXTI
         target_disable_irq();
         jd_line_falling();
         target_enable_irq();
+#endif
         return -1;
     }
-    target_wait_us(11);
-    LL_GPIO_SetOutputPin(PIN_PORT(UART_PIN), PIN_MASK(UART_PIN));
-
-    // from here...
-    uartOwnsPin(1);
-    LL_USART_DisableDirectionRx(USARTx);
-    LL_USART_EnableDirectionTx(USARTx);
-    USARTx->ICR = USART_ISR_FE | USART_ISR_NE | USART_ISR_ORE |
-                  USART_ISR_TC; // clear error flags before we start
-    LL_USART_Enable(USARTx);
-    while (!(LL_USART_IsActiveFlag_TEACK(USARTx)))
-        ;
 
-    LL_DMA_ConfigAddresses(DMAx, DMA_CH_TX, (uint32_t)data, (uint32_t) & (USARTx->TDR),
-                           LL_DMA_DIRECTION_MEMORY_TO_PERIPH);
-    LL_DMA_SetDataLength(DMAx, DMA_CH_TX, numbytes);
-    LL_USART_EnableDMAReq_TX(USARTx);
-    // to here, it's about 1.3us
+    // the rest of the start of frame is driven from SEQ_TIM_IRQHandler()
+    tx_data = data;
+    tx_numbytes = numbytes;
+    tx_step = TX_STEP_LO_PULSE;
+    seq_start(11);
 
-    // the USART takes a few us to start transmitting
-    target_wait_us(45);
-    // The spec requires min of 50us and max of 189us.
+    return 0;
+}
 
-    LL_DMA_EnableChannel(DMAx, DMA_CH_TX);
+JD_RAMFUNC void SEQ_TIM_IRQHandler(void) {
+    ISR_CYCLES(ISR_CYCLES_SEQ_TIM);
+    LL_TIM_ClearFlag_UPDATE(SEQ_TIM);
+
+    switch (tx_step) {
+    case TX_STEP_LO_PULSE:
+        LL_GPIO_SetOutputPin(PIN_PORT(UART_PIN), PIN_MASK(UART_PIN));
+
+        // from here...
+        uartOwnsPin(1);
+        LL_USART_DisableDirectionRx(USARTx);
+        LL_USART_EnableDirectionTx(USARTx);
+        USARTx->ICR = USART_ISR_FE | USART_ISR_NE | USART_ISR_ORE |
+                      USART_ISR_TC; // clear error flags before we start
+        LL_USART_Enable(USARTx);
+
+        LL_DMA_ConfigAddresses(DMAx, DMA_CH_TX, (uint32_t)tx_data, (uint32_t) & (USARTx->TDR),
+                               LL_DMA_DIRECTION_MEMORY_TO_PERIPH);
+        LL_DMA_SetDataLength(DMAx, DMA_CH_TX, tx_numbytes);
+        // to here, it's about 1.3us
+
+        // the USART takes a few us to start transmitting (TEACK)
+        // The spec requires min of 50us and max of 189us.
+        tx_step = TX_STEP_GAP;
+        seq_start(45);
+        break;
+
+    case TX_STEP_GAP:
+        if (!LL_USART_IsActiveFlag_TEACK(USARTx)) {
+            // shouldn't happen after 45us, but don't start DMA too early
+            seq_start(2);
+            break;
+        }
+        LL_USART_EnableDMAReq_TX(USARTx);
+        LL_DMA_EnableChannel(DMAx, DMA_CH_TX);
+        tx_step = TX_STEP_IDLE;
+        break;
 
-    return 0;
+    case TX_STEP_BREAK:
+        uart_disable();
+        jd_tx_completed(0);
+        break;
+    }
 }
 
-void uart_start_rx(void *data, uint32_t maxbytes) {
+JD_RAMFUNC void uart_start_rx(void *data, uint32_t maxbytes) {
+    ISR_CYCLES(ISR_CYCLES_START_RX);
     // DMESG("start rx");
     // check_idle();
 
@@ -359,15 +527,36 @@ void uart_start_rx(void *data, uint32_t maxbytes) {
 
     exti_disable(PIN_MASK(UART_PIN));
     exti_clear_falling(PIN_MASK(UART_PIN));
+
+#if JD_EXTI_PROBE
+    exti_probe_rx_started();
+#endif
 }
 
-// this is only enabled for error events
-void IRQHandler(void) {
+// this is only enabled for error events, for TC at the end of TX, and for idle line in ring mode
+JD_RAMFUNC void IRQHandler(void) {
+    ISR_CYCLES(ISR_CYCLES_UART);
+    if (LL_USART_IsEnabledIT_TC(USARTx) && LL_USART_IsActiveFlag_TC(USARTx)) {
+        LL_USART_DisableIT_TC(USARTx);
+        start_break();
+        return;
+    }
+
+#if JD_UART_RX_RING
+    uint32_t isr = USARTx->ISR;
+    // breaks always come with a framing error; the DMA keeps running through them
+    USARTx->ICR = USART_ISR_FE | USART_ISR_NE | USART_ISR_ORE | USART_ISR_IDLE;
+    if (isr & USART_ISR_IDLE) {
+        if (uart_ring_idle(&rx_ring, ring_pos(), &rx_frame) > 0)
+            jd_rx_frame_received(&rx_frame);
+    }
+#else
     // DMESG("irq handler");
     //  pulse_log_pin();
     uint32_t dataLeft = LL_DMA_GetDataLength(DMAx, DMA_CH_RX);
     uart_disable();
     jd_rx_completed(dataLeft);
+#endif
 }
 
 void uart_flush_rx() {}
@@ -0,0 +1,57 @@
+#include "uart_ring.h"
+
+#include <string.h>
+
+// a frame may be preceded by the break of a previous one, if they are back-to-back
+#define MAX_LEADING_BREAKS 2
+#define FRAME_HEADER_SIZE 12
+
+static inline uint8_t ring_byte(uart_ring_t *r, uint32_t off) {
+    return r->buf[off % r->size];
+}
+
+static void ring_copy(uart_ring_t *r, uint32_t off, void *dst, uint32_t len) {
+    off %= r->size;
+    uint32_t n = r->size - off;
+    if (n > len)
+        n = len;
+    memcpy(dst, r->buf + off, n);
+    memcpy((uint8_t *)dst + n, r->buf, len - n);
+}
+
+void uart_ring_init(uart_ring_t *r, const uint8_t *buf, uint32_t size) {
+    r->buf = buf;
+    r->size = size;
+    r->start = 0;
+    r->num_errors = 0;
+}
+
+bool uart_ring_busy(uart_ring_t *r, uint32_t pos) {
+    return pos != r->start;
+}
+
+int uart_ring_idle(uart_ring_t *r, uint32_t pos, jd_frame_t *frame) {
+    uint32_t start = r->start;
+    uint32_t len = (pos + r->size - start) % r->size;
+    r->start = pos;
+
+    if (len <= MAX_LEADING_BREAKS)
+        return 0;
+
+    for (uint32_t skip = 0; skip <= MAX_LEADING_BREAKS; ++skip) {
+        uint32_t avail = len - skip;
+        if (avail < FRAME_HEADER_SIZE)
+            break;
+        if (skip && ring_byte(r, start + skip - 1) != 0)
+            break;
+        uint32_t fsize = ring_byte(r, start + skip + 2) + FRAME_HEADER_SIZE;
+        if (fsize > avail || fsize > sizeof(*frame))
+            continue;
+        ring_copy(r, start + skip, frame, fsize);
+        if (jd_crc16((uint8_t *)frame + 2, fsize - 2) == frame->crc)
+            return 1;
+    }
+
+    r->num_errors++;
+    return -1;
+}
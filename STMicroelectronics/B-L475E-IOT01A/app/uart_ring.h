@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "jd_protocol.h"
+
+// Splits the byte stream written by a circular RX DMA into Jacdac frames.
+//
+// Every frame on the wire is preceded and followed by a break, which the USART
+// receives as a 0x00 byte (with a framing error). The line then stays idle for a
+// while, so frames are delimited with the USART idle-line event: the bytes between
+// two idle events are either just break bytes, or a frame followed by its break.
+//
+// This has no hardware dependencies, so it can be fed with recorded byte streams.
+
+typedef struct {
+    const uint8_t *buf;
+    uint32_t size;
+    uint32_t start; // ring offset just after the last idle-line event
+    uint32_t num_errors;
+} uart_ring_t;
+
+void uart_ring_init(uart_ring_t *r, const uint8_t *buf, uint32_t size);
+
+// pos is the current DMA write offset (size - NDTR)
+// Returns true when anything was received since the last idle-line event.
+bool uart_ring_busy(uart_ring_t *r, uint32_t pos);
+
+// Call on idle-line event.
+// Returns 1 when a valid frame was copied into *frame, 0 when only breaks
+// were received, and -1 when the bytes didn't form a valid frame.
+int uart_ring_idle(uart_ring_t *r, uint32_t pos, jd_frame_t *frame);
@@ -24,6 +24,7 @@ EndBSPDependencies */
 
 /* Includes ------------------------------------------------------------------*/
 #include "usbd_cdc_if.h"
+#include "jdstm.h"
 #include "interfaces/jd_usb.h"
 
 /** @addtogroup STM32_USB_DEVICE_LIBRARY
@@ -77,10 +78,110 @@ USBD_CDC_LineCodingTypeDef linecoding = {
 };
 
 extern USBD_HandleTypeDef USBD_Device;
+// plain .bss: the OTG FS core has no DMA, packets are copied through its FIFO by the CPU
 uint8_t UserRxBuffer[64];
 uint8_t UserTxBuffer[64];
 volatile uint8_t usb_in_tx;
 
+#if JD_USB_DMESG
+// DMESG records are sent between Jacdac frames, as frames of their own:
+//   USB_DMESG_BREAK USB_DMESG_FRAME <record> USB_DMESG_BREAK
+// where USB_DMESG_BREAK and USB_DMESG_ESCAPE bytes in the record are sent as
+// USB_DMESG_ESCAPE (byte ^ 0x20). Jacdac hosts drop these as invalid frames;
+// tools/usb-dmesg.py extracts them.
+#define USB_DMESG_BREAK  0xFE
+#define USB_DMESG_ESCAPE 0xFF
+#define USB_DMESG_FRAME  'D'
+
+// no frame is being sent when dmesg_pos == DMESG_IDLE
+#define DMESG_IDLE 0xffff
+
+static uint8_t dmesg_rec[DMESG_LINE_SIZE];
+static uint16_t dmesg_len;
+static uint16_t dmesg_pos = DMESG_IDLE;
+
+// fills dst with the next part of a DMESG frame; returns 0 when there is no more to send
+static int dmesg_pull(uint8_t* dst)
+{
+    int n = 0;
+
+    if (dmesg_pos == DMESG_IDLE)
+    {
+        int len;
+        uint32_t dropped = codal_dmesg_take_dropped();
+        if (dropped)
+        {
+            jd_sprintf((char*)dmesg_rec, sizeof(dmesg_rec), "[dmesg: %d bytes dropped]\n", (int)dropped);
+            len = strlen((char*)dmesg_rec);
+        }
+        else
+        {
+            // -1 means the record was too long and dropped; try the next one
+            do
+            {
+                len = codal_dmesg_read_record(dmesg_rec, sizeof(dmesg_rec));
+            } while (len < 0);
+        }
+        if (len == 0)
+        {
+            return 0;
+        }
+        dmesg_len = len;
+        dmesg_pos = 0;
+        dst[n++]  = USB_DMESG_BREAK;
+        dst[n++]  = USB_DMESG_FRAME;
+    }
+
+    // leave room for an escaped byte
+    while (dmesg_pos < dmesg_len && n < CDC_DATA_FS_MAX_PACKET_SIZE - 1)
+    {
+        uint8_t b = dmesg_rec[dmesg_pos++];
+        if (b >= USB_DMESG_BREAK)
+        {
+            dst[n++] = USB_DMESG_ESCAPE;
+            dst[n++] = b ^ 0x20;
+        }
+        else
+        {
+            dst[n++] = b;
+        }
+    }
+
+    if (dmesg_pos == dmesg_len && n < CDC_DATA_FS_MAX_PACKET_SIZE)
+    {
+        dst[n++]  = USB_DMESG_BREAK;
+        dmesg_pos = DMESG_IDLE;
+    }
+
+    return n;
+}
+
+bool jd_usb_dmesg_active(void)
+{
+    return USBD_Device.dev_state == USBD_STATE_CONFIGURED;
+}
+#endif
+
+static int pull_packet(uint8_t* dst)
+{
+#if JD_USB_DMESG
+    // a DMESG frame can't be split by a Jacdac one
+    if (dmesg_pos != DMESG_IDLE)
+    {
+        return dmesg_pull(dst);
+    }
+    // Jacdac frames go first; jd_usb_pull() only returns 0 between frames
+    int len = jd_usb_pull(dst);
+    if (len == 0)
+    {
+        len = dmesg_pull(dst);
+    }
+    return len;
+#else
+    return jd_usb_pull(dst);
+#endif
+}
+
 static void maybe_fill_buffer(int force)
 {
     int len = 0;
@@ -88,7 +189,7 @@ static void maybe_fill_buffer(int force)
     target_disable_irq();
     if (force || usb_in_tx == 0)
     {
-        len       = jd_usb_pull(UserTxBuffer);
+        len       = pull_packet(UserTxBuffer);
         usb_in_tx = len > 0;
     }
     target_enable_irq();
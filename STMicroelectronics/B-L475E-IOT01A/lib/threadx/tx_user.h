@@ -53,6 +53,19 @@
 
 #define TX_ENABLE_FPU_SUPPORT
 
+/* Tickless idle. TX_LOW_POWER and TX_ENABLE_WFI are set in lib/CMakeLists.txt, as they are
+   also needed by the assembly port. While idle, SysTick is stopped and the next ThreadX timer
+   expiration is scheduled on the system timer instead, see app/tickless.c.  */
+
+#define TX_LOW_POWER_TICKLESS
+#define TX_LOW_POWER_USER_ENTER             tickless_enter()
+#define TX_LOW_POWER_TIMER_SETUP(ticks)     tickless_timer_setup(ticks)
+#define TX_LOW_POWER_USER_TIMER_ADJUST      tickless_timer_adjust()
+
+void tickless_enter(void);
+void tickless_timer_setup(unsigned long ticks);
+unsigned long tickless_timer_adjust(void);
+
 /* Define various build options for the ThreadX port.  The application should either make changes
    here by commenting or un-commenting the conditional compilation defined OR supply the defines 
    though the compiler's equivalent of the -D option.  
@@ -0,0 +1,13 @@
+#include "jd_protocol.h"
+
+// CRC-16-CCITT, as in jacdac-c
+uint16_t jd_crc16(const void *data, uint32_t size) {
+    const uint8_t *ptr = (const uint8_t *)data;
+    uint16_t crc = 0xffff;
+    while (size--) {
+        uint8_t x = (crc >> 8) ^ *ptr++;
+        x ^= x >> 4;
+        crc = (crc << 8) ^ (x << 12) ^ (x << 5) ^ x;
+    }
+    return crc;
+}
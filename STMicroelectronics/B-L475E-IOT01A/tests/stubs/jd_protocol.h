@@ -0,0 +1,18 @@
+#pragma once
+
+// The parts of jacdac-c's jd_protocol.h used by the modules under test, so that the host
+// tests build without the submodule.
+
+#include <stdint.h>
+
+#define JD_SERIAL_PAYLOAD_SIZE 236
+
+typedef struct {
+    uint16_t crc;
+    uint8_t size;
+    uint8_t flags;
+    uint64_t device_identifier;
+    uint8_t data[JD_SERIAL_PAYLOAD_SIZE + 4];
+} __attribute__((__packed__, aligned(4))) jd_frame_t;
+
+uint16_t jd_crc16(const void *data, uint32_t size);
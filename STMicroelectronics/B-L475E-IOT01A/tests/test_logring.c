@@ -0,0 +1,238 @@
+#include "test.h"
+#include "logring.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+
+// Concurrent producers and a consumer on a small ring, so that records keep being dropped
+// while they are read. Every record read has to be intact and in order for its producer,
+// and each byte written has to be either read or counted as dropped.
+//
+// A fast timer signal plays the part of an interrupt handler: it writes records of its own
+// from whichever thread it interrupts, possibly in the middle of a write or a read. That is
+// also what makes the races show up on a single core. The handler uses a producer id for each
+// thread it runs on, so that its records stay in order even when it runs on several cores.
+
+#define NUM_THREADS 4
+// then one id for the signal handler on each producer thread, and one on the consumer
+#define NUM_PRODUCERS (2 * NUM_THREADS + 1)
+#define SIGNAL_PERIOD_NS 20000
+#define RECORDS_PER_PRODUCER 200000
+#define RING_SIZE 512
+#define MIN_LEN 6
+#define MAX_LEN 80
+
+static uint8_t ring_buf[RING_SIZE] __attribute__((aligned(8)));
+static logring_t ring;
+
+static volatile int producers_left;
+static uint64_t bytes_written[NUM_PRODUCERS];
+static uint32_t signal_records[NUM_PRODUCERS];
+static __thread int signal_id = -1;
+
+typedef struct {
+    uint64_t bytes_read;
+    uint64_t bytes_dropped;
+    uint32_t records_read[NUM_PRODUCERS];
+    uint32_t bad_records;
+    uint32_t out_of_order;
+} consumer_stats_t;
+
+static uint8_t fill_byte(int id, uint32_t seq, uint32_t i) {
+    return (uint8_t)(id * 31 + seq * 7 + i);
+}
+
+// [id][len][seq, 4 bytes][fill...]
+static uint32_t make_record(uint8_t *rec, int id, uint32_t seq) {
+    uint32_t len = MIN_LEN + (seq * 13 + id * 5) % (MAX_LEN - MIN_LEN + 1);
+    rec[0] = id;
+    rec[1] = len;
+    memcpy(rec + 2, &seq, 4);
+    for (uint32_t i = MIN_LEN; i < len; ++i)
+        rec[i] = fill_byte(id, seq, i);
+    return len;
+}
+
+static void *producer(void *arg) {
+    int id = (int)(intptr_t)arg;
+    uint8_t rec[MAX_LEN];
+
+    signal_id = NUM_THREADS + id;
+    for (uint32_t seq = 0; seq < RECORDS_PER_PRODUCER; ++seq) {
+        uint32_t len = make_record(rec, id, seq);
+        logring_write(&ring, rec, len);
+        bytes_written[id] += len;
+        // let the others get preempted mid-record now and then
+        if ((seq & 0xf) == id)
+            sched_yield();
+    }
+
+    __atomic_fetch_sub(&producers_left, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void signal_producer(int sig) {
+    uint8_t rec[MAX_LEN];
+    int id = signal_id;
+    if (id < 0)
+        return;
+    uint32_t len = make_record(rec, id, signal_records[id]++);
+    logring_write(&ring, rec, len);
+    bytes_written[id] += len;
+}
+
+static bool check_record(const uint8_t *rec, int len, uint32_t *next_seq) {
+    uint32_t seq;
+    if (len < MIN_LEN || rec[0] >= NUM_PRODUCERS || rec[1] != len)
+        return false;
+    int id = rec[0];
+    memcpy(&seq, rec + 2, 4);
+    for (int i = MIN_LEN; i < len; ++i)
+        if (rec[i] != fill_byte(id, seq, i))
+            return false;
+    if (make_record((uint8_t[MAX_LEN]){0}, id, seq) != (uint32_t)len)
+        return false;
+    *next_seq = seq;
+    return true;
+}
+
+static void drain(consumer_stats_t *st, int32_t *last_seq, uint32_t maxlen) {
+    uint8_t rec[MAX_LEN];
+    int len;
+
+    while ((len = logring_read(&ring, rec, maxlen)) != 0) {
+        uint32_t seq;
+        if (len < 0)
+            continue; // counted as dropped
+        if (!check_record(rec, len, &seq)) {
+            st->bad_records++;
+            continue;
+        }
+        int id = rec[0];
+        if ((int32_t)seq <= last_seq[id])
+            st->out_of_order++;
+        last_seq[id] = seq;
+        st->records_read[id]++;
+        st->bytes_read += len;
+    }
+    st->bytes_dropped += logring_take_dropped(&ring);
+}
+
+static void *consumer(void *arg) {
+    consumer_stats_t *st = arg;
+    int32_t last_seq[NUM_PRODUCERS];
+    uint32_t n = 0;
+
+    for (int i = 0; i < NUM_PRODUCERS; ++i)
+        last_seq[i] = -1;
+
+    signal_id = 2 * NUM_THREADS;
+    while (__atomic_load_n(&producers_left, __ATOMIC_ACQUIRE) > 0) {
+        // once in a while, read with a buffer too small for some records
+        drain(st, last_seq, (++n & 0x3f) == 0 ? MAX_LEN / 2 : MAX_LEN);
+    }
+    drain(st, last_seq, MAX_LEN);
+    return NULL;
+}
+
+static void test_single_thread(void) {
+    static uint8_t buf[64] __attribute__((aligned(8)));
+    logring_t r;
+    char out[64];
+
+    logring_init(&r, buf, sizeof(buf));
+    CHECK_EQ(logring_read(&r, out, sizeof(out)), 0);
+
+    // 8-byte header plus the 8-byte aligned data: three of these fit
+    CHECK(logring_write(&r, "hello", 5));
+    CHECK(logring_write(&r, "world!!", 7));
+    CHECK(logring_write(&r, "0123456789", 10));
+    CHECK_EQ(logring_take_dropped(&r), 0);
+
+    // the oldest record makes room for the new one
+    CHECK(logring_write(&r, "abc", 3));
+    CHECK_EQ(logring_take_dropped(&r), 5);
+    CHECK_EQ(logring_read(&r, out, sizeof(out)), 7);
+    CHECK(memcmp(out, "world!!", 7) == 0);
+
+    // too long to read: skipped and counted
+    CHECK_EQ(logring_read(&r, out, 4), -1);
+    CHECK_EQ(logring_take_dropped(&r), 10);
+    CHECK_EQ(logring_read(&r, out, sizeof(out)), 3);
+    CHECK(memcmp(out, "abc", 3) == 0);
+    CHECK_EQ(logring_read(&r, out, sizeof(out)), 0);
+
+    // larger than the whole ring
+    CHECK(!logring_write(&r, buf, 60));
+    CHECK_EQ(logring_take_dropped(&r), 60);
+
+    // a record still being written (not committed) isn't read or dropped
+    static uint8_t zbuf[32] __attribute__((aligned(8)));
+    logring_t z = LOGRING_INIT(zbuf);
+    z.wr = 16; // as if a producer had reserved 16 bytes and was preempted
+    CHECK_EQ(logring_read(&z, out, sizeof(out)), 0);
+    CHECK(!logring_write(&z, "0123456789", 10));
+    CHECK_EQ(logring_take_dropped(&z), 10);
+}
+
+int main(void) {
+    pthread_t producers[NUM_THREADS], cons;
+    consumer_stats_t st = {0};
+    timer_t timer;
+    struct sigevent sev = {.sigev_notify = SIGEV_SIGNAL, .sigev_signo = SIGALRM};
+    struct itimerspec period = {{0, SIGNAL_PERIOD_NS}, {0, SIGNAL_PERIOD_NS}};
+    struct itimerspec stop = {{0, 0}, {0, 0}};
+    sigset_t alrm;
+
+    test_single_thread();
+
+    logring_init(&ring, ring_buf, sizeof(ring_buf));
+    signal(SIGALRM, signal_producer);
+    timer_create(CLOCK_MONOTONIC, &sev, &timer);
+
+    // the consumer also waits for the timer to be stopped
+    producers_left = NUM_THREADS + 1;
+    pthread_create(&cons, NULL, consumer, &st);
+    for (int i = 0; i < NUM_THREADS; ++i)
+        pthread_create(&producers[i], NULL, producer, (void *)(intptr_t)i);
+    // only the producers and the consumer take the signal
+    sigemptyset(&alrm);
+    sigaddset(&alrm, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &alrm, NULL);
+    timer_settime(timer, 0, &period, NULL);
+    for (int i = 0; i < NUM_THREADS; ++i)
+        pthread_join(producers[i], NULL);
+    // no more signal records, before the consumer's last drain
+    timer_settime(timer, 0, &stop, NULL);
+    __atomic_fetch_sub(&producers_left, 1, __ATOMIC_RELEASE);
+    pthread_join(cons, NULL);
+    timer_delete(timer);
+
+    uint64_t total = 0;
+    uint32_t records = 0, from_signal = 0, signal_read = 0;
+    for (int i = 0; i < NUM_PRODUCERS; ++i) {
+        total += bytes_written[i];
+        records += st.records_read[i];
+        from_signal += signal_records[i];
+        if (i >= NUM_THREADS)
+            signal_read += st.records_read[i];
+    }
+    printf("logring: %u of %u records read (%u of %u from the signal), %llu of %llu bytes "
+           "dropped\n",
+           (unsigned)records, NUM_THREADS * RECORDS_PER_PRODUCER + (unsigned)from_signal,
+           (unsigned)signal_read, (unsigned)from_signal, (unsigned long long)st.bytes_dropped,
+           (unsigned long long)total);
+
+    CHECK_EQ(st.bad_records, 0);
+    CHECK_EQ(st.out_of_order, 0);
+    CHECK_EQ(st.bytes_read + st.bytes_dropped, total);
+    // the ring is empty, and consistent
+    CHECK_EQ(ring.rd, ring.wr);
+    CHECK(records > 0);
+    CHECK(signal_read > 0);
+
+    return test_done("logring");
+}
@@ -0,0 +1,286 @@
+#include "test.h"
+#include "sensor_conv.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Checks the sensor conversions against values worked out from the datasheets' formulas and
+// sensitivities, and sweeps them against a double precision reference. Then reports the
+// cost per sample, against the float conversions they replaced.
+
+#define BENCH_SAMPLES 1000000
+
+static void le16_set(uint8_t *p, int16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)((uint16_t)v >> 8);
+}
+
+static void set_cal(uint8_t *regs, int h0_x2, int h1_x2, int t0_x8, int t1_x8, int16_t h0_out,
+                    int16_t h1_out, int16_t t0_out, int16_t t1_out) {
+    for (int i = 0; i < HTS221_CAL_LEN; ++i)
+        regs[i] = 0;
+    regs[0x0] = h0_x2;
+    regs[0x1] = h1_x2;
+    regs[0x2] = t0_x8 & 0xff;
+    regs[0x3] = t1_x8 & 0xff;
+    regs[0x5] = ((t0_x8 >> 8) & 3) | (((t1_x8 >> 8) & 3) << 2);
+    le16_set(regs + 0x6, h0_out);
+    le16_set(regs + 0xA, h1_out);
+    le16_set(regs + 0xC, t0_out);
+    le16_set(regs + 0xE, t1_out);
+}
+
+static int32_t temperature(const hts221_cal_t *cal, int16_t out) {
+    uint8_t raw[2];
+    le16_set(raw, out);
+    return hts221_temperature(cal, raw);
+}
+
+static int32_t humidity(const hts221_cal_t *cal, int16_t out) {
+    uint8_t raw[2];
+    le16_set(raw, out);
+    return hts221_humidity(cal, raw);
+}
+
+static int32_t pressure(uint32_t out) {
+    uint8_t raw[3] = {(uint8_t)out, (uint8_t)(out >> 8), (uint8_t)(out >> 16)};
+    return lps22hb_pressure(raw);
+}
+
+static int32_t xyz_x(int16_t out, int64_t scale) {
+    uint8_t raw[6] = {0};
+    int32_t value[3];
+    le16_set(raw, out);
+    sensor_convert_xyz(raw, value, scale);
+    return value[0];
+}
+
+// 22.10, rounded and saturated
+static int32_t fixed(double v) {
+    long long r = llround(v * 1024);
+    return r > INT32_MAX ? INT32_MAX : r < INT32_MIN ? INT32_MIN : (int32_t)r;
+}
+
+static void test_hts221(void) {
+    uint8_t regs[HTS221_CAL_LEN];
+    hts221_cal_t cal;
+
+    // T0 = 10 °C at T0_OUT = 300, T1 = 25 °C at T1_OUT = 500;
+    // H0 = 20 %RH at H0_T0_OUT = -10000, H1 = 70 %RH at H1_T0_OUT = 5000
+    set_cal(regs, 40, 140, 80, 200, -10000, 5000, 300, 500);
+    hts221_cal_init(&cal, regs);
+    CHECK_EQ(temperature(&cal, 300), 10 * 1024);
+    CHECK_EQ(temperature(&cal, 500), 25 * 1024);
+    CHECK_EQ(temperature(&cal, 400), fixed(17.5));
+    CHECK_EQ(temperature(&cal, -100), -20 * 1024);
+    CHECK_EQ(humidity(&cal, -10000), 20 * 1024);
+    CHECK_EQ(humidity(&cal, -2500), 45 * 1024);
+    CHECK_EQ(humidity(&cal, 5000), 70 * 1024);
+    // clamped
+    CHECK_EQ(humidity(&cal, 20000), 100 * 1024);
+    CHECK_EQ(humidity(&cal, -30000), 0);
+
+    // the T0/T1 MSBs (T0_T1_DEGC_H2): 34 °C at -1000, 40 °C at 2000
+    set_cal(regs, 40, 140, 0x110, 0x140, -10000, 5000, -1000, 2000);
+    hts221_cal_init(&cal, regs);
+    CHECK_EQ(temperature(&cal, 500), 37 * 1024);
+    CHECK_EQ(temperature(&cal, -1000), 34 * 1024);
+
+    // a chip with equal calibration outputs gives T0, instead of dividing by zero
+    set_cal(regs, 40, 140, 80, 200, 0, 0, 300, 300);
+    hts221_cal_init(&cal, regs);
+    CHECK_EQ(temperature(&cal, 1234), 10 * 1024);
+    CHECK_EQ(humidity(&cal, 1234), 20 * 1024);
+
+    // random calibrations over the whole output range, within one LSB of the formula
+    srand(1);
+    uint32_t worst = 0;
+    for (int n = 0; n < 200; ++n) {
+        int t0_x8 = rand() % 400, t1_x8 = t0_x8 + 40 + rand() % 400;
+        int h0_x2 = rand() % 80, h1_x2 = h0_x2 + 40 + rand() % 100;
+        int16_t t0_out = rand() % 2000 - 1000, t1_out = t0_out + 200 + rand() % 2000;
+        int16_t h0_out = rand() % 20000 - 10000, h1_out = h0_out + 1000 + rand() % 10000;
+        set_cal(regs, h0_x2, h1_x2, t0_x8, t1_x8, h0_out, h1_out, t0_out, t1_out);
+        hts221_cal_init(&cal, regs);
+        for (int32_t out = -32768; out <= 32767; out += 7) {
+            double t = t0_x8 / 8.0 + (out - t0_out) * (t1_x8 - t0_x8) / 8.0 / (t1_out - t0_out);
+            double h = h0_x2 / 2.0 + (out - h0_out) * (h1_x2 - h0_x2) / 2.0 / (h1_out - h0_out);
+            h = h < 0 ? 0 : h > 100 ? 100 : h;
+            uint32_t et = abs(temperature(&cal, out) - fixed(t));
+            uint32_t eh = abs(humidity(&cal, out) - fixed(h));
+            if (et > worst)
+                worst = et;
+            if (eh > worst)
+                worst = eh;
+        }
+    }
+    CHECK(worst <= 1);
+}
+
+static void test_lps22hb(void) {
+    // the datasheet example: 0x3FF58D is 4191629 / 4096 = 1023.35 hPa
+    CHECK_EQ(pressure(0x3FF58D), fixed(4191629 / 4096.0));
+    // the ends of the operating range, 260 and 1260 hPa
+    CHECK_EQ(pressure(260 * 4096), 260 * 1024);
+    CHECK_EQ(pressure(1260 * 4096), 1260 * 1024);
+    // 24 bit two's complement
+    CHECK_EQ(pressure(0xFFF000), -1024);
+
+    uint32_t worst = 0;
+    for (uint32_t out = 0; out < (1 << 24); out += 3) {
+        int32_t p = (int32_t)(out << 8) >> 8;
+        uint32_t e = abs(pressure(out) - fixed(p / 4096.0));
+        if (e > worst)
+            worst = e;
+    }
+    CHECK(worst <= 1);
+}
+
+static void sweep_xyz(int64_t scale, double sensitivity) {
+    uint32_t worst = 0;
+    for (int32_t out = -32768; out <= 32767; ++out) {
+        uint32_t e = abs(xyz_x(out, scale) - fixed(out * sensitivity));
+        if (e > worst)
+            worst = e;
+    }
+    CHECK(worst <= 1);
+}
+
+static void test_lsm6dsl(void) {
+    // datasheet sensitivities by full scale; FS_XL codes are 2g, 16g, 4g, 8g
+    static const double acc[4] = {0.061, 0.488, 0.122, 0.244};
+    static const double gyro[4] = {8.75, 17.5, 35, 70};
+    for (int fs = 0; fs < 4; ++fs) {
+        // the ODR bits don't matter
+        int64_t a = lsm6dsl_acc_scale(0x60 | fs << 2);
+        int64_t g = lsm6dsl_gyro_scale(0x40 | fs << 2);
+        CHECK_EQ(sensor_micro_per_lsb(a), lround(acc[fs] * 1000));
+        CHECK_EQ(sensor_micro_per_lsb(g), lround(gyro[fs] * 1000));
+        sweep_xyz(a, acc[fs]);
+        sweep_xyz(g, gyro[fs]);
+    }
+
+    // 1 g at +-2g is about 16393 LSB
+    CHECK_EQ(xyz_x(16393, lsm6dsl_acc_scale(0)), fixed(16393 * 0.061));
+    CHECK_EQ(xyz_x(-16393, lsm6dsl_acc_scale(0)), fixed(-16393 * 0.061));
+    // full scale
+    CHECK_EQ(xyz_x(32767, lsm6dsl_acc_scale(0x04)), fixed(32767 * 0.488));
+    // 2293 dps doesn't fit in 22.10
+    CHECK_EQ(xyz_x(-32768, lsm6dsl_gyro_scale(0x0C)), INT32_MIN);
+    CHECK_EQ(xyz_x(32767, lsm6dsl_gyro_scale(0x0C)), INT32_MAX);
+    CHECK_EQ(xyz_x(29000, lsm6dsl_gyro_scale(0x0C)), 29000 * 70 * 1024);
+    CHECK_EQ(xyz_x(1000, lsm6dsl_gyro_scale(0)), 8750 * 1024);
+
+    // all three axes
+    uint8_t raw[6];
+    int32_t value[3];
+    le16_set(raw, 100);
+    le16_set(raw + 2, -200);
+    le16_set(raw + 4, 300);
+    sensor_convert_xyz(raw, value, lsm6dsl_gyro_scale(0x04));
+    CHECK_EQ(value[0], 1750 * 1024);
+    CHECK_EQ(value[1], -3500 * 1024);
+    CHECK_EQ(value[2], 5250 * 1024);
+
+    // LIS3MDL, with the BSP's sensitivities
+    static const double mag[4] = {0.14, 0.29, 0.43, 0.58};
+    for (int fs = 0; fs < 4; ++fs)
+        sweep_xyz(lis3mdl_mag_scale(fs << 5), mag[fs]);
+}
+
+// the float conversions these replaced
+static float ref_t0_degc = 10, ref_t1_degc = 25;
+static int16_t ref_t0_out = 300, ref_t1_out = 500;
+static float ref_sensitivity = 0.061f;
+
+static int32_t float_temperature(const uint8_t *raw) {
+    int16_t out = (int16_t)(raw[0] | (raw[1] << 8));
+    float t = (float)(out - ref_t0_out) * (ref_t1_degc - ref_t0_degc) /
+                  (float)(ref_t1_out - ref_t0_out) +
+              ref_t0_degc;
+    return (int32_t)lroundf(t * 1024);
+}
+
+static void float_xyz(const uint8_t *raw, int32_t *value) {
+    for (int i = 0; i < 3; ++i) {
+        int16_t out = (int16_t)(raw[2 * i] | (raw[2 * i + 1] << 8));
+        value[i] = (int32_t)lroundf(out * ref_sensitivity * 1024);
+    }
+}
+
+static uint64_t now_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+static void bench(void) {
+    static uint8_t raw[BENCH_SAMPLES / 64][6];
+    volatile int32_t sink;
+    int32_t value[3];
+    hts221_cal_t cal;
+    uint8_t regs[HTS221_CAL_LEN];
+    uint64_t start, t[4];
+
+    set_cal(regs, 40, 140, 80, 200, -10000, 5000, 300, 500);
+    hts221_cal_init(&cal, regs);
+    srand(2);
+    for (unsigned i = 0; i < sizeof(raw); ++i)
+        raw[i / 6][i % 6] = rand();
+    const unsigned n = sizeof(raw) / sizeof(raw[0]);
+    int64_t scale = lsm6dsl_acc_scale(0);
+
+    start = now_ticks();
+    for (int r = 0; r < 64; ++r)
+        for (unsigned i = 0; i < n; ++i)
+            sink = hts221_temperature(&cal, raw[i]);
+    t[0] = now_ticks() - start;
+
+    start = now_ticks();
+    for (int r = 0; r < 64; ++r)
+        for (unsigned i = 0; i < n; ++i)
+            sink = float_temperature(raw[i]);
+    t[1] = now_ticks() - start;
+
+    start = now_ticks();
+    for (int r = 0; r < 64; ++r)
+        for (unsigned i = 0; i < n; ++i) {
+            sensor_convert_xyz(raw[i], value, scale);
+            sink = value[0] + value[1] + value[2];
+        }
+    t[2] = now_ticks() - start;
+
+    start = now_ticks();
+    for (int r = 0; r < 64; ++r)
+        for (unsigned i = 0; i < n; ++i) {
+            float_xyz(raw[i], value);
+            sink = value[0] + value[1] + value[2];
+        }
+    t[3] = now_ticks() - start;
+    (void)sink;
+
+    double samples = 64.0 * n;
+#if defined(__x86_64__) || defined(__i386__)
+    const char *unit = "TSC cycles";
+#else
+    const char *unit = "ns";
+#endif
+    printf("sensor_conv: %s per sample: temperature %.1f (float %.1f), xyz %.1f (float %.1f)\n",
+           unit, t[0] / samples, t[1] / samples, t[2] / samples, t[3] / samples);
+}
+
+int main(void) {
+    test_hts221();
+    test_lps22hb();
+    test_lsm6dsl();
+    bench();
+    return test_done("sensor_conv");
+}
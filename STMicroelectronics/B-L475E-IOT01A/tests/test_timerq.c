@@ -0,0 +1,246 @@
+#include "test.h"
+#include "timerq.h"
+
+#include <stddef.h>
+
+// Ordering, cancellation and wrap-around of the timer queue, with a dispatcher that works
+// like TIMx_IRQHandler() in timer.c.
+
+static timerq_t q;
+static uint32_t now;
+
+#define NUM_ENTRIES 8
+static timerq_entry_t entries[NUM_ENTRIES];
+static int fired[32];
+static int num_fired;
+
+#define DEFINE_CB(i)                                                                               \
+    static void cb##i(void) {                                                                      \
+        fired[num_fired++] = i;                                                                    \
+    }
+DEFINE_CB(0)
+DEFINE_CB(1)
+DEFINE_CB(2)
+DEFINE_CB(3)
+DEFINE_CB(4)
+DEFINE_CB(5)
+DEFINE_CB(6)
+DEFINE_CB(7)
+static const timerq_cb_t cbs[NUM_ENTRIES] = {cb0, cb1, cb2, cb3, cb4, cb5, cb6, cb7};
+
+static void reset(uint32_t t) {
+    q.head = NULL;
+    now = t;
+    num_fired = 0;
+    for (int i = 0; i < NUM_ENTRIES; ++i) {
+        entries[i].next = NULL;
+        entries[i].pending = false;
+        entries[i].cb = cbs[i];
+    }
+}
+
+static void start(int i, uint32_t delta) {
+    timerq_insert(&q, &entries[i], now + delta);
+}
+
+// moves the clock forward, running what expires on the way
+static void run_until(uint32_t t) {
+    now = t;
+    timerq_entry_t *e;
+    while ((e = timerq_pop_expired(&q, now)) != NULL)
+        if (e->cb)
+            e->cb();
+}
+
+static void check_fired(const int *expected, int n) {
+    CHECK_EQ(num_fired, n);
+    for (int i = 0; i < n && i < num_fired; ++i)
+        CHECK_EQ(fired[i], expected[i]);
+}
+
+// the queue has to be sorted, and only hold the pending entries
+static void check_queue(void) {
+    int n = 0;
+    for (timerq_entry_t *e = q.head; e; e = e->next) {
+        CHECK(e->pending);
+        if (e->next)
+            CHECK(!timerq_before(e->next->deadline, e->deadline));
+        n++;
+    }
+    for (int i = 0; i < NUM_ENTRIES; ++i)
+        n -= entries[i].pending;
+    CHECK_EQ(n, 0);
+}
+
+static void test_ordering(uint32_t t0) {
+    reset(t0);
+    start(0, 300);
+    start(1, 100);
+    start(2, 200);
+    start(3, 100); // same deadline as 1, goes after it
+    start(4, 0);
+    check_queue();
+    CHECK(timerq_peek(&q) == &entries[4]);
+
+    run_until(t0 + 99);
+    check_fired((int[]){4}, 1);
+    run_until(t0 + 250);
+    check_fired((int[]){4, 1, 3, 2}, 4);
+    run_until(t0 + 1000);
+    check_fired((int[]){4, 1, 3, 2, 0}, 5);
+    CHECK(timerq_peek(&q) == NULL);
+
+    // nothing expires before its deadline
+    reset(t0);
+    start(5, 1);
+    CHECK(timerq_pop_expired(&q, now) == NULL);
+    CHECK(timerq_pop_expired(&q, now + 1) == &entries[5]);
+    CHECK(!entries[5].pending);
+}
+
+static void test_cancel(uint32_t t0) {
+    reset(t0);
+    for (int i = 0; i < 5; ++i)
+        start(i, 100 * (i + 1));
+
+    // the head, one in the middle, and the last one
+    CHECK(timerq_remove(&q, &entries[0]));
+    CHECK(timerq_peek(&q) == &entries[1]);
+    CHECK(timerq_remove(&q, &entries[2]));
+    CHECK(timerq_remove(&q, &entries[4]));
+    check_queue();
+    // not pending anymore, or never were
+    CHECK(!timerq_remove(&q, &entries[0]));
+    CHECK(!timerq_remove(&q, &entries[6]));
+
+    run_until(t0 + 1000);
+    check_fired((int[]){1, 3}, 2);
+
+    // cancelling the only entry empties the queue
+    reset(t0);
+    start(0, 10);
+    CHECK(timerq_remove(&q, &entries[0]));
+    CHECK(timerq_peek(&q) == NULL);
+    run_until(t0 + 100);
+    check_fired(NULL, 0);
+}
+
+static void test_move(uint32_t t0) {
+    reset(t0);
+    start(0, 100);
+    start(1, 200);
+    start(2, 300);
+    // starting a pending entry again moves it, it isn't queued twice
+    start(0, 250);
+    start(2, 50);
+    check_queue();
+    run_until(t0 + 1000);
+    check_fired((int[]){2, 1, 0}, 3);
+}
+
+// callbacks that re-arm, or start and cancel other entries, while the dispatcher runs
+static int periodic_left;
+
+static void periodic_cb(void) {
+    fired[num_fired++] = 6;
+    if (--periodic_left > 0)
+        timerq_insert(&q, &entries[6], entries[6].deadline + 100);
+}
+
+static void rearm_now_cb(void) {
+    fired[num_fired++] = 7;
+    // already expired: the dispatcher picks it up again in the same run, after the others due
+    if (num_fired < 4)
+        timerq_insert(&q, &entries[7], now);
+}
+
+static void cancel_other_cb(void) {
+    fired[num_fired++] = 5;
+    timerq_remove(&q, &entries[1]);
+}
+
+static void test_rearm(uint32_t t0) {
+    reset(t0);
+    periodic_left = 5;
+    entries[6].cb = periodic_cb;
+    start(6, 100);
+    start(0, 250);
+    run_until(t0 + 150);
+    check_fired((int[]){6}, 1);
+    // deadlines stay on the 100us grid, even when the dispatcher runs late
+    run_until(t0 + 420);
+    check_fired((int[]){6, 6, 0, 6, 6}, 5);
+    CHECK_EQ(entries[6].deadline, t0 + 500);
+    CHECK(entries[6].pending);
+    run_until(t0 + 1000);
+    check_fired((int[]){6, 6, 0, 6, 6, 6}, 6);
+    CHECK(!entries[6].pending);
+
+    reset(t0);
+    entries[7].cb = rearm_now_cb;
+    start(7, 10);
+    start(2, 10);
+    run_until(t0 + 10);
+    check_fired((int[]){7, 2, 7, 7}, 4);
+    CHECK(timerq_peek(&q) == NULL);
+
+    // a callback cancelling an entry that is due at the same time
+    reset(t0);
+    entries[5].cb = cancel_other_cb;
+    start(5, 10);
+    start(1, 10);
+    start(2, 20);
+    run_until(t0 + 50);
+    check_fired((int[]){5, 2}, 2);
+}
+
+static void test_wraparound(void) {
+    // deadlines on both sides of 2^32 keep their order
+    reset(0xffffff00);
+    start(0, 0x80);   // 0xffffff80
+    start(1, 0x180);  // 0x00000080
+    start(2, 0x100);  // 0x00000000
+    start(3, 0xff);   // 0xffffffff
+    start(4, 0x1000); // 0x00000f00
+    check_queue();
+    run_until(0xffffffff);
+    check_fired((int[]){0, 3}, 2);
+    run_until(0);
+    check_fired((int[]){0, 3, 2}, 3);
+    run_until(0x80);
+    check_fired((int[]){0, 3, 2, 1}, 4);
+    CHECK(timerq_pop_expired(&q, 0xeff) == NULL);
+    run_until(0xf00);
+    check_fired((int[]){0, 3, 2, 1, 4}, 5);
+
+    CHECK(timerq_before(0xffffffff, 0));
+    CHECK(!timerq_before(0, 0xffffffff));
+    CHECK(timerq_before(0x7ffffff0, 0x80000010));
+    // the limit documented in timerq.h: up to 2^31 - 1 apart
+    CHECK(timerq_before(0, 0x7fffffff));
+    CHECK(!timerq_before(0, 0x80000001));
+
+    // a periodic timer crossing 2^32 doesn't stall or fire early
+    reset(0xfffffe00);
+    periodic_left = 10;
+    entries[6].cb = periodic_cb;
+    start(6, 100);
+    for (uint32_t t = 0xfffffe00; num_fired < 10; t += 50)
+        run_until(t);
+    CHECK_EQ(num_fired, 10);
+    CHECK_EQ(now, 0xfffffe00u + 1000);
+}
+
+int main(void) {
+    // away from, and just before, the wrap-around
+    const uint32_t starts[] = {1000, 0xffffff00, 0xffffffff - 250};
+    for (unsigned i = 0; i < sizeof(starts) / sizeof(starts[0]); ++i) {
+        test_ordering(starts[i]);
+        test_cancel(starts[i]);
+        test_move(starts[i]);
+        test_rearm(starts[i]);
+    }
+    test_wraparound();
+
+    return test_done("timerq");
+}
@@ -0,0 +1,189 @@
+#include "test.h"
+#include "tlsf.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Replays the allocation traces in data/tlsf on an arena the size of JD_HEAP_SIZE. The first
+// pass checks every block (alignment, size, contents until it is freed) and that the arena is
+// whole again at the end; then the trace is timed against TLSF and the host malloc().
+//
+// Block headers are twice as large with 64-bit pointers, so the peak is a bit higher here than
+// on the device.
+
+// as JD_HEAP_SIZE in jd_user_config.h
+#define ARENA_SIZE (20 * 1024)
+#define BENCH_REPEAT 200
+
+static const char *const traces[] = {"client.trace", "upload.trace", "churn.trace"};
+
+typedef struct {
+    uint32_t id;
+    uint32_t size; // 0 for a free
+} trace_op_t;
+
+typedef struct {
+    trace_op_t *ops;
+    uint32_t num_ops;
+    uint32_t max_id;
+} trace_t;
+
+static uint8_t arena[ARENA_SIZE] __attribute__((aligned(TLSF_ALIGN)));
+
+static bool load_trace(trace_t *tr, const char *dir, const char *name) {
+    char path[512], line[128];
+    uint32_t cap = 1024;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        printf("can't open %s\n", path);
+        return false;
+    }
+
+    tr->ops = malloc(cap * sizeof(trace_op_t));
+    tr->num_ops = 0;
+    tr->max_id = 0;
+    while (fgets(line, sizeof(line), f)) {
+        trace_op_t op = {0};
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        if (sscanf(line, "a %u %u", &op.id, &op.size) != 2 &&
+            (sscanf(line, "f %u", &op.id) != 1 || line[0] != 'f')) {
+            printf("%s: bad line: %s", name, line);
+            fclose(f);
+            return false;
+        }
+        if (tr->num_ops == cap) {
+            cap *= 2;
+            tr->ops = realloc(tr->ops, cap * sizeof(trace_op_t));
+        }
+        tr->ops[tr->num_ops++] = op;
+        if (op.id > tr->max_id)
+            tr->max_id = op.id;
+    }
+    fclose(f);
+    return true;
+}
+
+static uint8_t fill_byte(uint32_t id, uint32_t i) {
+    return (uint8_t)(id * 13 + i);
+}
+
+static void check_trace(const trace_t *tr, const char *name) {
+    tlsf_t t;
+    tlsf_stats_t s;
+    void **ptrs = calloc(tr->max_id + 1, sizeof(void *));
+    uint32_t *sizes = calloc(tr->max_id + 1, sizeof(uint32_t));
+    uint32_t worst_frag = 0, bad = 0;
+
+    tlsf_init(&t, arena, sizeof(arena));
+    tlsf_get_stats(&t, &s);
+    uint32_t initial_free = s.free;
+    CHECK_EQ(s.largest_free, initial_free);
+
+    for (uint32_t n = 0; n < tr->num_ops; ++n) {
+        const trace_op_t *op = &tr->ops[n];
+        if (op->size) {
+            uint8_t *p = tlsf_malloc(&t, op->size);
+            CHECK(p != NULL);
+            if (!p)
+                continue;
+            CHECK_EQ((uintptr_t)p % TLSF_ALIGN, 0);
+            CHECK(tlsf_block_size(p) >= op->size);
+            for (uint32_t i = 0; i < op->size; ++i)
+                p[i] = fill_byte(op->id, i);
+            ptrs[op->id] = p;
+            sizes[op->id] = op->size;
+
+            // the share of free memory that can't be allocated in one block
+            tlsf_get_stats(&t, &s);
+            uint32_t frag = s.free ? 100 - (uint32_t)((uint64_t)s.largest_free * 100 / s.free) : 0;
+            if (frag > worst_frag)
+                worst_frag = frag;
+        } else {
+            uint8_t *p = ptrs[op->id];
+            for (uint32_t i = 0; p && i < sizes[op->id]; ++i)
+                if (p[i] != fill_byte(op->id, i))
+                    bad++;
+            CHECK(tlsf_free(&t, p));
+            ptrs[op->id] = NULL;
+        }
+    }
+
+    CHECK_EQ(bad, 0);
+    tlsf_get_stats(&t, &s);
+    printf("%s: %u ops, peak %u of %u bytes, worst fragmentation %u%%\n", name,
+           (unsigned)tr->num_ops, (unsigned)s.peak, (unsigned)initial_free,
+           (unsigned)worst_frag);
+    // every block was freed, and merged back into one
+    CHECK_EQ(s.in_use, 0);
+    CHECK_EQ(s.num_allocs, 0);
+    CHECK_EQ(s.num_failed, 0);
+    CHECK_EQ(s.free, initial_free);
+    CHECK_EQ(s.largest_free, initial_free);
+
+    free(ptrs);
+    free(sizes);
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void bench_trace(const trace_t *tr, const char *name) {
+    tlsf_t t;
+    void **ptrs = calloc(tr->max_id + 1, sizeof(void *));
+    double start, tlsf_ns, malloc_ns;
+
+    start = now_ns();
+    for (int r = 0; r < BENCH_REPEAT; ++r) {
+        tlsf_init(&t, arena, sizeof(arena));
+        for (uint32_t n = 0; n < tr->num_ops; ++n) {
+            const trace_op_t *op = &tr->ops[n];
+            if (op->size)
+                ptrs[op->id] = tlsf_malloc(&t, op->size);
+            else
+                tlsf_free(&t, ptrs[op->id]);
+        }
+    }
+    tlsf_ns = (now_ns() - start) / ((double)BENCH_REPEAT * tr->num_ops);
+
+    start = now_ns();
+    for (int r = 0; r < BENCH_REPEAT; ++r) {
+        for (uint32_t n = 0; n < tr->num_ops; ++n) {
+            const trace_op_t *op = &tr->ops[n];
+            if (op->size)
+                ptrs[op->id] = malloc(op->size);
+            else
+                free(ptrs[op->id]);
+        }
+    }
+    malloc_ns = (now_ns() - start) / ((double)BENCH_REPEAT * tr->num_ops);
+
+    printf("%s: %.1f ns per op, host malloc() %.1f ns\n", name, tlsf_ns, malloc_ns);
+    free(ptrs);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("usage: %s <trace dir>\n", argv[0]);
+        return 2;
+    }
+
+    for (unsigned i = 0; i < sizeof(traces) / sizeof(traces[0]); ++i) {
+        trace_t tr;
+        if (!load_trace(&tr, argv[1], traces[i])) {
+            test_failures++;
+            continue;
+        }
+        check_trace(&tr, traces[i]);
+        bench_trace(&tr, traces[i]);
+        free(tr.ops);
+    }
+
+    return test_done("tlsf");
+}
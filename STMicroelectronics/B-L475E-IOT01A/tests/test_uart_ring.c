@@ -0,0 +1,113 @@
+#include "test.h"
+#include "uart_ring.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Replays the byte streams in data/uart_ring through the splitter, as the circular DMA and
+// the idle-line interrupt would, for a few ring sizes so that frames wrap around at
+// different offsets.
+
+#define MAX_BLOCK 1024
+// as in uart.c
+#define JD_UART_RX_RING_FRAMES 4
+
+static const char *const streams[] = {"single.txt", "back_to_back.txt", "errors.txt"};
+
+typedef struct {
+    uint8_t *buf;
+    uint32_t size;
+    uint32_t pos; // DMA write offset
+    uart_ring_t ring;
+} replay_t;
+
+static void dma_write(replay_t *rp, const uint8_t *data, uint32_t len) {
+    for (uint32_t i = 0; i < len; ++i) {
+        rp->buf[rp->pos] = data[i];
+        rp->pos = (rp->pos + 1) % rp->size;
+    }
+}
+
+// the frame has to be the block's bytes after at most two leading breaks
+static int frame_in_block(const jd_frame_t *frame, const uint8_t *block, uint32_t len) {
+    uint32_t fsize = frame->size + 12;
+    for (uint32_t skip = 0; skip <= 2 && skip + fsize <= len; ++skip)
+        if (memcmp(frame, block + skip, fsize) == 0)
+            return 1;
+    return 0;
+}
+
+static void replay_file(replay_t *rp, const char *dir, const char *name) {
+    char path[512], line[256];
+    uint8_t block[MAX_BLOCK];
+    uint32_t len = 0;
+    int lineno = 0;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        printf("can't open %s\n", path);
+        test_failures++;
+        return;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        int expected;
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        if (sscanf(line, "idle %d", &expected) == 1) {
+            jd_frame_t frame;
+            uint32_t errors = rp->ring.num_errors;
+
+            CHECK(uart_ring_busy(&rp->ring, rp->pos) == (len != 0));
+            int r = uart_ring_idle(&rp->ring, rp->pos, &frame);
+            if (r != expected) {
+                printf("%s:%d: uart_ring_idle() == %d, expected %d (ring size %u)\n", name,
+                       lineno, r, expected, (unsigned)rp->size);
+                test_failures++;
+            } else if (r > 0) {
+                CHECK(frame_in_block(&frame, block, len));
+            }
+            CHECK_EQ(rp->ring.num_errors, errors + (r < 0));
+            CHECK(!uart_ring_busy(&rp->ring, rp->pos));
+            len = 0;
+            continue;
+        }
+
+        char *p = line;
+        uint32_t start = len;
+        for (;;) {
+            char *end;
+            unsigned long b = strtoul(p, &end, 16);
+            if (end == p)
+                break;
+            if (b > 0xff || len >= MAX_BLOCK) {
+                printf("%s:%d: bad byte\n", name, lineno);
+                test_failures++;
+                break;
+            }
+            block[len++] = b;
+            p = end;
+        }
+        dma_write(rp, block + start, len - start);
+    }
+    fclose(f);
+}
+
+int main(int argc, char **argv) {
+    const char *dir = argc > 1 ? argv[1] : "data/uart_ring";
+    // the firmware default, then a range of sizes, so that the wrap-around falls on every
+    // part of the frames
+    for (uint32_t size = sizeof(jd_frame_t); size <= 2 * sizeof(jd_frame_t); ++size) {
+        replay_t rp = {0};
+        rp.size = size == sizeof(jd_frame_t) ? JD_UART_RX_RING_FRAMES * sizeof(jd_frame_t) : size;
+        rp.buf = calloc(1, rp.size);
+        uart_ring_init(&rp.ring, rp.buf, rp.size);
+        for (unsigned j = 0; j < sizeof(streams) / sizeof(streams[0]); ++j)
+            replay_file(&rp, dir, streams[j]);
+        free(rp.buf);
+    }
+
+    return test_done("uart_ring");
+}
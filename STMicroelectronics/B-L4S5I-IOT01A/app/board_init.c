@@ -7,6 +7,8 @@
 
 #include "tx_api.h"
 
+#include "cmsis_utils.h"
+
 #include "stm32l4s5i_iot01.h"
 #include "stm32l4s5i_iot01_accelero.h"
 #include "stm32l4s5i_iot01_gyro.h"
@@ -38,6 +40,7 @@ static void UART_Console_Init(void)
     UartHandle.Init.HwFlowCtl              = UART_HWCONTROL_NONE;
     UartHandle.AdvancedInit.AdvFeatureInit = UART_ADVFEATURE_NO_INIT;
     BSP_COM_Init(COM1, &UartHandle);
+    UART_Console_DMA_Init();
 }
 
 static void Init_MEM1_Sensors(void)
@@ -80,6 +83,9 @@ void board_init(void)
     // Configure the system clock
     SystemClock_Config();
 
+    // Cycle counter for the microsecond delays
+    dwt_init();
+
     // Initialize all configured peripherals
     MX_GPIO_Init();
     MX_RNG_Init();
@@ -105,6 +111,15 @@ uint32_t HAL_GetTick(void)
     return tx_time_get() * 10;
 }
 
+// HAL_GetTick() has a 10ms resolution, and doesn't advance before the kernel starts
+void HAL_Delay(uint32_t Delay)
+{
+    while (Delay--)
+    {
+        dwt_delay_us(1000);
+    }
+}
+
 // EXTI line detection callback
 void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
 {
@@ -25,6 +25,7 @@
 #include <string.h>
 #include "es_wifi_conf.h"
 #include <core_cm4.h>
+#include "cmsis_utils.h"
 
 /* Private define ------------------------------------------------------------*/
 #define MIN(a, b)  ((a) < (b) ? (a) : (b))
@@ -450,27 +451,7 @@ void SPI_WIFI_Delay(uint32_t Delay)
   */
 void SPI_WIFI_DelayUs(uint32_t n)
 {
-  volatile        uint32_t ct = 0;
-  uint32_t        loop_per_us = 0;
-  static uint32_t cycle_per_loop = 0;
-
-  /* calibration happen on first call for a duration of 1 ms * nbcycle per loop */
-  /* 10 cycle for STM32L4 */
-  if (cycle_per_loop == 0 ) 
-  {
-     uint32_t cycle_per_ms = (SystemCoreClock/1000UL);
-     uint32_t t = 0;
-     ct = cycle_per_ms;
-     t = HAL_GetTick();
-     while(ct) ct--;
-     cycle_per_loop = HAL_GetTick()-t;
-     if (cycle_per_loop == 0) cycle_per_loop = 1;
-  }
-
-  loop_per_us = SystemCoreClock/1000000UL/cycle_per_loop;
-  ct = n * loop_per_us;
-  while(ct) ct--;
-  return;
+  dwt_delay_us(n);
 }
 
 /**
@@ -11,6 +11,11 @@ function(post_build TARGET)
             DEPENDS ${TARGET}
             COMMAND ${CMAKE_OBJCOPY} -Obinary ${TARGET}.elf ${TARGET}.bin
             COMMAND ${CMAKE_OBJCOPY} -Oihex ${TARGET}.elf ${TARGET}.hex)
+        if(CMAKE_SIZE_UTIL)
+            # per section sizes, including .dma_bss and .fast_bss (mem_sections.h)
+            add_custom_command(TARGET ${TARGET}.bin POST_BUILD
+                COMMAND ${CMAKE_SIZE_UTIL} -A -x ${TARGET}.elf)
+        endif()
     else()
         message(FATAL_ERROR "Unknown CMAKE_C_COMPILER_ID ${CMAKE_C_COMPILER_ID}")
     endif()
@@ -15,6 +15,9 @@
 #include "azure_iot_mqtt/azure_iot_dps_mqtt.h"
 #include "azure_iot_mqtt/sas_token.h"
 
+#define LOG_MODULE_LEVEL LOG_LEVEL_MQTT
+#include "logging.h"
+
 #define USERNAME                "%s/%s/?api-version=2020-09-30&model-id=%s"
 #define PUBLISH_TELEMETRY_TOPIC "devices/%s/messages/events/"
 
@@ -47,7 +50,7 @@ static ULONG azure_iot_certificate_verify(NX_SECURE_TLS_SESSION* session, NX_SEC
         certificate, (UCHAR*)azure_iot_x509_hostname, strlen(azure_iot_x509_hostname));
     if (status)
     {
-        printf("Error in certificate verification: DNS name did not match CN\r\n");
+        LOG_ERROR("Error in certificate verification: DNS name did not match CN\r\n");
     }
 
     return status;
@@ -120,7 +123,7 @@ UINT tls_setup(NXD_MQTT_CLIENT* client,
         sizeof(azure_iot_mqtt->tls_metadata_buffer));
     if (status != NX_SUCCESS)
     {
-        printf("Failed to create TLS session status (0x%04x)\r\n", status);
+        LOG_ERROR("Failed to create TLS session status (0x%04x)\r\n", status);
         return status;
     }
 
@@ -130,7 +133,7 @@ UINT tls_setup(NXD_MQTT_CLIENT* client,
         sizeof(azure_iot_mqtt->mqtt_remote_cert_buffer));
     if (status != NX_SUCCESS)
     {
-        printf("Failed to create remote certificate buffer (0x%04x)\r\n", status);
+        LOG_ERROR("Failed to create remote certificate buffer (0x%04x)\r\n", status);
         return status;
     }
 
@@ -145,14 +148,14 @@ UINT tls_setup(NXD_MQTT_CLIENT* client,
         NX_SECURE_X509_KEY_TYPE_NONE);
     if (status != NX_SUCCESS)
     {
-        printf("Unable to initialize CA certificate (0x%04x)\r\n", status);
+        LOG_ERROR("Unable to initialize CA certificate (0x%04x)\r\n", status);
         return status;
     }
 
     status = nx_secure_tls_trusted_certificate_add(tls_session, trusted_cert);
     if (status != NX_SUCCESS)
     {
-        printf("Unable to add CA certificate to trusted store (0x%04x)\r\n", status);
+        LOG_ERROR("Unable to add CA certificate to trusted store (0x%04x)\r\n", status);
         return status;
     }
 
@@ -160,7 +163,7 @@ UINT tls_setup(NXD_MQTT_CLIENT* client,
         tls_session, azure_iot_mqtt->tls_packet_buffer, sizeof(azure_iot_mqtt->tls_packet_buffer));
     if (status != NX_SUCCESS)
     {
-        printf("Could not set TLS session packet buffer (0x%02x)\r\n", status);
+        LOG_ERROR("Could not set TLS session packet buffer (0x%02x)\r\n", status);
         return status;
     }
 
@@ -169,7 +172,7 @@ UINT tls_setup(NXD_MQTT_CLIENT* client,
     status = nx_secure_tls_session_certificate_callback_set(tls_session, azure_iot_certificate_verify);
     if (status)
     {
-        printf("Failed to set the session certificate callback: status: %d", status);
+        LOG_ERROR("Failed to set the session certificate callback: status: %d", status);
         return status;
     }
 
@@ -191,7 +194,7 @@ UINT mqtt_publish(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic, CHAR* message)
         NX_WAIT_FOREVER);
     if (status != NX_SUCCESS)
     {
-        printf("Failed to publish %s (0x%02x)\r\n", message, status);
+        LOG_ERROR("Failed to publish %s (0x%02x)\r\n", message, status);
     }
 
     return status;
@@ -205,7 +208,7 @@ static UINT mqtt_publish_float(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic, CHAR
     int fracvalue = abs(100 * (value - (long)value));
 
     snprintf(mqtt_message, sizeof(mqtt_message), "{\"%s\":%d.%02d}", label, decvalue, fracvalue);
-    printf("Sending message %s\r\n", mqtt_message);
+    LOG_DEBUG("Sending message %s\r\n", mqtt_message);
 
     return mqtt_publish(azure_iot_mqtt, topic, mqtt_message);
 }
@@ -215,7 +218,7 @@ static UINT mqtt_publish_bool(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic, CHAR*
     CHAR mqtt_message[200];
 
     snprintf(mqtt_message, sizeof(mqtt_message), "{\"%s\":%s}", label, (value ? "true" : "false"));
-    printf("Sending message %s\r\n", mqtt_message);
+    LOG_DEBUG("Sending message %s\r\n", mqtt_message);
 
     return mqtt_publish(azure_iot_mqtt, topic, mqtt_message);
 }
@@ -241,21 +244,21 @@ static VOID process_direct_method(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic, C
     find = strstr(location, "$rid=");
     if (find == 0)
     {
-        printf("Error: failed to parse direct method rid\r\n");
+        LOG_ERROR("Error: failed to parse direct method rid\r\n");
         return;
     }
 
     location = find + 5;
     strncpy(azure_iot_mqtt->direct_command_request_id, location, AZURE_IOT_MQTT_DIRECT_COMMAND_RID_SIZE);
 
-    printf("Received direct method=%s, rid=%s, message=%s\r\n",
+    LOG_DEBUG("Received direct method=%s, rid=%s, message=%s\r\n",
         direct_method_name,
         azure_iot_mqtt->direct_command_request_id,
         message);
 
     if (azure_iot_mqtt->cb_ptr_mqtt_invoke_direct_method == NULL)
     {
-        printf("No callback is registered for MQTT direct method invoke\r\n");
+        LOG_WARN("No callback is registered for MQTT direct method invoke\r\n");
         return;
     }
 
@@ -269,7 +272,7 @@ static VOID process_c2d_message(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic, CHA
     // Get to parameters list
     if ((properties = strstr(topic, ".to")) == 0)
     {
-        printf("Received C2D message has no parameter list\r\n");
+        LOG_WARN("Received C2D message has no parameter list\r\n");
         return;
     }
 
@@ -287,7 +290,7 @@ static VOID process_c2d_message(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic, CHA
 
     if (azure_iot_mqtt->cb_ptr_mqtt_c2d_message == NULL)
     {
-        printf("No callback is registered for MQTT cloud to device message processing\r\n");
+        LOG_WARN("No callback is registered for MQTT cloud to device message processing\r\n");
         return;
     }
 
@@ -310,7 +313,7 @@ static VOID process_device_twin_response(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* t
 
     response_status = atoi(location);
 
-    printf("Processed device twin update response with status=%d\r\n", response_status);
+    LOG_INFO("Processed device twin update response with status=%d\r\n", response_status);
 
     if (response_status == 200)
     {
@@ -320,7 +323,7 @@ static VOID process_device_twin_response(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* t
 
 static VOID process_device_twin_desired_prop_update(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR* topic, CHAR* message)
 {
-    printf("Received device twin desired property\r\n");
+    LOG_INFO("Received device twin desired property\r\n");
 
     // Parse the device twin version
     CHAR* location = topic + sizeof(DEVICE_TWIN_DESIRED_PROP_RES_BASE) - 1;
@@ -328,7 +331,7 @@ static VOID process_device_twin_desired_prop_update(AZURE_IOT_MQTT* azure_iot_mq
     location = strstr(location, "$version=");
     if (location == 0)
     {
-        printf("Error: Failed to parse version from desired property update\r\n");
+        LOG_ERROR("Error: Failed to parse version from desired property update\r\n");
         return;
     }
 
@@ -339,7 +342,7 @@ static VOID process_device_twin_desired_prop_update(AZURE_IOT_MQTT* azure_iot_mq
 
 static VOID mqtt_disconnect_cb(NXD_MQTT_CLIENT* client_ptr)
 {
-    printf("ERROR: MQTT disconnected, reconnecting...\r\n");
+    LOG_ERROR("ERROR: MQTT disconnected, reconnecting...\r\n");
 
     AZURE_IOT_MQTT* azure_iot_mqtt = (AZURE_IOT_MQTT*)client_ptr;
 
@@ -370,7 +373,7 @@ static VOID mqtt_notify_cb(NXD_MQTT_CLIENT* client_ptr, UINT number_of_messages)
             &actual_message_length);
         if (status != NXD_MQTT_SUCCESS)
         {
-            printf("ERROR: nxd_mqtt_client_message_get failed (0x%02x)\r\n", status);
+            LOG_ERROR("ERROR: nxd_mqtt_client_message_get failed (0x%02x)\r\n", status);
             continue;
         }
 
@@ -400,7 +403,7 @@ static VOID mqtt_notify_cb(NXD_MQTT_CLIENT* client_ptr, UINT number_of_messages)
         }
         else
         {
-            printf("Unknown topic received, no custom processing specified\r\n");
+            LOG_WARN("Unknown topic received, no custom processing specified\r\n");
         }
     }
 }
@@ -409,7 +412,7 @@ static UINT azure_iot_mqtt_create_common(AZURE_IOT_MQTT* azure_iot_mqtt, NX_IP*
 {
     UINT status;
 
-    printf("\r\nInitializing MQTT Hub client\r\n");
+    LOG_INFO("\r\nInitializing MQTT Hub client\r\n");
 
     status = nxd_mqtt_client_create(&azure_iot_mqtt->nxd_mqtt_client,
         "MQTT client",
@@ -424,14 +427,14 @@ static UINT azure_iot_mqtt_create_common(AZURE_IOT_MQTT* azure_iot_mqtt, NX_IP*
         0);
     if (status != NXD_MQTT_SUCCESS)
     {
-        printf("Failed to create MQTT Client (0x%02x)\r\n", status);
+        LOG_ERROR("Failed to create MQTT Client (0x%02x)\r\n", status);
         return status;
     }
 
     status = nxd_mqtt_client_receive_notify_set(&azure_iot_mqtt->nxd_mqtt_client, mqtt_notify_cb);
     if (status != NXD_MQTT_SUCCESS)
     {
-        printf("Error in setting receive notify (0x%02x)\r\n", status);
+        LOG_ERROR("Error in setting receive notify (0x%02x)\r\n", status);
         nxd_mqtt_client_delete(&azure_iot_mqtt->nxd_mqtt_client);
         return status;
     }
@@ -439,7 +442,7 @@ static UINT azure_iot_mqtt_create_common(AZURE_IOT_MQTT* azure_iot_mqtt, NX_IP*
     status = nxd_mqtt_client_disconnect_notify_set(&azure_iot_mqtt->nxd_mqtt_client, mqtt_disconnect_cb);
     if (status != NXD_MQTT_SUCCESS)
     {
-        printf("Error in seting disconnect notification (0x%02x)\r\n", status);
+        LOG_ERROR("Error in seting disconnect notification (0x%02x)\r\n", status);
         nxd_mqtt_client_delete(&azure_iot_mqtt->nxd_mqtt_client);
         return status;
     }
@@ -456,7 +459,7 @@ UINT azure_iot_mqtt_publish_float_property(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR*
     CHAR mqtt_publish_topic[100];
     UINT status;
 
-    printf("Sending device twin update with float value\r\n");
+    LOG_INFO("Sending device twin update with float value\r\n");
 
     snprintf(mqtt_publish_topic,
         sizeof(mqtt_publish_topic),
@@ -472,7 +475,7 @@ UINT azure_iot_mqtt_publish_bool_property(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR*
 {
     CHAR mqtt_publish_topic[100];
 
-    printf("Sending device twin update with bool value\r\n");
+    LOG_INFO("Sending device twin update with bool value\r\n");
 
     snprintf(mqtt_publish_topic,
         sizeof(mqtt_publish_topic),
@@ -486,7 +489,7 @@ UINT azure_iot_mqtt_publish_float_telemetry(AZURE_IOT_MQTT* azure_iot_mqtt, CHAR
 {
     CHAR mqtt_publish_topic[100];
 
-    printf("Sending telemetry with float value\r\n");
+    LOG_INFO("Sending telemetry with float value\r\n");
 
     snprintf(mqtt_publish_topic,
         sizeof(mqtt_publish_topic),
@@ -501,7 +504,7 @@ UINT azure_iot_mqtt_publish_int_writeable_property(AZURE_IOT_MQTT* azure_iot_mqt
     CHAR mqtt_publish_topic[100];
     CHAR mqtt_publish_message[100];
 
-    printf("Reporting writeable property %s as %d\r\n", label, value);
+    LOG_INFO("Reporting writeable property %s as %d\r\n", label, value);
 
     snprintf(mqtt_publish_topic,
         sizeof(mqtt_publish_topic),
@@ -523,7 +526,7 @@ UINT azure_iot_mqtt_respond_int_writeable_property(
     CHAR mqtt_publish_topic[100];
     CHAR mqtt_publish_message[100];
 
-    printf("Responding to writeable property %s = %d\r\n", label, value);
+    LOG_INFO("Responding to writeable property %s = %d\r\n", label, value);
 
     snprintf(mqtt_publish_topic,
         sizeof(mqtt_publish_topic),
@@ -545,7 +548,7 @@ UINT azure_iot_mqtt_respond_direct_method(AZURE_IOT_MQTT* azure_iot_mqtt, UINT r
 {
     CHAR mqtt_publish_topic[100];
 
-    printf("Responding to direct command property with status:%d, rid:%s\r\n",
+    LOG_INFO("Responding to direct command property with status:%d, rid:%s\r\n",
         response,
         azure_iot_mqtt->direct_command_request_id);
 
@@ -562,7 +565,7 @@ UINT azure_iot_mqtt_device_twin_request(AZURE_IOT_MQTT* azure_iot_mqtt)
 {
     CHAR mqtt_publish_topic[100];
 
-    printf("Requesting device twin model\r\n");
+    LOG_INFO("Requesting device twin model\r\n");
 
     snprintf(mqtt_publish_topic, sizeof(mqtt_publish_topic), DEVICE_TWIN_REQUEST_TOPIC, 0);
 
@@ -582,13 +585,13 @@ UINT azure_iot_mqtt_create(AZURE_IOT_MQTT* azure_iot_mqtt,
 {
     if (azure_iot_mqtt == NULL)
     {
-        printf("ERROR: azure_iot_mqtt is NULL\r\n");
+        LOG_ERROR("ERROR: azure_iot_mqtt is NULL\r\n");
         return NX_PTR_ERROR;
     }
 
     if (iot_hub_hostname[0] == 0 || iot_device_id[0] == 0 || iot_sas_key[0] == 0)
     {
-        printf("ERROR: IoT Hub connection configuration is empty\r\n");
+        LOG_ERROR("ERROR: IoT Hub connection configuration is empty\r\n");
         return NX_PTR_ERROR;
     }
 
@@ -618,17 +621,17 @@ UINT azure_iot_mqtt_create_with_dps(AZURE_IOT_MQTT* azure_iot_mqtt,
 {
     UINT status;
 
-    printf("\r\nInitializing MQTT DPS client\r\n");
+    LOG_INFO("\r\nInitializing MQTT DPS client\r\n");
 
     if (azure_iot_mqtt == NULL)
     {
-        printf("ERROR: azure_iot_mqtt is NULL\r\n");
+        LOG_ERROR("ERROR: azure_iot_mqtt is NULL\r\n");
         return NX_PTR_ERROR;
     }
 
     if (iot_dps_id_scope[0] == 0 || iot_registration_id[0] == 0 || iot_sas_key[0] == 0)
     {
-        printf("ERROR: IoT DPS connection configuration is empty\r\n");
+        LOG_ERROR("ERROR: IoT DPS connection configuration is empty\r\n");
         return NX_PTR_ERROR;
     }
 
@@ -646,14 +649,14 @@ UINT azure_iot_mqtt_create_with_dps(AZURE_IOT_MQTT* azure_iot_mqtt,
     status = azure_iot_dps_create(azure_iot_mqtt, nx_ip, nx_pool);
     if (status != NX_SUCCESS)
     {
-        printf("ERROR: Failed to create DPS client (0x%04x)\r\n", status);
+        LOG_ERROR("ERROR: Failed to create DPS client (0x%04x)\r\n", status);
         return status;
     }
 
     status = azure_iot_dps_register(azure_iot_mqtt, NX_WAIT_FOREVER);
     if (status != NX_SUCCESS)
     {
-        printf("ERROR: Failed to register DPS device (0x%04x)\r\n", status);
+        LOG_ERROR("ERROR: Failed to register DPS device (0x%04x)\r\n", status);
         azure_iot_dps_delete(azure_iot_mqtt);
         return status;
     }
@@ -661,11 +664,11 @@ UINT azure_iot_mqtt_create_with_dps(AZURE_IOT_MQTT* azure_iot_mqtt,
     status = azure_iot_dps_delete(azure_iot_mqtt);
     if (status != NX_SUCCESS)
     {
-        printf("ERROR: Failed to delete DPS client (0x%04x)\r\n", status);
+        LOG_ERROR("ERROR: Failed to delete DPS client (0x%04x)\r\n", status);
         return status;
     }
 
-    printf("SUCCESS: MQTT DPS client initialized\r\n");
+    LOG_INFO("SUCCESS: MQTT DPS client initialized\r\n");
 
     // call into common code
     return azure_iot_mqtt_create_common(azure_iot_mqtt, nx_ip, nx_pool);
@@ -685,9 +688,9 @@ UINT azure_iot_mqtt_connect(AZURE_IOT_MQTT* azure_iot_mqtt)
     CHAR mqtt_subscribe_topic[100];
     NXD_ADDRESS server_ip;
 
-    printf("\tHub hostname: %s\r\n", azure_iot_mqtt->mqtt_hub_hostname);
-    printf("\tDevice id: %s\r\n", azure_iot_mqtt->mqtt_device_id);
-    printf("\tModel id: %s\r\n", azure_iot_mqtt->mqtt_model_id);
+    LOG_INFO("\tHub hostname: %s\r\n", azure_iot_mqtt->mqtt_hub_hostname);
+    LOG_INFO("\tDevice id: %s\r\n", azure_iot_mqtt->mqtt_device_id);
+    LOG_INFO("\tModel id: %s\r\n", azure_iot_mqtt->mqtt_model_id);
 
     // Create the username & password
     snprintf(azure_iot_mqtt->mqtt_username,
@@ -705,7 +708,7 @@ UINT azure_iot_mqtt_connect(AZURE_IOT_MQTT* azure_iot_mqtt)
             azure_iot_mqtt->mqtt_password,
             AZURE_IOT_MQTT_PASSWORD_SIZE))
     {
-        printf("ERROR: Unable to generate SAS token\r\n");
+        LOG_ERROR("ERROR: Unable to generate SAS token\r\n");
         return NX_PTR_ERROR;
     }
 
@@ -716,7 +719,7 @@ UINT azure_iot_mqtt_connect(AZURE_IOT_MQTT* azure_iot_mqtt)
         strlen(azure_iot_mqtt->mqtt_password));
     if (status != NXD_MQTT_SUCCESS)
     {
-        printf("Could not create Login Set (0x%02x)\r\n", status);
+        LOG_ERROR("Could not create Login Set (0x%02x)\r\n", status);
         nx_secure_tls_session_delete(&azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_tls_session);
         return status;
     }
@@ -729,7 +732,7 @@ UINT azure_iot_mqtt_connect(AZURE_IOT_MQTT* azure_iot_mqtt)
         NX_IP_VERSION_V4);
     if (status != NX_SUCCESS)
     {
-        printf("Unable to resolve DNS for MQTT Server %s (0x%02x)\r\n", azure_iot_mqtt->mqtt_hub_hostname, status);
+        LOG_ERROR("Unable to resolve DNS for MQTT Server %s (0x%02x)\r\n", azure_iot_mqtt->mqtt_hub_hostname, status);
         nx_secure_tls_session_delete(&azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_tls_session);
         return status;
     }
@@ -746,7 +749,7 @@ UINT azure_iot_mqtt_connect(AZURE_IOT_MQTT* azure_iot_mqtt)
         MQTT_TIMEOUT);
     if (status != NXD_MQTT_SUCCESS)
     {
-        printf("Could not connect to MQTT server (0x%02x)\r\n", status);
+        LOG_ERROR("Could not connect to MQTT server (0x%02x)\r\n", status);
         nx_secure_tls_session_delete(&azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_tls_session);
         return status;
     }
@@ -756,7 +759,7 @@ UINT azure_iot_mqtt_connect(AZURE_IOT_MQTT* azure_iot_mqtt)
         &azure_iot_mqtt->nxd_mqtt_client, mqtt_subscribe_topic, strlen(mqtt_subscribe_topic), MQTT_QOS_0);
     if (status != NXD_MQTT_SUCCESS)
     {
-        printf("Error in subscribing to server (0x%02x)\r\n", status);
+        LOG_ERROR("Error in subscribing to server (0x%02x)\r\n", status);
         nx_secure_tls_session_delete(&azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_tls_session);
         return status;
     }
@@ -765,7 +768,7 @@ UINT azure_iot_mqtt_connect(AZURE_IOT_MQTT* azure_iot_mqtt)
         &azure_iot_mqtt->nxd_mqtt_client, DIRECT_METHOD_TOPIC, strlen(DIRECT_METHOD_TOPIC), MQTT_QOS_0);
     if (status != NXD_MQTT_SUCCESS)
     {
-        printf("Error in direct method subscribing to server (0x%02x)\r\n", status);
+        LOG_ERROR("Error in direct method subscribing to server (0x%02x)\r\n", status);
         nx_secure_tls_session_delete(&azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_tls_session);
         return status;
     }
@@ -774,7 +777,7 @@ UINT azure_iot_mqtt_connect(AZURE_IOT_MQTT* azure_iot_mqtt)
         &azure_iot_mqtt->nxd_mqtt_client, DEVICE_TWIN_RES_TOPIC, strlen(DEVICE_TWIN_RES_TOPIC), MQTT_QOS_0);
     if (status != NXD_MQTT_SUCCESS)
     {
-        printf("Error in device twin response subscribing to server (0x%02x)\r\n", status);
+        LOG_ERROR("Error in device twin response subscribing to server (0x%02x)\r\n", status);
         nx_secure_tls_session_delete(&azure_iot_mqtt->nxd_mqtt_client.nxd_mqtt_tls_session);
         return status;
     }
@@ -785,11 +788,11 @@ UINT azure_iot_mqtt_connect(AZURE_IOT_MQTT* azure_iot_mqtt)
         MQTT_QOS_0);
     if (status != NXD_MQTT_SUCCESS)
     {
-        printf("Error in device twin desired properties response subscribing to server (0x%02x)\r\n", status);
+        LOG_ERROR("Error in device twin desired properties response subscribing to server (0x%02x)\r\n", status);
         return status;
     }
 
-    printf("SUCCESS: MQTT Hub client initialized\r\n\r\n");
+    LOG_INFO("SUCCESS: MQTT Hub client initialized\r\n\r\n");
 
     return NXD_MQTT_SUCCESS;
 }
@@ -12,6 +12,9 @@
 #include "azure_iot_ciphersuites.h"
 #include "azure_iot_connect.h"
 
+#define LOG_MODULE_LEVEL LOG_LEVEL_NX_CLIENT
+#include "logging.h"
+
 #define NX_AZURE_IOT_THREAD_PRIORITY 4
 
 // Incoming events from the middleware
@@ -23,6 +26,7 @@
 #define HUB_WRITABLE_PROPERTIES_RECEIVE_EVENT 0x10
 #define HUB_PROPERTIES_COMPLETE_EVENT         0x20
 #define HUB_PERIODIC_TIMER_EVENT              0x40
+#define HUB_APP_EVENT                         0x80
 
 #define AZURE_IOT_DPS_ENDPOINT "global.azure-devices-provisioning.net"
 
@@ -34,9 +38,21 @@
 #define DPS_REGISTER_TIMEOUT_TICKS (30 * TX_TIMER_TICKS_PER_SECOND)
 
 #define DPS_PAYLOAD_SIZE       (15 + 128)
-#define TELEMETRY_BUFFER_SIZE  256
 #define PROPERTIES_BUFFER_SIZE 128
 
+// Boards that send several telemetry streams in one message need more
+#ifndef TELEMETRY_BUFFER_SIZE
+#define TELEMETRY_BUFFER_SIZE 256
+#endif
+
+// Telemetry streams due within this many ticks of each other are sent together
+#define TELEMETRY_COALESCE_TICKS (TX_TIMER_TICKS_PER_SECOND / 2)
+
+// Writable properties of the telemetry streams, appended to the stream name
+#define TELEMETRY_INTERVAL_SUFFIX "Interval"
+#define TELEMETRY_PHASE_SUFFIX    "Phase"
+#define TELEMETRY_PROPERTY_SIZE   64
+
 // define static strings for content type and -encoding on message property bag
 static const UCHAR content_type_property[]     = "$.ct";
 static const UCHAR content_encoding_property[] = "$.ce";
@@ -59,6 +75,16 @@ static VOID printf_packet(CHAR* prepend, NX_PACKET* packet_ptr)
     printf("\r\n");
 }
 
+// whole payloads are only dumped at LOG_LEVEL_DEBUG
+#define LOG_PACKET(prepend, packet_ptr)                                                                                \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (LOG_ENABLED(LOG_LEVEL_DEBUG))                                                                              \
+        {                                                                                                              \
+            printf_packet(prepend, packet_ptr);                                                                        \
+        }                                                                                                              \
+    } while (0)
+
 static VOID connection_status_callback(NX_AZURE_IOT_HUB_CLIENT* hub_client_ptr, UINT status)
 {
     // :HACK: This callback doesn't allow us to provide context, pinch it from the command message callback args
@@ -122,7 +148,7 @@ static UINT iot_hub_initialize(AZURE_IOT_NX_CONTEXT* nx_context)
              sizeof(nx_context->nx_azure_iot_tls_metadata_buffer),
              &nx_context->root_ca_cert)))
     {
-        printf("Error: on nx_azure_iot_hub_client_initialize (0x%08x)\r\n", status);
+        LOG_ERROR("Error: on nx_azure_iot_hub_client_initialize (0x%08x)\r\n", status);
         return status;
     }
 
@@ -134,7 +160,7 @@ static UINT iot_hub_initialize(AZURE_IOT_NX_CONTEXT* nx_context)
                  (UCHAR*)nx_context->azure_iot_device_sas_key,
                  nx_context->azure_iot_device_sas_key_len)))
         {
-            printf("Error: failed on nx_azure_iot_hub_client_symmetric_key_set (0x%08x)\r\n", status);
+            LOG_ERROR("Error: failed on nx_azure_iot_hub_client_symmetric_key_set (0x%08x)\r\n", status);
         }
     }
     else if (nx_context->azure_iot_auth_mode == AZURE_IOT_AUTH_MODE_CERT)
@@ -143,25 +169,25 @@ static UINT iot_hub_initialize(AZURE_IOT_NX_CONTEXT* nx_context)
         if ((status = nx_azure_iot_hub_client_device_cert_set(
                  &nx_context->iothub_client, &nx_context->device_certificate)))
         {
-            printf("Error: failed on nx_azure_iot_hub_client_device_cert_set!: error code = 0x%08x\r\n", status);
+            LOG_ERROR("Error: failed on nx_azure_iot_hub_client_device_cert_set!: error code = 0x%08x\r\n", status);
         }
     }
 
     if (status != NX_AZURE_IOT_SUCCESS)
     {
-        printf("Failed to set auth credentials\r\n");
+        LOG_ERROR("Failed to set auth credentials\r\n");
     }
 
     // Add more CA certificates
     else if ((status =
                      nx_azure_iot_hub_client_trusted_cert_add(&nx_context->iothub_client, &nx_context->root_ca_cert_2)))
     {
-        printf("Failed on nx_azure_iot_hub_client_trusted_cert_add!: error code = 0x%08x\r\n", status);
+        LOG_ERROR("Failed on nx_azure_iot_hub_client_trusted_cert_add!: error code = 0x%08x\r\n", status);
     }
     else if ((status =
                      nx_azure_iot_hub_client_trusted_cert_add(&nx_context->iothub_client, &nx_context->root_ca_cert_3)))
     {
-        printf("Failed on nx_azure_iot_hub_client_trusted_cert_add!: error code = 0x%08x\r\n", status);
+        LOG_ERROR("Failed on nx_azure_iot_hub_client_trusted_cert_add!: error code = 0x%08x\r\n", status);
     }
 
     // Set Model id
@@ -169,26 +195,26 @@ static UINT iot_hub_initialize(AZURE_IOT_NX_CONTEXT* nx_context)
                   (UCHAR*)nx_context->azure_iot_model_id,
                   nx_context->azure_iot_model_id_len)))
     {
-        printf("Error: nx_azure_iot_hub_client_model_id_set (0x%08x)\r\n", status);
+        LOG_ERROR("Error: nx_azure_iot_hub_client_model_id_set (0x%08x)\r\n", status);
     }
 
     // Set connection status callback
     else if ((status = nx_azure_iot_hub_client_connection_status_callback_set(
                   &nx_context->iothub_client, connection_status_callback)))
     {
-        printf("Error: failed on connection_status_callback (0x%08x)\r\n", status);
+        LOG_ERROR("Error: failed on connection_status_callback (0x%08x)\r\n", status);
     }
 
     // Enable commands
     else if ((status = nx_azure_iot_hub_client_command_enable(&nx_context->iothub_client)))
     {
-        printf("Error: command receive enable failed (0x%08x)\r\n", status);
+        LOG_ERROR("Error: command receive enable failed (0x%08x)\r\n", status);
     }
 
     // Enable properties
     else if ((status = nx_azure_iot_hub_client_properties_enable(&nx_context->iothub_client)))
     {
-        printf("Failed on nx_azure_iot_hub_client_properties_enable!: error code = 0x%08x\r\n", status);
+        LOG_ERROR("Failed on nx_azure_iot_hub_client_properties_enable!: error code = 0x%08x\r\n", status);
     }
 
     // Set properties callback
@@ -197,14 +223,14 @@ static UINT iot_hub_initialize(AZURE_IOT_NX_CONTEXT* nx_context)
                   message_receive_callback_properties,
                   (VOID*)nx_context)))
     {
-        printf("Error: device twin callback set (0x%08x)\r\n", status);
+        LOG_ERROR("Error: device twin callback set (0x%08x)\r\n", status);
     }
 
     // Set command callback
     else if ((status = nx_azure_iot_hub_client_receive_callback_set(
                   &nx_context->iothub_client, NX_AZURE_IOT_HUB_COMMAND, message_receive_command, (VOID*)nx_context)))
     {
-        printf("Error: device method callback set (0x%08x)\r\n", status);
+        LOG_ERROR("Error: device method callback set (0x%08x)\r\n", status);
     }
 
     // Set the writable property callback
@@ -213,7 +239,7 @@ static UINT iot_hub_initialize(AZURE_IOT_NX_CONTEXT* nx_context)
                   message_receive_callback_writable_property,
                   (VOID*)nx_context)))
     {
-        printf("Error: device twin desired property callback set (0x%08x)\r\n", status);
+        LOG_ERROR("Error: device twin desired property callback set (0x%08x)\r\n", status);
     }
 
     // Register the pnp components for receiving
@@ -223,7 +249,7 @@ static UINT iot_hub_initialize(AZURE_IOT_NX_CONTEXT* nx_context)
                  (UCHAR*)nx_context->azure_iot_components[i],
                  strlen(nx_context->azure_iot_components[i]))))
         {
-            printf("ERROR: nx_azure_iot_hub_client_component_add failed (0x%08x)\r\n", status);
+            LOG_ERROR("ERROR: nx_azure_iot_hub_client_component_add failed (0x%08x)\r\n", status);
             break;
         }
     }
@@ -243,21 +269,21 @@ static UINT dps_initialize(AZURE_IOT_NX_CONTEXT* nx_context)
 
     if (nx_context == NULL)
     {
-        printf("ERROR: context is NULL\r\n");
+        LOG_ERROR("ERROR: context is NULL\r\n");
         return NX_PTR_ERROR;
     }
 
     // Return error if empty credentials
     if (nx_context->azure_iot_dps_id_scope_len == 0 || nx_context->azure_iot_dps_registration_id_len == 0)
     {
-        printf("ERROR: azure_iot_nx_client_dps_entry incorrect parameters\r\n");
+        LOG_ERROR("ERROR: azure_iot_nx_client_dps_entry incorrect parameters\r\n");
         return NX_PTR_ERROR;
     }
 
-    printf("\r\nInitializing Azure IoT DPS client\r\n");
-    printf("\tDPS endpoint: %s\r\n", AZURE_IOT_DPS_ENDPOINT);
-    printf("\tDPS ID scope: %.*s\r\n", nx_context->azure_iot_dps_id_scope_len, nx_context->azure_iot_dps_id_scope);
-    printf("\tRegistration ID: %.*s\r\n",
+    LOG_INFO("\r\nInitializing Azure IoT DPS client\r\n");
+    LOG_INFO("\tDPS endpoint: %s\r\n", AZURE_IOT_DPS_ENDPOINT);
+    LOG_INFO("\tDPS ID scope: %.*s\r\n", nx_context->azure_iot_dps_id_scope_len, nx_context->azure_iot_dps_id_scope);
+    LOG_INFO("\tRegistration ID: %.*s\r\n",
         nx_context->azure_iot_dps_registration_id_len,
         nx_context->azure_iot_dps_registration_id);
 
@@ -267,7 +293,7 @@ static UINT dps_initialize(AZURE_IOT_NX_CONTEXT* nx_context)
 
     if (snprintf(payload, sizeof(payload), DPS_PAYLOAD, nx_context->azure_iot_model_id) > DPS_PAYLOAD_SIZE - 1)
     {
-        printf("ERROR: insufficient buffer size to create DPS payload\r\n");
+        LOG_ERROR("ERROR: insufficient buffer size to create DPS payload\r\n");
         return NX_SIZE_ERROR;
     }
 
@@ -288,7 +314,7 @@ static UINT dps_initialize(AZURE_IOT_NX_CONTEXT* nx_context)
              sizeof(nx_context->nx_azure_iot_tls_metadata_buffer),
              &nx_context->root_ca_cert)))
     {
-        printf("ERROR: nx_azure_iot_provisioning_client_initialize (0x%08x)\r\n", status);
+        LOG_ERROR("ERROR: nx_azure_iot_provisioning_client_initialize (0x%08x)\r\n", status);
         return status;
     }
 
@@ -296,12 +322,12 @@ static UINT dps_initialize(AZURE_IOT_NX_CONTEXT* nx_context)
     else if ((status = nx_azure_iot_provisioning_client_trusted_cert_add(
                   &nx_context->dps_client, &nx_context->root_ca_cert_2)))
     {
-        printf("ERROR: nx_azure_iot_provisioning_client_trusted_cert_add!: error code = 0x%08x\r\n", status);
+        LOG_ERROR("ERROR: nx_azure_iot_provisioning_client_trusted_cert_add!: error code = 0x%08x\r\n", status);
     }
     else if ((status = nx_azure_iot_provisioning_client_trusted_cert_add(
                   &nx_context->dps_client, &nx_context->root_ca_cert_3)))
     {
-        printf("ERROR: nx_azure_iot_provisioning_client_trusted_cert_add!: error code = 0x%08x\r\n", status);
+        LOG_ERROR("ERROR: nx_azure_iot_provisioning_client_trusted_cert_add!: error code = 0x%08x\r\n", status);
     }
 
     else
@@ -314,7 +340,7 @@ static UINT dps_initialize(AZURE_IOT_NX_CONTEXT* nx_context)
                          (UCHAR*)nx_context->azure_iot_device_sas_key,
                          nx_context->azure_iot_device_sas_key_len)))
                 {
-                    printf("ERROR: nx_azure_iot_provisioning_client_symmetric_key_set (0x%08x)\r\n", status);
+                    LOG_ERROR("ERROR: nx_azure_iot_provisioning_client_symmetric_key_set (0x%08x)\r\n", status);
                 }
                 break;
 
@@ -323,7 +349,7 @@ static UINT dps_initialize(AZURE_IOT_NX_CONTEXT* nx_context)
                 if ((status = nx_azure_iot_provisioning_client_device_cert_set(
                          &nx_context->dps_client, &nx_context->device_certificate)))
                 {
-                    printf("ERROR: nx_azure_iot_provisioning_client_device_cert_set (0x%08x)\r\n", status);
+                    LOG_ERROR("ERROR: nx_azure_iot_provisioning_client_device_cert_set (0x%08x)\r\n", status);
                 }
                 break;
         }
@@ -331,19 +357,19 @@ static UINT dps_initialize(AZURE_IOT_NX_CONTEXT* nx_context)
 
     if (status != NX_AZURE_IOT_SUCCESS)
     {
-        printf("ERROR: failed to set initialize DPS\r\n");
+        LOG_ERROR("ERROR: failed to set initialize DPS\r\n");
     }
 
     // Set the payload containing the model Id
     else if ((status = nx_azure_iot_provisioning_client_registration_payload_set(
                   &nx_context->dps_client, (UCHAR*)payload, strlen(payload))))
     {
-        printf("ERROR: nx_azure_iot_provisioning_client_registration_payload_set (0x%08x\r\n", status);
+        LOG_ERROR("ERROR: nx_azure_iot_provisioning_client_registration_payload_set (0x%08x\r\n", status);
     }
 
     else if ((status = nx_azure_iot_provisioning_client_register(&nx_context->dps_client, DPS_REGISTER_TIMEOUT_TICKS)))
     {
-        printf("\tERROR: nx_azure_iot_provisioning_client_register (0x%08x)\r\n", status);
+        LOG_ERROR("\tERROR: nx_azure_iot_provisioning_client_register (0x%08x)\r\n", status);
     }
 
     // Stash IoT Hub Device info
@@ -353,7 +379,7 @@ static UINT dps_initialize(AZURE_IOT_NX_CONTEXT* nx_context)
                   (UCHAR*)nx_context->azure_iot_hub_device_id,
                   &nx_context->azure_iot_hub_device_id_len)))
     {
-        printf("ERROR: nx_azure_iot_provisioning_client_iothub_device_info_get (0x%08x)\r\n", status);
+        LOG_ERROR("ERROR: nx_azure_iot_provisioning_client_iothub_device_info_get (0x%08x)\r\n", status);
     }
 
     // Destroy Provisioning Client
@@ -364,11 +390,28 @@ static UINT dps_initialize(AZURE_IOT_NX_CONTEXT* nx_context)
         return status;
     }
 
-    printf("SUCCESS: Azure IoT DPS client initialized\r\n");
+    LOG_INFO("SUCCESS: Azure IoT DPS client initialized\r\n");
 
     return iot_hub_initialize(nx_context);
 }
 
+// Sets the next time the stream is due after now; the due times are phase seconds past the
+// multiples of the interval, counted from the connection
+static VOID telemetry_stream_schedule(AZURE_IOT_NX_CONTEXT* nx_context, AZURE_IOT_TELEMETRY_STREAM* stream, ULONG now)
+{
+    ULONG period = stream->interval * TX_TIMER_TICKS_PER_SECOND;
+    ULONG start  = nx_context->telemetry_epoch + stream->phase * TX_TIMER_TICKS_PER_SECOND;
+
+    if (period == 0 || (LONG)(start - now) >= 0)
+    {
+        stream->next_tick = start;
+    }
+    else
+    {
+        stream->next_tick = start + ((now - start) / period + 1) * period;
+    }
+}
+
 static VOID process_connect(AZURE_IOT_NX_CONTEXT* nx_context)
 {
     UINT status;
@@ -376,13 +419,21 @@ static VOID process_connect(AZURE_IOT_NX_CONTEXT* nx_context)
     // Request the client properties
     if ((status = nx_azure_iot_hub_client_properties_request(&nx_context->iothub_client, NX_WAIT_FOREVER)))
     {
-        printf("ERROR: failed to request properties (0x%08x)\r\n", status);
+        LOG_ERROR("ERROR: failed to request properties (0x%08x)\r\n", status);
     }
 
     // Start the periodic timer
     if ((status = tx_timer_activate(&nx_context->periodic_timer)))
     {
-        printf("ERROR: tx_timer_activate (0x%08x)\r\n", status);
+        LOG_ERROR("ERROR: tx_timer_activate (0x%08x)\r\n", status);
+    }
+
+    // Start the telemetry streams
+    nx_context->telemetry_epoch           = tx_time_get();
+    nx_context->telemetry_streams_running = true;
+    for (UINT i = 0; i < nx_context->telemetry_stream_count; i++)
+    {
+        telemetry_stream_schedule(nx_context, &nx_context->telemetry_streams[i], nx_context->telemetry_epoch);
     }
 }
 
@@ -390,12 +441,19 @@ static VOID process_disconnect(AZURE_IOT_NX_CONTEXT* nx_context)
 {
     UINT status;
 
-    printf("Disconnected from IoT Hub\r\n");
+    LOG_INFO("Disconnected from IoT Hub\r\n");
 
     // Stop the periodic timer
     if ((status = tx_timer_deactivate(&nx_context->periodic_timer)))
     {
-        printf("ERROR: tx_timer_deactivate (0x%08x)\r\n", status);
+        LOG_ERROR("ERROR: tx_timer_deactivate (0x%08x)\r\n", status);
+    }
+
+    nx_context->telemetry_streams_running = false;
+
+    if (nx_context->disconnected_cb)
+    {
+        nx_context->disconnected_cb(nx_context);
     }
 }
 
@@ -430,8 +488,8 @@ static VOID process_command(AZURE_IOT_NX_CONTEXT* nx_context)
                 &packet_ptr,
                 NX_NO_WAIT)) == NX_AZURE_IOT_SUCCESS)
     {
-        printf("Received command: %.*s\r\n", (INT)command_name_length, (CHAR*)command_name_ptr);
-        printf_packet("\tPayload: ", packet_ptr);
+        LOG_INFO("Received command: %.*s\r\n", (INT)command_name_length, (CHAR*)command_name_ptr);
+        LOG_PACKET("\tPayload: ", packet_ptr);
 
         payload_ptr    = packet_ptr->nx_packet_prepend_ptr;
         payload_length = packet_ptr->nx_packet_append_ptr - packet_ptr->nx_packet_prepend_ptr;
@@ -456,11 +514,85 @@ static VOID process_command(AZURE_IOT_NX_CONTEXT* nx_context)
     // If we failed for anything other than no packet, then report error
     if (status != NX_AZURE_IOT_NO_PACKET)
     {
-        printf("Error: Command receive failed (0x%08x)\r\n", status);
+        LOG_ERROR("Error: Command receive failed (0x%08x)\r\n", status);
         return;
     }
 }
 
+// Handles the "<name>Interval" and "<name>Phase" properties of the telemetry streams, and
+// acknowledges them when they come from a writable properties message. Returns false for
+// the other properties.
+static bool process_telemetry_stream_property(AZURE_IOT_NX_CONTEXT* nx_context,
+    UCHAR* property_name,
+    UINT property_name_len,
+    NX_AZURE_IOT_JSON_READER* json_reader_ptr,
+    UINT message_type,
+    ULONG version)
+{
+    for (UINT i = 0; i < nx_context->telemetry_stream_count; i++)
+    {
+        AZURE_IOT_TELEMETRY_STREAM* stream = &nx_context->telemetry_streams[i];
+        UINT name_len                      = strlen(stream->name);
+        CHAR* suffix                       = (CHAR*)property_name + name_len;
+        UINT suffix_len                    = property_name_len - name_len;
+        CHAR property[TELEMETRY_PROPERTY_SIZE];
+        UINT* setting;
+        int32_t value;
+
+        if (property_name_len <= name_len || strncmp((CHAR*)property_name, stream->name, name_len) != 0)
+        {
+            continue;
+        }
+
+        if (suffix_len == sizeof(TELEMETRY_INTERVAL_SUFFIX) - 1 &&
+            strncmp(suffix, TELEMETRY_INTERVAL_SUFFIX, suffix_len) == 0)
+        {
+            setting = &stream->interval;
+        }
+        else if (suffix_len == sizeof(TELEMETRY_PHASE_SUFFIX) - 1 &&
+                 strncmp(suffix, TELEMETRY_PHASE_SUFFIX, suffix_len) == 0)
+        {
+            setting = &stream->phase;
+        }
+        else
+        {
+            continue;
+        }
+
+        snprintf(property, sizeof(property), "%.*s", (INT)property_name_len, property_name);
+
+        if (nx_azure_iot_json_reader_token_int32_get(json_reader_ptr, &value) || value < 0 ||
+            value > AZURE_IOT_TELEMETRY_SCHEDULE_MAX)
+        {
+            LOG_ERROR("ERROR: invalid value for %s\r\n", property);
+            if (message_type == NX_AZURE_IOT_HUB_WRITABLE_PROPERTIES)
+            {
+                // Reject it, with the setting that is kept
+                azure_nx_client_respond_int_writable_property(nx_context, NULL, property, *setting, 400, version);
+            }
+            return true;
+        }
+
+        LOG_INFO("Updating %s to %d\r\n", property, (INT)value);
+        *setting = value;
+
+        if (nx_context->telemetry_streams_running)
+        {
+            telemetry_stream_schedule(nx_context, stream, tx_time_get());
+        }
+
+        if (message_type == NX_AZURE_IOT_HUB_WRITABLE_PROPERTIES)
+        {
+            // Confirm reception back to hub
+            azure_nx_client_respond_int_writable_property(nx_context, NULL, property, value, 200, version);
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
 static UINT process_properties_shared(AZURE_IOT_NX_CONTEXT* nx_context,
     NX_PACKET* packet_ptr,
     UINT message_type,
@@ -478,7 +610,7 @@ static UINT process_properties_shared(AZURE_IOT_NX_CONTEXT* nx_context,
 
     if ((status = nx_azure_iot_json_reader_init(&json_reader, packet_ptr)))
     {
-        printf("Error: failed to initialize json reader (0x%08x)\r\n", status);
+        LOG_ERROR("Error: failed to initialize json reader (0x%08x)\r\n", status);
         nx_packet_release(packet_ptr);
         return status;
     }
@@ -487,7 +619,7 @@ static UINT process_properties_shared(AZURE_IOT_NX_CONTEXT* nx_context,
     if ((status = nx_azure_iot_hub_client_properties_version_get(
              &nx_context->iothub_client, &json_reader, message_type, &properties_version)))
     {
-        printf("Error: Properties version get failed (0x%08x)\r\n", status);
+        LOG_ERROR("Error: Properties version get failed (0x%08x)\r\n", status);
         nx_packet_release(packet_ptr);
         return status;
     }
@@ -495,7 +627,7 @@ static UINT process_properties_shared(AZURE_IOT_NX_CONTEXT* nx_context,
     // reinitialize the json reader after reading the version to reset
     if ((status = nx_azure_iot_json_reader_init(&json_reader, packet_ptr)))
     {
-        printf("Error: failed to initialize json reader (0x%08x)\r\n", status);
+        LOG_ERROR("Error: failed to initialize json reader (0x%08x)\r\n", status);
         nx_packet_release(packet_ptr);
         return status;
     }
@@ -510,19 +642,29 @@ static UINT process_properties_shared(AZURE_IOT_NX_CONTEXT* nx_context,
         if (nx_azure_iot_json_reader_token_string_get(
                 &json_reader, scratch_buffer, scratch_buffer_len, &property_name_length))
         {
-            printf("Failed to get string property value\r\n");
+            LOG_ERROR("Failed to get string property value\r\n");
             return NX_NOT_SUCCESSFUL;
         }
 
         nx_azure_iot_json_reader_next_token(&json_reader);
 
-        property_received_cb(nx_context,
-            component_name_ptr,
-            component_name_length,
-            scratch_buffer,
-            property_name_length,
-            &json_reader,
-            properties_version);
+        if (component_name_length == 0 &&
+            process_telemetry_stream_property(
+                nx_context, scratch_buffer, property_name_length, &json_reader, message_type, properties_version))
+        {
+            // Handled by the client
+        }
+
+        else if (property_received_cb)
+        {
+            property_received_cb(nx_context,
+                component_name_ptr,
+                component_name_length,
+                scratch_buffer,
+                property_name_length,
+                &json_reader,
+                properties_version);
+        }
 
         // If we are still looking at the value, then skip over it (including if it has children)
         if (nx_azure_iot_json_reader_token_type(&json_reader) == NX_AZURE_IOT_READER_TOKEN_BEGIN_OBJECT)
@@ -543,13 +685,13 @@ static VOID process_properties(AZURE_IOT_NX_CONTEXT* nx_context)
 
     if ((status = nx_azure_iot_hub_client_properties_receive(&nx_context->iothub_client, &packet_ptr, NX_WAIT_FOREVER)))
     {
-        printf("ERROR: nx_azure_iot_hub_client_properties_receive failed (0x%08x)\r\n", status);
+        LOG_ERROR("ERROR: nx_azure_iot_hub_client_properties_receive failed (0x%08x)\r\n", status);
         return;
     }
 
-    printf_packet("Receive properties: ", packet_ptr);
+    LOG_PACKET("Receive properties: ", packet_ptr);
 
-    if (nx_context->property_received_cb)
+    if (nx_context->property_received_cb || nx_context->telemetry_stream_count > 0)
     {
         // Parse the writable properties from the device twin receive receive message
         if ((status = process_properties_shared(nx_context,
@@ -560,7 +702,7 @@ static VOID process_properties(AZURE_IOT_NX_CONTEXT* nx_context)
                  sizeof(properties_buffer),
                  nx_context->property_received_cb)))
         {
-            printf("Error: failed to parse properties (0x%08x)\r\n", status);
+            LOG_ERROR("Error: failed to parse properties (0x%08x)\r\n", status);
         }
     }
 
@@ -579,13 +721,13 @@ static VOID process_writable_properties(AZURE_IOT_NX_CONTEXT* nx_context)
     if ((status = nx_azure_iot_hub_client_writable_properties_receive(
              &nx_context->iothub_client, &packet_ptr, NX_WAIT_FOREVER)))
     {
-        printf("ERROR: nx_azure_iot_hub_client_writable_properties_receive (0x%08x)\r\n", status);
+        LOG_ERROR("ERROR: nx_azure_iot_hub_client_writable_properties_receive (0x%08x)\r\n", status);
         return;
     }
 
-    printf_packet("Receive properties: ", packet_ptr);
+    LOG_PACKET("Receive properties: ", packet_ptr);
 
-    if (nx_context->writable_property_received_cb)
+    if (nx_context->writable_property_received_cb || nx_context->telemetry_stream_count > 0)
     {
         // Parse the writable properties from the writable receive message
         if ((status = process_properties_shared(nx_context,
@@ -596,7 +738,7 @@ static VOID process_writable_properties(AZURE_IOT_NX_CONTEXT* nx_context)
                  sizeof(properties_buffer),
                  nx_context->writable_property_received_cb)))
         {
-            printf("ERROR: failed to parse properties (0x%08x)\r\n", status);
+            LOG_ERROR("ERROR: failed to parse properties (0x%08x)\r\n", status);
         }
     }
 
@@ -612,6 +754,14 @@ static VOID process_timer_event(AZURE_IOT_NX_CONTEXT* nx_context)
     }
 }
 
+static VOID process_app_event(AZURE_IOT_NX_CONTEXT* nx_context)
+{
+    if (nx_context->app_event_cb)
+    {
+        nx_context->app_event_cb(nx_context);
+    }
+}
+
 UINT azure_nx_client_periodic_interval_set(AZURE_IOT_NX_CONTEXT* nx_context, INT interval)
 {
     UINT status;
@@ -620,71 +770,53 @@ UINT azure_nx_client_periodic_interval_set(AZURE_IOT_NX_CONTEXT* nx_context, INT
 
     if ((status = tx_timer_info_get(&nx_context->periodic_timer, NULL, &active, NULL, NULL, NULL)))
     {
-        printf("ERROR: tx_timer_deactivate (0x%08x)\r\n", status);
+        LOG_ERROR("ERROR: tx_timer_deactivate (0x%08x)\r\n", status);
         return status;
     }
 
     if (active == TX_TRUE && (status = tx_timer_deactivate(&nx_context->periodic_timer)))
     {
-        printf("ERROR: tx_timer_deactivate (0x%08x)\r\n", status);
+        LOG_ERROR("ERROR: tx_timer_deactivate (0x%08x)\r\n", status);
     }
 
     else if ((status = tx_timer_change(&nx_context->periodic_timer, ticks, ticks)))
     {
-        printf("ERROR: tx_timer_change (0x%08x)\r\n", status);
+        LOG_ERROR("ERROR: tx_timer_change (0x%08x)\r\n", status);
     }
 
     else if (active == TX_TRUE && (status = tx_timer_activate(&nx_context->periodic_timer)))
     {
-        printf("ERROR: tx_timer_activate (0x%08x)\r\n", status);
+        LOG_ERROR("ERROR: tx_timer_activate (0x%08x)\r\n", status);
     }
 
     return status;
 }
 
-UINT azure_iot_nx_client_publish_telemetry(AZURE_IOT_NX_CONTEXT* context_ptr,
-    CHAR* component_name_ptr,
-    UINT (*append_properties)(NX_AZURE_IOT_JSON_WRITER* json_builder_ptr))
+static UINT publish_telemetry_buffer(
+    AZURE_IOT_NX_CONTEXT* context_ptr, CHAR* component_name_ptr, const UCHAR* telemetry, UINT telemetry_length)
 {
     UINT status;
-    UINT telemetry_length;
     NX_PACKET* packet_ptr;
-    NX_AZURE_IOT_JSON_WRITER json_writer;
 
     if ((status = nx_azure_iot_hub_client_telemetry_message_create(
              &context_ptr->iothub_client, &packet_ptr, NX_WAIT_FOREVER)))
     {
-        printf("Error: nx_azure_iot_hub_client_telemetry_message_create failed (0x%08x)\r\n", status);
+        LOG_ERROR("Error: nx_azure_iot_hub_client_telemetry_message_create failed (0x%08x)\r\n", status);
+        return status;
     }
 
     if (component_name_ptr != NX_NULL)
     {
-        printf("appending component name: %s\r\n", component_name_ptr);
+        LOG_DEBUG("appending component name: %s\r\n", component_name_ptr);
         if ((status = nx_azure_iot_hub_client_telemetry_component_set(
                  packet_ptr, (UCHAR*)component_name_ptr, strlen(component_name_ptr), NX_WAIT_FOREVER)))
         {
-            printf("Error: nx_azure_iot_hub_client_telemetry_component_set failed (0x%08x)\r\n", status);
+            LOG_ERROR("Error: nx_azure_iot_hub_client_telemetry_component_set failed (0x%08x)\r\n", status);
             nx_azure_iot_hub_client_telemetry_message_delete(packet_ptr);
             return status;
         }
     }
 
-    if ((status = nx_azure_iot_json_writer_with_buffer_init(&json_writer, telemetry_buffer, sizeof(telemetry_buffer))))
-    {
-        printf("Error: Failed to initialize json writer (0x%08x)\r\n", status);
-        nx_azure_iot_hub_client_telemetry_message_delete(packet_ptr);
-        return status;
-    }
-
-    if ((status = nx_azure_iot_json_writer_append_begin_object(&json_writer)) ||
-        (status = append_properties(&json_writer)) ||
-        (status = nx_azure_iot_json_writer_append_end_object(&json_writer)))
-    {
-        printf("Error: Failed to build telemetry (0x%08x)\r\n", status);
-        nx_azure_iot_hub_client_telemetry_message_delete(packet_ptr);
-        return status;
-    }
-
     // set the ContentType property on the message to "application/json" (url-encoded)
     if ((status = nx_azure_iot_hub_client_telemetry_property_add(packet_ptr,
              content_type_property,
@@ -693,7 +825,7 @@ UINT azure_iot_nx_client_publish_telemetry(AZURE_IOT_NX_CONTEXT* context_ptr,
              sizeof(content_type_json) - 1,
              NX_WAIT_FOREVER)))
     {
-        printf("Error: Cant set ContentType message property (0x%08X)\r\n", status);
+        LOG_ERROR("Error: Cant set ContentType message property (0x%08X)\r\n", status);
         nx_azure_iot_hub_client_telemetry_message_delete(packet_ptr);
         return status;
     }
@@ -706,21 +838,231 @@ UINT azure_iot_nx_client_publish_telemetry(AZURE_IOT_NX_CONTEXT* context_ptr,
              sizeof(content_encoding_utf8) - 1,
              NX_WAIT_FOREVER)))
     {
-        printf("Error: Cant set ContentEncoding message property (0x%08X)\r\n", status);
+        LOG_ERROR("Error: Cant set ContentEncoding message property (0x%08X)\r\n", status);
         nx_azure_iot_hub_client_telemetry_message_delete(packet_ptr);
         return status;
     }
 
-    telemetry_length = nx_azure_iot_json_writer_get_bytes_used(&json_writer);
     if ((status = nx_azure_iot_hub_client_telemetry_send(
-             &context_ptr->iothub_client, packet_ptr, telemetry_buffer, telemetry_length, NX_WAIT_FOREVER)))
+             &context_ptr->iothub_client, packet_ptr, (UCHAR*)telemetry, telemetry_length, NX_WAIT_FOREVER)))
     {
-        printf("Error: Telemetry message send failed (0x%08x)\r\n", status);
+        LOG_ERROR("Error: Telemetry message send failed (0x%08x)\r\n", status);
         nx_azure_iot_hub_client_telemetry_message_delete(packet_ptr);
         return status;
     }
 
-    printf("Telemetry message sent: %.*s.\r\n", telemetry_length, telemetry_buffer);
+    LOG_DEBUG("Telemetry message sent: %.*s.\r\n", telemetry_length, telemetry);
+
+    return status;
+}
+
+UINT azure_iot_nx_client_publish_telemetry(AZURE_IOT_NX_CONTEXT* context_ptr,
+    CHAR* component_name_ptr,
+    UINT (*append_properties)(NX_AZURE_IOT_JSON_WRITER* json_builder_ptr))
+{
+    UINT status;
+    NX_AZURE_IOT_JSON_WRITER json_writer;
+
+    if ((status = nx_azure_iot_json_writer_with_buffer_init(&json_writer, telemetry_buffer, sizeof(telemetry_buffer))))
+    {
+        LOG_ERROR("Error: Failed to initialize json writer (0x%08x)\r\n", status);
+        return status;
+    }
+
+    if ((status = nx_azure_iot_json_writer_append_begin_object(&json_writer)) ||
+        (status = append_properties(&json_writer)) ||
+        (status = nx_azure_iot_json_writer_append_end_object(&json_writer)))
+    {
+        LOG_ERROR("Error: Failed to build telemetry (0x%08x)\r\n", status);
+        return status;
+    }
+
+    return publish_telemetry_buffer(
+        context_ptr, component_name_ptr, telemetry_buffer, nx_azure_iot_json_writer_get_bytes_used(&json_writer));
+}
+
+UINT azure_iot_nx_client_publish_telemetry_raw(
+    AZURE_IOT_NX_CONTEXT* context_ptr, CHAR* component_name_ptr, const UCHAR* json, UINT json_length)
+{
+    return publish_telemetry_buffer(context_ptr, component_name_ptr, json, json_length);
+}
+
+static UINT publish_telemetry_streams(
+    AZURE_IOT_NX_CONTEXT* nx_context, AZURE_IOT_TELEMETRY_STREAM** streams, UINT stream_count)
+{
+    UINT status;
+    NX_AZURE_IOT_JSON_WRITER json_writer;
+
+    if ((status = nx_azure_iot_json_writer_with_buffer_init(&json_writer, telemetry_buffer, sizeof(telemetry_buffer))))
+    {
+        LOG_ERROR("Error: Failed to initialize json writer (0x%08x)\r\n", status);
+        return status;
+    }
+
+    if ((status = nx_azure_iot_json_writer_append_begin_object(&json_writer)))
+    {
+        LOG_ERROR("Error: Failed to build telemetry (0x%08x)\r\n", status);
+        return status;
+    }
+
+    for (UINT i = 0; i < stream_count; i++)
+    {
+        if ((status = streams[i]->append(&json_writer)))
+        {
+            LOG_ERROR("Error: Failed to build telemetry for %s (0x%08x)\r\n", streams[i]->name, status);
+            return status;
+        }
+    }
+
+    if ((status = nx_azure_iot_json_writer_append_end_object(&json_writer)))
+    {
+        LOG_ERROR("Error: Failed to build telemetry (0x%08x)\r\n", status);
+        return status;
+    }
+
+    return publish_telemetry_buffer(
+        nx_context, NULL, telemetry_buffer, nx_azure_iot_json_writer_get_bytes_used(&json_writer));
+}
+
+// Publishes the streams that are due in one message, and schedules their next one. A stream
+// that fell more than an interval behind skips the messages it missed.
+static VOID process_telemetry_streams(AZURE_IOT_NX_CONTEXT* nx_context)
+{
+    AZURE_IOT_TELEMETRY_STREAM* due[AZURE_IOT_TELEMETRY_STREAMS_MAX];
+    UINT due_count = 0;
+    ULONG now      = tx_time_get();
+
+    if (!nx_context->telemetry_streams_running)
+    {
+        return;
+    }
+
+    for (UINT i = 0; i < nx_context->telemetry_stream_count; i++)
+    {
+        AZURE_IOT_TELEMETRY_STREAM* stream = &nx_context->telemetry_streams[i];
+
+        if (stream->interval > 0 && (LONG)(stream->next_tick - now) <= (LONG)TELEMETRY_COALESCE_TICKS)
+        {
+            due[due_count++] = stream;
+        }
+    }
+
+    if (due_count == 0)
+    {
+        return;
+    }
+
+    publish_telemetry_streams(nx_context, due, due_count);
+
+    now = tx_time_get();
+    for (UINT i = 0; i < due_count; i++)
+    {
+        due[i]->next_tick += due[i]->interval * TX_TIMER_TICKS_PER_SECOND;
+
+        if ((LONG)(due[i]->next_tick - now) <= 0)
+        {
+            telemetry_stream_schedule(nx_context, due[i], now);
+        }
+    }
+}
+
+// Ticks until the next telemetry stream is due, at most max_ticks
+static ULONG telemetry_streams_wait(AZURE_IOT_NX_CONTEXT* nx_context, ULONG max_ticks)
+{
+    ULONG wait = max_ticks;
+    ULONG now  = tx_time_get();
+
+    if (!nx_context->telemetry_streams_running)
+    {
+        return wait;
+    }
+
+    for (UINT i = 0; i < nx_context->telemetry_stream_count; i++)
+    {
+        AZURE_IOT_TELEMETRY_STREAM* stream = &nx_context->telemetry_streams[i];
+        LONG left                          = (LONG)(stream->next_tick - now);
+
+        if (stream->interval == 0)
+        {
+            continue;
+        }
+
+        if (left <= 0)
+        {
+            return TX_NO_WAIT;
+        }
+
+        if ((ULONG)left < wait)
+        {
+            wait = left;
+        }
+    }
+
+    return wait;
+}
+
+UINT azure_iot_nx_client_add_telemetry_stream(
+    AZURE_IOT_NX_CONTEXT* nx_context, CHAR* name, func_ptr_append_telemetry append, UINT interval, UINT phase)
+{
+    AZURE_IOT_TELEMETRY_STREAM* stream;
+
+    if (nx_context == NULL || name == NULL || append == NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    if (interval > AZURE_IOT_TELEMETRY_SCHEDULE_MAX || phase > AZURE_IOT_TELEMETRY_SCHEDULE_MAX)
+    {
+        return NX_INVALID_PARAMETERS;
+    }
+
+    if (nx_context->telemetry_stream_count >= AZURE_IOT_TELEMETRY_STREAMS_MAX)
+    {
+        LOG_ERROR("ERROR: telemetry streams exceeded\r\n");
+        return NX_NOT_SUCCESSFUL;
+    }
+
+    stream           = &nx_context->telemetry_streams[nx_context->telemetry_stream_count++];
+    stream->name     = name;
+    stream->append   = append;
+    stream->interval = interval;
+    stream->phase    = phase;
+
+    if (nx_context->telemetry_streams_running)
+    {
+        telemetry_stream_schedule(nx_context, stream, tx_time_get());
+    }
+
+    return NX_SUCCESS;
+}
+
+UINT azure_iot_nx_client_telemetry_interval_set(AZURE_IOT_NX_CONTEXT* nx_context, CHAR* name, UINT interval)
+{
+    UINT status = NX_NOT_FOUND;
+
+    if (interval > AZURE_IOT_TELEMETRY_SCHEDULE_MAX)
+    {
+        LOG_ERROR("ERROR: telemetry interval %u out of range\r\n", interval);
+        return NX_INVALID_PARAMETERS;
+    }
+
+    for (UINT i = 0; i < nx_context->telemetry_stream_count; i++)
+    {
+        AZURE_IOT_TELEMETRY_STREAM* stream = &nx_context->telemetry_streams[i];
+
+        if (name != NULL && strcmp(name, stream->name) != 0)
+        {
+            continue;
+        }
+
+        stream->interval = interval;
+        if (nx_context->telemetry_streams_running)
+        {
+            telemetry_stream_schedule(nx_context, stream, tx_time_get());
+        }
+
+        status = NX_SUCCESS;
+    }
 
     return status;
 }
@@ -735,24 +1077,24 @@ static UINT reported_properties_begin(AZURE_IOT_NX_CONTEXT* context_ptr,
     if ((status = nx_azure_iot_hub_client_reported_properties_create(
              &context_ptr->iothub_client, packet_ptr, NX_WAIT_FOREVER)))
     {
-        printf("Error: Failed create reported properties (0x%08x)\r\n", status);
+        LOG_ERROR("Error: Failed create reported properties (0x%08x)\r\n", status);
     }
 
     else if ((status = nx_azure_iot_json_writer_init(json_writer, *packet_ptr, NX_WAIT_FOREVER)))
     {
-        printf("Error: Failed to initialize json writer (0x%08x)\r\n", status);
+        LOG_ERROR("Error: Failed to initialize json writer (0x%08x)\r\n", status);
     }
 
     else if ((status = nx_azure_iot_json_writer_append_begin_object(json_writer)))
     {
-        printf("Error: Failed to append object begin (0x%08x)\r\n", status);
+        LOG_ERROR("Error: Failed to append object begin (0x%08x)\r\n", status);
     }
 
     else if (component_name_ptr != NX_NULL &&
              (status = nx_azure_iot_hub_client_reported_properties_component_begin(
                   &context_ptr->iothub_client, json_writer, (UCHAR*)component_name_ptr, strlen(component_name_ptr))))
     {
-        printf("Error: Failed to append component begin (0x%08x)\r\n", status);
+        LOG_ERROR("Error: Failed to append component begin (0x%08x)\r\n", status);
     }
 
     return status;
@@ -769,28 +1111,28 @@ static UINT reported_properties_end(AZURE_IOT_NX_CONTEXT* nx_context,
     if ((component_name_ptr != NX_NULL && (status = nx_azure_iot_hub_client_reported_properties_component_end(
                                                &nx_context->iothub_client, json_writer))))
     {
-        printf("Error: Failed to append component end (0x%08x)\r\n", status);
+        LOG_ERROR("Error: Failed to append component end (0x%08x)\r\n", status);
         return status;
     }
 
     if ((status = nx_azure_iot_json_writer_append_end_object(json_writer)))
     {
-        printf("Error: Failed to append object end (0x%08x)\r\n", status);
+        LOG_ERROR("Error: Failed to append object end (0x%08x)\r\n", status);
         return status;
     }
 
-    printf_packet("Sending property: ", *packet_ptr);
+    LOG_PACKET("Sending property: ", *packet_ptr);
 
     if ((status = nx_azure_iot_hub_client_reported_properties_send(
              &nx_context->iothub_client, *packet_ptr, NX_NULL, &response_status, NX_NULL, 5 * NX_IP_PERIODIC_RATE)))
     {
-        printf("Error: nx_azure_iot_hub_client_reported_properties_send failed (0x%08x)\r\n", status);
+        LOG_ERROR("Error: nx_azure_iot_hub_client_reported_properties_send failed (0x%08x)\r\n", status);
         return status;
     }
 
     else if ((response_status < 200) || (response_status >= 300))
     {
-        printf("Error: Property sent response status failed (%d)\r\n", response_status);
+        LOG_ERROR("Error: Property sent response status failed (%d)\r\n", response_status);
         return NX_NOT_SUCCESSFUL;
     }
 
@@ -811,7 +1153,7 @@ UINT azure_iot_nx_client_publish_properties(AZURE_IOT_NX_CONTEXT* nx_context,
 
         (status = reported_properties_end(nx_context, &json_writer, &packet_ptr, component_name_ptr)))
     {
-        printf("ERROR: azure_iot_nx_client_publish_properties (0x%08x)", status);
+        LOG_ERROR("ERROR: azure_iot_nx_client_publish_properties (0x%08x)", status);
         nx_packet_release(packet_ptr);
     }
 
@@ -832,7 +1174,7 @@ UINT azure_iot_nx_client_publish_bool_property(
 
         (status = reported_properties_end(nx_context, &json_writer, &packet_ptr, component_name_ptr)))
     {
-        printf("ERROR: azure_iot_nx_client_publish_bool_property (0x%08x)", status);
+        LOG_ERROR("ERROR: azure_iot_nx_client_publish_bool_property (0x%08x)", status);
         nx_packet_release(packet_ptr);
     }
 
@@ -867,7 +1209,7 @@ UINT azure_nx_client_respond_int_writable_property(AZURE_IOT_NX_CONTEXT* nx_cont
 
         (status = reported_properties_end(nx_context, &json_writer, &packet_ptr, component_name_ptr)))
     {
-        printf("ERROR: azure_nx_client_respond_int_writable_property (0x%08x)", status);
+        LOG_ERROR("ERROR: azure_nx_client_respond_int_writable_property (0x%08x)", status);
         nx_packet_release(packet_ptr);
     }
 
@@ -881,6 +1223,68 @@ UINT azure_iot_nx_client_publish_int_writable_property(
     return azure_nx_client_respond_int_writable_property(nx_context, component_ptr, property_ptr, value, 200, 1);
 }
 
+static UINT append_telemetry_stream_property(
+    AZURE_IOT_NX_CONTEXT* nx_context, NX_AZURE_IOT_JSON_WRITER* json_writer, CHAR* name, CHAR* suffix, UINT value)
+{
+    UINT status;
+    CHAR property[TELEMETRY_PROPERTY_SIZE];
+    INT length = snprintf(property, sizeof(property), "%s%s", name, suffix);
+
+    if (length <= 0 || length >= sizeof(property))
+    {
+        return NX_SIZE_ERROR;
+    }
+
+    if ((status = nx_azure_iot_hub_client_reported_properties_status_begin(
+             &nx_context->iothub_client, json_writer, (const UCHAR*)property, length, 200, 1, NULL, 0)) ||
+
+        (status = nx_azure_iot_json_writer_append_int32(json_writer, value)) ||
+
+        (status = nx_azure_iot_hub_client_reported_properties_status_end(&nx_context->iothub_client, json_writer)))
+    {
+        return status;
+    }
+
+    return NX_SUCCESS;
+}
+
+UINT azure_iot_nx_client_publish_telemetry_stream_properties(AZURE_IOT_NX_CONTEXT* nx_context)
+{
+    UINT status;
+    NX_AZURE_IOT_JSON_WRITER json_writer;
+    NX_PACKET* packet_ptr;
+
+    if ((status = reported_properties_begin(nx_context, &json_writer, &packet_ptr, NULL)))
+    {
+        LOG_ERROR("ERROR: azure_iot_nx_client_publish_telemetry_stream_properties (0x%08x)", status);
+        nx_packet_release(packet_ptr);
+        return status;
+    }
+
+    for (UINT i = 0; i < nx_context->telemetry_stream_count; i++)
+    {
+        AZURE_IOT_TELEMETRY_STREAM* stream = &nx_context->telemetry_streams[i];
+
+        if ((status = append_telemetry_stream_property(
+                 nx_context, &json_writer, stream->name, TELEMETRY_INTERVAL_SUFFIX, stream->interval)) ||
+            (status = append_telemetry_stream_property(
+                 nx_context, &json_writer, stream->name, TELEMETRY_PHASE_SUFFIX, stream->phase)))
+        {
+            LOG_ERROR("ERROR: azure_iot_nx_client_publish_telemetry_stream_properties (0x%08x)", status);
+            nx_packet_release(packet_ptr);
+            return status;
+        }
+    }
+
+    if ((status = reported_properties_end(nx_context, &json_writer, &packet_ptr, NULL)))
+    {
+        LOG_ERROR("ERROR: azure_iot_nx_client_publish_telemetry_stream_properties (0x%08x)", status);
+        nx_packet_release(packet_ptr);
+    }
+
+    return status;
+}
+
 UINT azure_iot_nx_client_register_command_callback(AZURE_IOT_NX_CONTEXT* nx_context, func_ptr_command_received callback)
 {
     if (nx_context == NULL || nx_context->command_received_cb != NULL)
@@ -943,6 +1347,34 @@ UINT azure_iot_nx_client_register_timer_callback(
     return NX_SUCCESS;
 }
 
+UINT azure_iot_nx_client_register_app_event_callback(AZURE_IOT_NX_CONTEXT* nx_context, func_ptr_app_event callback)
+{
+    if (nx_context == NULL || nx_context->app_event_cb != NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    nx_context->app_event_cb = callback;
+    return NX_SUCCESS;
+}
+
+UINT azure_iot_nx_client_register_disconnected_callback(
+    AZURE_IOT_NX_CONTEXT* nx_context, func_ptr_disconnected callback)
+{
+    if (nx_context == NULL || nx_context->disconnected_cb != NULL)
+    {
+        return NX_PTR_ERROR;
+    }
+
+    nx_context->disconnected_cb = callback;
+    return NX_SUCCESS;
+}
+
+UINT azure_iot_nx_client_app_event_set(AZURE_IOT_NX_CONTEXT* nx_context)
+{
+    return tx_event_flags_set(&nx_context->events, HUB_APP_EVENT, TX_OR);
+}
+
 UINT azure_iot_nx_client_add_component(AZURE_IOT_NX_CONTEXT* nx_context, CHAR* component_name)
 {
     if (nx_context == NULL || component_name == NULL)
@@ -964,7 +1396,7 @@ UINT azure_iot_nx_client_sas_set(AZURE_IOT_NX_CONTEXT* context, CHAR* device_sas
 {
     if (device_sas_key[0] == 0)
     {
-        printf("Error: azure_iot_nx_client_sas_set device_sas_key is null\r\n");
+        LOG_ERROR("Error: azure_iot_nx_client_sas_set device_sas_key is null\r\n");
         return NX_PTR_ERROR;
     }
 
@@ -985,7 +1417,7 @@ UINT azure_iot_nx_client_cert_set(AZURE_IOT_NX_CONTEXT* nx_context,
 
     if (device_x509_cert_len == 0 || device_x509_key_len == 0)
     {
-        printf("ERROR: azure_iot_nx_client_cert_set cert/key is null\r\n");
+        LOG_ERROR("ERROR: azure_iot_nx_client_cert_set cert/key is null\r\n");
         return NX_PTR_ERROR;
     }
 
@@ -1001,7 +1433,7 @@ UINT azure_iot_nx_client_cert_set(AZURE_IOT_NX_CONTEXT* nx_context,
              (USHORT)device_x509_key_len,
              NX_SECURE_X509_KEY_TYPE_RSA_PKCS1_DER)))
     {
-        printf("ERROR: nx_secure_x509_certificate_initialize (0x%08x)\r\n", status);
+        LOG_ERROR("ERROR: nx_secure_x509_certificate_initialize (0x%08x)\r\n", status);
     }
 
     return NX_SUCCESS;
@@ -1019,7 +1451,7 @@ UINT azure_iot_nx_client_create(AZURE_IOT_NX_CONTEXT* nx_context,
 
     if (iot_model_id_len == 0)
     {
-        printf("ERROR: azure_iot_nx_client_create_new empty model_id\r\n");
+        LOG_ERROR("ERROR: azure_iot_nx_client_create_new empty model_id\r\n");
         return NX_PTR_ERROR;
     }
 
@@ -1042,7 +1474,7 @@ UINT azure_iot_nx_client_create(AZURE_IOT_NX_CONTEXT* nx_context,
              0,
              NX_SECURE_X509_KEY_TYPE_NONE)))
     {
-        printf("ERROR: nx_secure_x509_certificate_initialize (0x%08x)\r\n", status);
+        LOG_ERROR("ERROR: nx_secure_x509_certificate_initialize (0x%08x)\r\n", status);
     }
 
     else if ((status = nx_secure_x509_certificate_initialize(&nx_context->root_ca_cert_2,
@@ -1054,7 +1486,7 @@ UINT azure_iot_nx_client_create(AZURE_IOT_NX_CONTEXT* nx_context,
                   0,
                   NX_SECURE_X509_KEY_TYPE_NONE)))
     {
-        printf("ERROR: nx_secure_x509_certificate_initialize (0x%08x)\r\n", status);
+        LOG_ERROR("ERROR: nx_secure_x509_certificate_initialize (0x%08x)\r\n", status);
     }
 
     else if ((status = nx_secure_x509_certificate_initialize(&nx_context->root_ca_cert_3,
@@ -1066,12 +1498,12 @@ UINT azure_iot_nx_client_create(AZURE_IOT_NX_CONTEXT* nx_context,
                   0,
                   NX_SECURE_X509_KEY_TYPE_NONE)))
     {
-        printf("ERROR: nx_secure_x509_certificate_initialize (0x%08x)\r\n", status);
+        LOG_ERROR("ERROR: nx_secure_x509_certificate_initialize (0x%08x)\r\n", status);
     }
 
     if ((status = tx_event_flags_create(&nx_context->events, "nx_client")))
     {
-        printf("ERROR: tx_event_flags_creates (0x%08x)\r\n", status);
+        LOG_ERROR("ERROR: tx_event_flags_creates (0x%08x)\r\n", status);
     }
 
     else if ((status = tx_timer_create(&nx_context->periodic_timer,
@@ -1082,7 +1514,7 @@ UINT azure_iot_nx_client_create(AZURE_IOT_NX_CONTEXT* nx_context,
                   60 * NX_IP_PERIODIC_RATE,
                   TX_NO_ACTIVATE)))
     {
-        printf("ERROR: tx_timer_create (0x%08x)\r\n", status);
+        LOG_ERROR("ERROR: tx_timer_create (0x%08x)\r\n", status);
         tx_event_flags_delete(&nx_context->events);
     }
 
@@ -1097,7 +1529,7 @@ UINT azure_iot_nx_client_create(AZURE_IOT_NX_CONTEXT* nx_context,
                   NX_AZURE_IOT_THREAD_PRIORITY,
                   unix_time_callback)))
     {
-        printf("ERROR: failed on nx_azure_iot_create (0x%08x)\r\n", status);
+        LOG_ERROR("ERROR: failed on nx_azure_iot_create (0x%08x)\r\n", status);
         tx_event_flags_delete(&nx_context->events);
         tx_timer_delete(&nx_context->periodic_timer);
     }
@@ -1113,7 +1545,11 @@ static UINT client_run(
     while (true)
     {
         app_events = 0;
-        tx_event_flags_get(&nx_context->events, HUB_ALL_EVENTS, TX_OR_CLEAR, &app_events, NX_IP_PERIODIC_RATE);
+        tx_event_flags_get(&nx_context->events,
+            HUB_ALL_EVENTS,
+            TX_OR_CLEAR,
+            &app_events,
+            telemetry_streams_wait(nx_context, NX_IP_PERIODIC_RATE));
 
         if (app_events & HUB_DISCONNECT_EVENT)
         {
@@ -1150,6 +1586,13 @@ static UINT client_run(
             process_writable_properties(nx_context);
         }
 
+        if (app_events & HUB_APP_EVENT)
+        {
+            process_app_event(nx_context);
+        }
+
+        process_telemetry_streams(nx_context);
+
         // Monitor and reconnect where possible
         connection_monitor(nx_context, iot_initialize, network_connect);
     }
@@ -1162,13 +1605,13 @@ UINT azure_iot_nx_client_hub_run(
 {
     if (iot_hub_hostname == 0 || iot_hub_device_id == 0)
     {
-        printf("ERROR: azure_iot_nx_client_hub_run hub config is null\r\n");
+        LOG_ERROR("ERROR: azure_iot_nx_client_hub_run hub config is null\r\n");
         return NX_PTR_ERROR;
     }
 
     if (strlen(iot_hub_hostname) > AZURE_IOT_HOST_NAME_SIZE || strlen(iot_hub_device_id) > AZURE_IOT_DEVICE_ID_SIZE)
     {
-        printf("ERROR: azure_iot_nx_client_hub_run hub config exceeds buffer size\r\n");
+        LOG_ERROR("ERROR: azure_iot_nx_client_hub_run hub config exceeds buffer size\r\n");
         return NX_SIZE_ERROR;
     }
 
@@ -1186,7 +1629,7 @@ UINT azure_iot_nx_client_dps_run(
 {
     if (dps_id_scope == 0 || dps_registration_id == 0)
     {
-        printf("ERROR: azure_iot_nx_client_dps_run dps config is null\r\n");
+        LOG_ERROR("ERROR: azure_iot_nx_client_dps_run dps config is null\r\n");
         return NX_PTR_ERROR;
     }
 
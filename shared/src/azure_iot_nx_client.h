@@ -22,6 +22,11 @@
 #define AZURE_IOT_AUTH_MODE_SAS     1
 #define AZURE_IOT_AUTH_MODE_CERT    2
 
+#define AZURE_IOT_TELEMETRY_STREAMS_MAX 8
+// Longest telemetry stream interval and phase, in seconds, so that they stay well within a ULONG
+// in ticks
+#define AZURE_IOT_TELEMETRY_SCHEDULE_MAX (24 * 60 * 60)
+
 typedef struct AZURE_IOT_NX_CONTEXT_STRUCT AZURE_IOT_NX_CONTEXT;
 
 typedef void (*func_ptr_command_received)(
@@ -32,9 +37,22 @@ typedef void (*func_ptr_property_received)(
     AZURE_IOT_NX_CONTEXT*, const UCHAR*, UINT, UCHAR*, UINT, NX_AZURE_IOT_JSON_READER*, UINT);
 typedef void (*func_ptr_properties_complete)(AZURE_IOT_NX_CONTEXT*);
 typedef void (*func_ptr_timer)(AZURE_IOT_NX_CONTEXT*);
+typedef void (*func_ptr_app_event)(AZURE_IOT_NX_CONTEXT*);
+typedef void (*func_ptr_disconnected)(AZURE_IOT_NX_CONTEXT*);
+typedef UINT (*func_ptr_append_telemetry)(NX_AZURE_IOT_JSON_WRITER*);
 
 typedef ULONG (*func_ptr_unix_time_get)(VOID);
 
+// A group of telemetry values with its own schedule, see azure_iot_nx_client_add_telemetry_stream
+typedef struct AZURE_IOT_TELEMETRY_STREAM_STRUCT
+{
+    CHAR* name;
+    func_ptr_append_telemetry append;
+    UINT interval; // seconds, 0 pauses the stream
+    UINT phase;    // seconds
+    ULONG next_tick;
+} AZURE_IOT_TELEMETRY_STREAM;
+
 struct AZURE_IOT_NX_CONTEXT_STRUCT
 {
     NX_SECURE_X509_CERT root_ca_cert;
@@ -96,6 +114,14 @@ struct AZURE_IOT_NX_CONTEXT_STRUCT
     func_ptr_property_received property_received_cb;
     func_ptr_properties_complete properties_complete_cb;
     func_ptr_timer timer_cb;
+    func_ptr_app_event app_event_cb;
+    func_ptr_disconnected disconnected_cb;
+
+    // telemetry streams, scheduled from the connection time while connected
+    AZURE_IOT_TELEMETRY_STREAM telemetry_streams[AZURE_IOT_TELEMETRY_STREAMS_MAX];
+    UINT telemetry_stream_count;
+    ULONG telemetry_epoch;
+    bool telemetry_streams_running;
 };
 
 UINT azure_nx_client_periodic_interval_set(AZURE_IOT_NX_CONTEXT* nx_context, INT interval);
@@ -103,6 +129,21 @@ UINT azure_nx_client_periodic_interval_set(AZURE_IOT_NX_CONTEXT* nx_context, INT
 UINT azure_iot_nx_client_publish_telemetry(AZURE_IOT_NX_CONTEXT* nx_context,
     CHAR* component_name_ptr,
     UINT (*append_properties)(NX_AZURE_IOT_JSON_WRITER* json_writer_ptr));
+UINT azure_iot_nx_client_publish_telemetry_raw(
+    AZURE_IOT_NX_CONTEXT* nx_context, CHAR* component_name_ptr, const UCHAR* json, UINT json_length);
+
+// Telemetry streams are published by the client thread on their own schedules: every interval
+// seconds, phase seconds past a multiple of the interval counted from the connection. Streams
+// that come due together are sent as one message. The schedules can also be changed with the
+// "<name>Interval" and "<name>Phase" writable properties, which the client handles itself.
+// Call these from the client callbacks, or before running the client. Intervals and phases above
+// AZURE_IOT_TELEMETRY_SCHEDULE_MAX are rejected with NX_INVALID_PARAMETERS.
+UINT azure_iot_nx_client_add_telemetry_stream(
+    AZURE_IOT_NX_CONTEXT* nx_context, CHAR* name, func_ptr_append_telemetry append, UINT interval, UINT phase);
+// A NULL name changes all the streams
+UINT azure_iot_nx_client_telemetry_interval_set(AZURE_IOT_NX_CONTEXT* nx_context, CHAR* name, UINT interval);
+// Reports the schedule of each stream, in one message
+UINT azure_iot_nx_client_publish_telemetry_stream_properties(AZURE_IOT_NX_CONTEXT* nx_context);
 
 UINT azure_iot_nx_client_publish_properties(AZURE_IOT_NX_CONTEXT* nx_context,
     CHAR* component_name_ptr,
@@ -129,6 +170,13 @@ UINT azure_iot_nx_client_register_properties_complete_callback(
     AZURE_IOT_NX_CONTEXT* nx_context, func_ptr_properties_complete callback);
 UINT azure_iot_nx_client_register_timer_callback(
     AZURE_IOT_NX_CONTEXT* nx_context, func_ptr_timer callback, int32_t interval);
+UINT azure_iot_nx_client_register_app_event_callback(AZURE_IOT_NX_CONTEXT* nx_context, func_ptr_app_event callback);
+// Called from the client thread when the hub connection is lost
+UINT azure_iot_nx_client_register_disconnected_callback(
+    AZURE_IOT_NX_CONTEXT* nx_context, func_ptr_disconnected callback);
+
+// Wake up the client thread to run the app event callback, can be called from any thread
+UINT azure_iot_nx_client_app_event_set(AZURE_IOT_NX_CONTEXT* nx_context);
 
 UINT azure_iot_nx_client_add_component(AZURE_IOT_NX_CONTEXT* nx_context, CHAR* component_name);
 
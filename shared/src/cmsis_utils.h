@@ -19,4 +19,45 @@ static __inline void systick_interval_set(uint32_t ticks)
     SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
 }
 
+#ifdef DWT
+// Cycle counter based timestamps and delays. dwt_init() must be called once
+// before use; after that there is no calibration, and delays are accurate to
+// a few cycles regardless of interrupts being enabled or the kernel running.
+
+static __inline void dwt_init(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+static __inline uint32_t dwt_cycles(void)
+{
+    return DWT->CYCCNT;
+}
+
+// wraps around every 2^32 cycles (~53s at 80MHz), compare differences only
+static __inline uint32_t dwt_cycles_to_us(uint32_t cycles)
+{
+    return cycles / (SystemCoreClock / 1000000);
+}
+
+static __inline void dwt_delay_cycles(uint32_t cycles)
+{
+    uint32_t start = DWT->CYCCNT;
+    while (DWT->CYCCNT - start < cycles)
+    {
+    }
+}
+
+static __inline void dwt_delay_us(uint32_t us)
+{
+    dwt_delay_cycles(us * (SystemCoreClock / 1000000));
+}
+
+static __inline void dwt_delay_ns(uint32_t ns)
+{
+    dwt_delay_cycles((ns * (SystemCoreClock / 1000000) + 999) / 1000);
+}
+#endif
+
 #endif
@@ -0,0 +1,235 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "console_buffer.h"
+
+#include <string.h>
+
+#include "tx_thread.h"
+
+#define SYNC_NONE     0
+#define SYNC_CREATING 1
+#define SYNC_READY    2
+
+// how long a blocked writer waits before checking the buffer again
+#define BLOCK_TICKS 10
+
+static UCHAR buffer[CONSOLE_BUFFER_SIZE];
+
+// head is only moved by the writer holding the writing flag, tail by the TX interrupt;
+// one byte is left unused, so that head == tail means empty
+static volatile UINT head;
+static volatile UINT tail;
+// length of the transfer in progress, 0 when the DMA is idle
+static volatile UINT tx_length;
+
+static console_start_tx_fn start_tx_fn;
+static volatile ULONG dropped;
+
+// set while a write is in progress, claimed with interrupts disabled. Threads take write_mutex
+// first, so they wait for each other; interrupts and code running before the kernel can't
+// wait, so their output is dropped when they interrupt another write.
+static volatile UINT writing;
+
+// these can't be created before the kernel is running, so it's done on the first write from a thread
+static TX_MUTEX write_mutex;
+static TX_SEMAPHORE space_semaphore;
+static volatile UINT sync_state;
+
+// In an interrupt, tx_thread_identify() returns the interrupted thread. The Cortex-M ports
+// don't count interrupts in _tx_thread_system_state, their TX_THREAD_GET_SYSTEM_STATE() adds
+// IPSR for that.
+static UINT in_thread(VOID)
+{
+    return TX_THREAD_GET_SYSTEM_STATE() == 0 && tx_thread_identify() != TX_NULL;
+}
+
+static VOID sync_create(VOID)
+{
+    TX_INTERRUPT_SAVE_AREA
+    UINT claim;
+
+    TX_DISABLE
+    claim = sync_state == SYNC_NONE;
+    if (claim)
+    {
+        sync_state = SYNC_CREATING;
+    }
+    TX_RESTORE
+
+    if (claim)
+    {
+        tx_mutex_create(&write_mutex, "console", TX_INHERIT);
+        tx_semaphore_create(&space_semaphore, "console space", 0);
+        sync_state = SYNC_READY;
+    }
+    else
+    {
+        while (sync_state != SYNC_READY)
+        {
+            tx_thread_sleep(1);
+        }
+    }
+}
+
+// has to be called with interrupts disabled, or from the TX interrupt
+static UINT next_chunk(VOID)
+{
+    UINT h = head;
+    UINT t = tail;
+
+    if (h == t)
+    {
+        return 0;
+    }
+
+    // the DMA can't wrap around, the rest is sent on the next completion
+    return h > t ? h - t : CONSOLE_BUFFER_SIZE - t;
+}
+
+static UINT claim_writer(UINT length)
+{
+    TX_INTERRUPT_SAVE_AREA
+    UINT claim;
+
+    TX_DISABLE
+    claim = !writing;
+    if (claim)
+    {
+        writing = 1;
+    }
+    else
+    {
+        dropped += length;
+    }
+    TX_RESTORE
+
+    return claim;
+}
+
+static UINT space_left(VOID)
+{
+    return (tail + CONSOLE_BUFFER_SIZE - head - 1) % CONSOLE_BUFFER_SIZE;
+}
+
+static VOID commit(UINT new_head)
+{
+    TX_INTERRUPT_SAVE_AREA
+    UINT length = 0;
+    UINT start;
+
+    // only the decision is made with interrupts disabled, the transfer is started after
+    TX_DISABLE
+    head = new_head;
+    if (tx_length == 0)
+    {
+        length    = next_chunk();
+        tx_length = length;
+    }
+    start = tail;
+    TX_RESTORE
+
+    if (length)
+    {
+        start_tx_fn(&buffer[start], length);
+    }
+}
+
+VOID console_buffer_init(console_start_tx_fn start_tx)
+{
+    head        = 0;
+    tail        = 0;
+    tx_length   = 0;
+    dropped     = 0;
+    writing     = 0;
+    start_tx_fn = start_tx;
+}
+
+UINT console_buffer_write(const UCHAR* data, UINT length)
+{
+    TX_INTERRUPT_SAVE_AREA
+    UINT thread = in_thread();
+    UINT written = 0;
+
+    if (thread)
+    {
+        if (sync_state != SYNC_READY)
+        {
+            sync_create();
+        }
+        tx_mutex_get(&write_mutex, TX_WAIT_FOREVER);
+    }
+
+    if (!claim_writer(length))
+    {
+        // only when interrupting another write, which can't happen in a thread
+        if (thread)
+        {
+            tx_mutex_put(&write_mutex);
+        }
+        return 0;
+    }
+
+    while (written < length)
+    {
+        UINT h     = head;
+        UINT count = space_left();
+
+        if (count == 0)
+        {
+            if (CONSOLE_OVERFLOW_POLICY == CONSOLE_OVERFLOW_BLOCK && thread)
+            {
+                tx_semaphore_get(&space_semaphore, BLOCK_TICKS);
+                continue;
+            }
+
+            TX_DISABLE
+            dropped += length - written;
+            TX_RESTORE
+            break;
+        }
+
+        if (count > length - written)
+        {
+            count = length - written;
+        }
+        if (count > CONSOLE_BUFFER_SIZE - h)
+        {
+            count = CONSOLE_BUFFER_SIZE - h;
+        }
+
+        memcpy(&buffer[h], data + written, count);
+        written += count;
+        commit((h + count) % CONSOLE_BUFFER_SIZE);
+    }
+
+    writing = 0;
+
+    if (thread)
+    {
+        tx_mutex_put(&write_mutex);
+    }
+
+    return written;
+}
+
+VOID console_buffer_tx_done(VOID)
+{
+    tail = (tail + tx_length) % CONSOLE_BUFFER_SIZE;
+
+    tx_length = next_chunk();
+    if (tx_length)
+    {
+        start_tx_fn(&buffer[tail], tx_length);
+    }
+
+    if (sync_state == SYNC_READY)
+    {
+        tx_semaphore_ceiling_put(&space_semaphore, 1);
+    }
+}
+
+ULONG console_buffer_dropped(VOID)
+{
+    return dropped;
+}
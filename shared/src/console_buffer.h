@@ -0,0 +1,40 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _CONSOLE_BUFFER_H
+#define _CONSOLE_BUFFER_H
+
+#include <tx_api.h>
+
+// Buffered console output. _write() copies into a ring buffer, which the board
+// drains with UART TX DMA, so printf doesn't block on the 115200 baud line.
+
+// What to do when the ring buffer is full
+#define CONSOLE_OVERFLOW_DROP  0 // drop what doesn't fit, and count it
+#define CONSOLE_OVERFLOW_BLOCK 1 // wait for the DMA to make room (only in threads)
+
+#ifndef CONSOLE_BUFFER_SIZE
+#define CONSOLE_BUFFER_SIZE 2048
+#endif
+
+#ifndef CONSOLE_OVERFLOW_POLICY
+#define CONSOLE_OVERFLOW_POLICY CONSOLE_OVERFLOW_BLOCK
+#endif
+
+// Starts a transfer of length bytes; the board calls console_buffer_tx_done() from
+// the completion interrupt.
+typedef void (*console_start_tx_fn)(const UCHAR* data, UINT length);
+
+// Can be called before the kernel is started
+VOID console_buffer_init(console_start_tx_fn start_tx);
+
+// Returns the number of bytes queued
+UINT console_buffer_write(const UCHAR* data, UINT length);
+
+// Called from the TX complete interrupt
+VOID console_buffer_tx_done(VOID);
+
+// Bytes dropped because the buffer was full
+ULONG console_buffer_dropped(VOID);
+
+#endif
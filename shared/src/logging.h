@@ -0,0 +1,62 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _LOGGING_H
+#define _LOGGING_H
+
+#include <stdio.h>
+
+// Compile-time filtered diagnostics. Messages above the module's level are compiled out,
+// format strings included, so release builds only keep what they need.
+//
+// Each source file selects its module before using the macros, e.g.
+//   #define LOG_MODULE_LEVEL LOG_LEVEL_SNTP
+// The global level is LOG_LEVEL, and each module can be overridden, e.g.
+//   -DLOG_LEVEL=LOG_LEVEL_ERROR -DLOG_LEVEL_MQTT=LOG_LEVEL_DEBUG
+
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4 // packet and payload dumps
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+#ifndef LOG_LEVEL_NX_CLIENT
+#define LOG_LEVEL_NX_CLIENT LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_MQTT
+#define LOG_LEVEL_MQTT LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_SNTP
+#define LOG_LEVEL_SNTP LOG_LEVEL
+#endif
+#ifndef LOG_LEVEL_NETWORKING
+#define LOG_LEVEL_NETWORKING LOG_LEVEL
+#endif
+
+#ifndef LOG_MODULE_LEVEL
+#define LOG_MODULE_LEVEL LOG_LEVEL
+#endif
+
+#define LOG_ENABLED(level) ((level) <= LOG_MODULE_LEVEL)
+
+// the condition is a constant, so disabled calls are removed even at -O0,
+// while the arguments are still type checked
+#define LOG_AT(level, ...)                                                                                             \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if (LOG_ENABLED(level))                                                                                        \
+        {                                                                                                              \
+            printf(__VA_ARGS__);                                                                                       \
+        }                                                                                                              \
+    } while (0)
+
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_WARN(...)  LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_INFO(...)  LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+#endif
@@ -0,0 +1,29 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _MEM_SECTIONS_H
+#define _MEM_SECTIONS_H
+
+// Placement of buffers and stacks that need a particular kind of RAM. Each board's linker
+// script maps the sections to one of its regions:
+//
+//   DMA_BUFFER - memory that peripherals' DMA can reach and the data cache doesn't cover
+//                (.dma_bss), aligned to a cache line
+//   FAST_BSS   - zero wait state RAM for hot stacks and data, like DTCM on i.MX RT (.fast_bss)
+//
+// Both are uninitialized: they are not cleared at startup, so only use them for buffers
+// that are set up before use (packet pools, thread stacks).
+// On other toolchains the data stays in .bss.
+
+#if defined(__GNUC__) && defined(__arm__)
+// the "@" comments out the flags GCC appends, so the section is NOBITS
+#define MEM_SECTION(name) __attribute__((section(name ",\"aw\",%nobits@")))
+#define DMA_BUFFER        MEM_SECTION(".dma_bss") __attribute__((aligned(32)))
+#define FAST_BSS          MEM_SECTION(".fast_bss") __attribute__((aligned(8)))
+#else
+#define MEM_SECTION(name)
+#define DMA_BUFFER
+#define FAST_BSS
+#endif
+
+#endif
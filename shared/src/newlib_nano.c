@@ -10,23 +10,54 @@
 
 #include <sys/stat.h>
 
+#include "newlib_nano.h"
+
 extern int errno;
-extern int _end;
+
+// Heap bounds, from the board's linker script. The asm names keep the symbols as they are
+// on toolchains that prefix C names with an underscore.
+extern unsigned char heap_start[] __asm__("__heap_start__");
+extern unsigned char heap_end[] __asm__("__heap_end__");
+
+static unsigned char* heap_brk;
+static unsigned char* heap_max;
 
 void* _sbrk(int incr)
 {
-    static unsigned char* heap = NULL;
-    unsigned char* prev_heap;
+    unsigned char* prev_brk;
+
+    if (heap_brk == NULL)
+    {
+        heap_brk = heap_start;
+        heap_max = heap_start;
+    }
 
-    if (heap == NULL)
+    // the heap is followed by the main stack on most boards, so never go past the end
+    if (incr > heap_end - heap_brk || incr < heap_start - heap_brk)
     {
-        heap = (unsigned char*)&_end;
+        errno = ENOMEM;
+        return (void*)-1;
     }
-    prev_heap = heap;
 
-    heap += incr;
+    prev_brk = heap_brk;
+    heap_brk += incr;
 
-    return prev_heap;
+    if (heap_brk > heap_max)
+    {
+        heap_max = heap_brk;
+    }
+
+    return prev_brk;
+}
+
+size_t heap_size(void)
+{
+    return heap_end - heap_start;
+}
+
+size_t heap_high_water(void)
+{
+    return heap_max ? heap_max - heap_start : 0;
 }
 
 int _close(int file)
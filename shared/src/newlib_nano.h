@@ -0,0 +1,18 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _NEWLIB_NANO_H
+#define _NEWLIB_NANO_H
+
+#include <stddef.h>
+
+// The malloc() heap is between __heap_start__ and __heap_end__, which each board's linker
+// script defines; _sbrk() fails with ENOMEM past the end.
+
+// Size of the heap region
+size_t heap_size(void);
+
+// Most of the heap malloc() has taken so far
+size_t heap_high_water(void);
+
+#endif
@@ -0,0 +1,62 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#include "window_stats.h"
+
+#include <math.h>
+
+void window_stats_reset(WINDOW_STATS* window)
+{
+    window->count       = 0;
+    window->min         = 0;
+    window->max         = 0;
+    window->sum         = 0;
+    window->sum_squares = 0;
+}
+
+void window_stats_add(WINDOW_STATS* window, float value)
+{
+    // NaN would poison the sums for the rest of the window
+    if (isnan(value))
+    {
+        return;
+    }
+
+    if (window->count == 0 || value < window->min)
+    {
+        window->min = value;
+    }
+    if (window->count == 0 || value > window->max)
+    {
+        window->max = value;
+    }
+
+    window->count++;
+    window->sum += value;
+    window->sum_squares += (double)value * value;
+}
+
+bool window_stats_summary(const WINDOW_STATS* window, WINDOW_SUMMARY* summary)
+{
+    if (window->count == 0)
+    {
+        return false;
+    }
+
+    summary->count = window->count;
+    summary->min   = window->min;
+    summary->max   = window->max;
+    summary->mean  = (float)(window->sum / window->count);
+    summary->rms   = (float)sqrt(window->sum_squares / window->count);
+
+    return true;
+}
+
+bool window_stats_take(WINDOW_STATS* window, WINDOW_SUMMARY* summary)
+{
+    bool result = window_stats_summary(window, summary);
+
+    window_stats_reset(window);
+
+    return result;
+}
@@ -0,0 +1,43 @@
+/* Copyright (c) Microsoft Corporation.
+   Licensed under the MIT License. */
+
+#ifndef _WINDOW_STATS_H
+#define _WINDOW_STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Statistics of a window of samples, for sending a summary of what was sampled since the last
+// telemetry message instead of a single reading. Each channel only keeps running sums, so the
+// memory doesn't depend on the number of samples. Plain C, no RTOS or SDK dependencies.
+
+typedef struct
+{
+    uint32_t count;
+    float min;
+    float max;
+    double sum;
+    double sum_squares;
+} WINDOW_STATS;
+
+typedef struct
+{
+    uint32_t count;
+    float min;
+    float max;
+    float mean;
+    float rms;
+} WINDOW_SUMMARY;
+
+// Starts a new, empty window
+void window_stats_reset(WINDOW_STATS* window);
+
+void window_stats_add(WINDOW_STATS* window, float value);
+
+// Returns false, and leaves summary alone, when the window is empty
+bool window_stats_summary(const WINDOW_STATS* window, WINDOW_SUMMARY* summary);
+
+// Summary of the window, then starts a new one
+bool window_stats_take(WINDOW_STATS* window, WINDOW_SUMMARY* summary);
+
+#endif
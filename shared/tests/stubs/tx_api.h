@@ -0,0 +1,56 @@
+#pragma once
+
+// The parts of ThreadX used by the modules under test, so that the host tests build without
+// the submodule. Threads and interrupts are simulated by the test, see tx_stub.c.
+
+#include <stddef.h>
+
+#define VOID  void
+typedef char CHAR;
+typedef unsigned char UCHAR;
+typedef int INT;
+typedef unsigned int UINT;
+typedef long LONG;
+typedef unsigned long ULONG;
+
+#define TX_NULL         NULL
+#define TX_SUCCESS      0x00
+#define TX_WAIT_ERROR   0x04
+#define TX_NO_INSTANCE  0x0D
+#define TX_NOT_OWNED    0x1E
+#define TX_INHERIT      1
+#define TX_NO_WAIT      0
+#define TX_WAIT_FOREVER 0xFFFFFFFFUL
+
+typedef struct {
+    int dummy;
+} TX_THREAD;
+
+typedef struct {
+    int created;
+    int owned;
+} TX_MUTEX;
+
+typedef struct {
+    int created;
+    ULONG count;
+} TX_SEMAPHORE;
+
+// interrupts are disabled by the test harness's own flag, which the tests can check
+extern int stub_irq_disabled;
+#define TX_INTERRUPT_SAVE_AREA int interrupt_save;
+#define TX_DISABLE                                                                                 \
+    interrupt_save = stub_irq_disabled;                                                            \
+    stub_irq_disabled = 1;
+#define TX_RESTORE stub_irq_disabled = interrupt_save;
+
+TX_THREAD *tx_thread_identify(VOID);
+UINT tx_thread_sleep(ULONG timer_ticks);
+
+UINT tx_mutex_create(TX_MUTEX *mutex_ptr, CHAR *name_ptr, UINT inherit);
+UINT tx_mutex_get(TX_MUTEX *mutex_ptr, ULONG wait_option);
+UINT tx_mutex_put(TX_MUTEX *mutex_ptr);
+
+UINT tx_semaphore_create(TX_SEMAPHORE *semaphore_ptr, CHAR *name_ptr, ULONG initial_count);
+UINT tx_semaphore_get(TX_SEMAPHORE *semaphore_ptr, ULONG wait_option);
+UINT tx_semaphore_ceiling_put(TX_SEMAPHORE *semaphore_ptr, ULONG ceiling);
@@ -0,0 +1,104 @@
+#include "tx_thread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "tx_stub.h"
+
+// Before tx_kernel_enter(), there is no thread yet, and the system state is non-zero
+volatile ULONG _tx_thread_system_state = 1;
+ULONG stub_ipsr;
+int stub_irq_disabled;
+
+int stub_isr_blocking_calls;
+int stub_semaphore_waits;
+void (*stub_on_semaphore_wait)(void);
+
+static TX_THREAD current_thread;
+static TX_THREAD *thread;
+
+void stub_kernel_start(void) {
+    _tx_thread_system_state = 0;
+    thread = &current_thread;
+}
+
+void stub_isr_enter(void) {
+    // the interrupted thread is still the current one
+    stub_ipsr = 16;
+}
+
+void stub_isr_exit(void) {
+    stub_ipsr = 0;
+}
+
+// a real interrupt would get TX_WAIT_ERROR and spin, or corrupt the mutex
+static int check_not_isr(const char *what) {
+    if (stub_ipsr) {
+        printf("%s called from an interrupt\n", what);
+        stub_isr_blocking_calls++;
+        if (stub_isr_blocking_calls > 100)
+            abort();
+        return 0;
+    }
+    return 1;
+}
+
+TX_THREAD *tx_thread_identify(VOID) {
+    return thread;
+}
+
+UINT tx_thread_sleep(ULONG timer_ticks) {
+    return check_not_isr("tx_thread_sleep()") ? TX_SUCCESS : TX_WAIT_ERROR;
+}
+
+UINT tx_mutex_create(TX_MUTEX *mutex_ptr, CHAR *name_ptr, UINT inherit) {
+    check_not_isr("tx_mutex_create()");
+    mutex_ptr->created = 1;
+    mutex_ptr->owned = 0;
+    return TX_SUCCESS;
+}
+
+UINT tx_mutex_get(TX_MUTEX *mutex_ptr, ULONG wait_option) {
+    if (!check_not_isr("tx_mutex_get()"))
+        return TX_WAIT_ERROR;
+    // one thread: the mutex is always free
+    if (!mutex_ptr->created || mutex_ptr->owned)
+        abort();
+    mutex_ptr->owned = 1;
+    return TX_SUCCESS;
+}
+
+UINT tx_mutex_put(TX_MUTEX *mutex_ptr) {
+    if (!check_not_isr("tx_mutex_put()"))
+        return TX_NOT_OWNED;
+    mutex_ptr->owned = 0;
+    return TX_SUCCESS;
+}
+
+UINT tx_semaphore_create(TX_SEMAPHORE *semaphore_ptr, CHAR *name_ptr, ULONG initial_count) {
+    check_not_isr("tx_semaphore_create()");
+    semaphore_ptr->created = 1;
+    semaphore_ptr->count = initial_count;
+    return TX_SUCCESS;
+}
+
+UINT tx_semaphore_get(TX_SEMAPHORE *semaphore_ptr, ULONG wait_option) {
+    if (!check_not_isr("tx_semaphore_get()"))
+        return TX_WAIT_ERROR;
+    if (semaphore_ptr->count == 0) {
+        // what would happen while the thread waits
+        stub_semaphore_waits++;
+        if (stub_on_semaphore_wait)
+            stub_on_semaphore_wait();
+        if (semaphore_ptr->count == 0)
+            return TX_NO_INSTANCE;
+    }
+    semaphore_ptr->count--;
+    return TX_SUCCESS;
+}
+
+UINT tx_semaphore_ceiling_put(TX_SEMAPHORE *semaphore_ptr, ULONG ceiling) {
+    if (semaphore_ptr->count < ceiling)
+        semaphore_ptr->count++;
+    return TX_SUCCESS;
+}
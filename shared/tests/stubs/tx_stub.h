@@ -0,0 +1,17 @@
+#pragma once
+
+// Controls for the ThreadX stubs
+
+// from here on, code runs in a thread
+void stub_kernel_start(void);
+// code runs in an interrupt, as far as the port can tell
+void stub_isr_enter(void);
+void stub_isr_exit(void);
+
+// calls that can block or need a thread, made from an interrupt
+extern int stub_isr_blocking_calls;
+// tx_semaphore_get() calls that would have waited
+extern int stub_semaphore_waits;
+// called instead of waiting in tx_semaphore_get()
+extern void (*stub_on_semaphore_wait)(void);
+extern int stub_irq_disabled;
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "tx_api.h"
+
+// As in the Cortex-M ports' tx_port.h: interrupts aren't counted in _tx_thread_system_state,
+// IPSR is added instead
+extern volatile ULONG _tx_thread_system_state;
+extern ULONG stub_ipsr;
+#define TX_THREAD_GET_SYSTEM_STATE() (_tx_thread_system_state | stub_ipsr)
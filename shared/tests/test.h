@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdio.h>
+
+// Minimal checks for the host tests; each test is a program that returns non-zero on failure.
+
+static int test_failures;
+
+#define CHECK(cond)                                                                                \
+    do {                                                                                           \
+        if (!(cond)) {                                                                             \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);                        \
+            test_failures++;                                                                       \
+        }                                                                                          \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                                             \
+    do {                                                                                           \
+        long long _a = (a), _b = (b);                                                              \
+        if (_a != _b) {                                                                            \
+            printf("%s:%d: %s == %lld, expected %lld\n", __FILE__, __LINE__, #a, _a, _b);          \
+            test_failures++;                                                                       \
+        }                                                                                          \
+    } while (0)
+
+static inline int test_done(const char *name) {
+    if (test_failures)
+        printf("%s: %d failures\n", name, test_failures);
+    else
+        printf("%s: ok\n", name);
+    return test_failures != 0;
+}
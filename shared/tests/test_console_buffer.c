@@ -0,0 +1,111 @@
+#include "test.h"
+#include "console_buffer.h"
+#include "tx_stub.h"
+
+#include <string.h>
+
+// The console ring buffer written from before the kernel starts, from a thread, and from
+// interrupts: an interrupt can't take the mutex or wait for room, whatever the overflow policy,
+// so its output goes in when there is room and is dropped otherwise.
+//
+// The TX DMA is simulated: a transfer completes when the test says so, from an interrupt.
+
+static const UCHAR *dma_data;
+static UINT dma_length;
+static char sink[4096];
+static UINT sink_length;
+static const char *isr_text; // written from an interrupt when the next transfer starts
+
+static UINT isr_write(const char *s) {
+    stub_isr_enter();
+    UINT r = console_buffer_write((const UCHAR *)s, strlen(s));
+    stub_isr_exit();
+    return r;
+}
+
+static void start_tx(const UCHAR *data, UINT length) {
+    CHECK_EQ(dma_length, 0);
+    dma_data = data;
+    dma_length = length;
+    if (isr_text) {
+        const char *s = isr_text;
+        isr_text = NULL;
+        // in the middle of a write; nothing is added
+        CHECK_EQ(isr_write(s), 0);
+    }
+}
+
+static void dma_complete(void) {
+    if (!dma_length)
+        return;
+    memcpy(sink + sink_length, dma_data, dma_length);
+    sink_length += dma_length;
+    dma_length = 0;
+    stub_isr_enter();
+    console_buffer_tx_done();
+    stub_isr_exit();
+}
+
+static void dma_drain(void) {
+    while (dma_length)
+        dma_complete();
+}
+
+static UINT write_str(const char *s) {
+    return console_buffer_write((const UCHAR *)s, strlen(s));
+}
+
+static void check_sink(const char *expected) {
+    dma_drain();
+    CHECK_EQ(sink_length, strlen(expected));
+    CHECK(sink_length == strlen(expected) && memcmp(sink, expected, sink_length) == 0);
+    sink_length = 0;
+}
+
+int main(void) {
+    char fill[CONSOLE_BUFFER_SIZE];
+    char expected[2 * CONSOLE_BUFFER_SIZE];
+
+    console_buffer_init(start_tx);
+
+    // before the kernel: no thread, no mutex
+    CHECK_EQ(write_str("boot "), 5);
+    check_sink("boot ");
+
+    stub_kernel_start();
+    CHECK_EQ(write_str("thread "), 7);
+    CHECK_EQ(isr_write("isr "), 4);
+    check_sink("thread isr ");
+
+    // an interrupt in the middle of a thread's write is dropped
+    isr_text = "late";
+    CHECK_EQ(write_str("first "), 6);
+    CHECK_EQ(console_buffer_dropped(), 4);
+    check_sink("first ");
+
+    // with the buffer full, an interrupt doesn't wait for room, even with the BLOCK policy
+    memset(fill, 'x', sizeof(fill));
+    CHECK_EQ(console_buffer_write((const UCHAR *)fill, CONSOLE_BUFFER_SIZE - 1),
+             CONSOLE_BUFFER_SIZE - 1);
+    CHECK_EQ(isr_write("full"), 0);
+    CHECK_EQ(console_buffer_dropped(), 8);
+    dma_drain();
+    sink_length = 0;
+
+    // a thread does wait, and carries on as the DMA makes room; the output wraps around
+    stub_on_semaphore_wait = dma_complete;
+    for (int i = 0; i < (int)sizeof(expected); ++i)
+        expected[i] = 'a' + i % 26;
+    CHECK_EQ(console_buffer_write((const UCHAR *)expected, sizeof(expected)), sizeof(expected));
+    CHECK(stub_semaphore_waits > 0);
+    dma_drain();
+    CHECK_EQ(sink_length, sizeof(expected));
+    CHECK(memcmp(sink, expected, sizeof(expected)) == 0);
+    sink_length = 0;
+
+    CHECK_EQ(console_buffer_dropped(), 8);
+    CHECK_EQ(stub_isr_blocking_calls, 0);
+    CHECK_EQ(stub_irq_disabled, 0);
+
+    return test_done("console_buffer");
+}
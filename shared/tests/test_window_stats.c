@@ -0,0 +1,124 @@
+#include "test.h"
+#include "window_stats.h"
+
+#include <math.h>
+
+// The window statistics the AZ3166 telemetry is built from.
+
+static bool near(float a, float b) {
+    return fabsf(a - b) <= 1e-4f * (fabsf(b) > 1 ? fabsf(b) : 1);
+}
+
+static void test_empty(void) {
+    WINDOW_STATS w;
+    WINDOW_SUMMARY s = {.count = 42, .min = 1, .max = 2, .mean = 3, .rms = 4};
+
+    window_stats_reset(&w);
+    CHECK(!window_stats_summary(&w, &s));
+    CHECK(!window_stats_take(&w, &s));
+    // left alone
+    CHECK_EQ(s.count, 42);
+    CHECK(s.min == 1 && s.max == 2 && s.mean == 3 && s.rms == 4);
+
+    // NaN only is still empty
+    window_stats_add(&w, NAN);
+    CHECK(!window_stats_summary(&w, &s));
+    CHECK_EQ(s.count, 42);
+}
+
+static void test_values(void) {
+    WINDOW_STATS w;
+    WINDOW_SUMMARY s;
+
+    window_stats_reset(&w);
+    window_stats_add(&w, 3);
+    window_stats_add(&w, -4);
+    window_stats_add(&w, 5);
+    window_stats_add(&w, 0);
+    CHECK(window_stats_summary(&w, &s));
+    CHECK_EQ(s.count, 4);
+    CHECK(s.min == -4 && s.max == 5);
+    CHECK(near(s.mean, 1));
+    // sqrt((9 + 16 + 25) / 4)
+    CHECK(near(s.rms, sqrtf(12.5f)));
+
+    // a single negative value: it's both the min and the max, the RMS is its magnitude
+    window_stats_reset(&w);
+    window_stats_add(&w, -2.5f);
+    CHECK(window_stats_summary(&w, &s));
+    CHECK_EQ(s.count, 1);
+    CHECK(s.min == -2.5f && s.max == -2.5f);
+    CHECK(near(s.mean, -2.5f));
+    CHECK(near(s.rms, 2.5f));
+
+    // all negative: the max isn't stuck at the initial 0
+    window_stats_reset(&w);
+    window_stats_add(&w, -7);
+    window_stats_add(&w, -1);
+    CHECK(window_stats_summary(&w, &s));
+    CHECK(s.min == -7 && s.max == -1);
+}
+
+static void test_nan(void) {
+    WINDOW_STATS w;
+    WINDOW_SUMMARY s;
+
+    window_stats_reset(&w);
+    window_stats_add(&w, NAN);
+    window_stats_add(&w, 2);
+    window_stats_add(&w, NAN);
+    window_stats_add(&w, 4);
+    window_stats_add(&w, -NAN);
+    CHECK(window_stats_summary(&w, &s));
+    CHECK_EQ(s.count, 2);
+    CHECK(s.min == 2 && s.max == 4);
+    CHECK(near(s.mean, 3));
+    CHECK(near(s.rms, sqrtf(10)));
+    CHECK(!isnan(s.mean) && !isnan(s.rms));
+}
+
+static void test_take(void) {
+    WINDOW_STATS w;
+    WINDOW_SUMMARY s;
+
+    window_stats_reset(&w);
+    window_stats_add(&w, 10);
+    window_stats_add(&w, 20);
+    CHECK(window_stats_take(&w, &s));
+    CHECK_EQ(s.count, 2);
+    CHECK(near(s.mean, 15));
+
+    // the next window starts empty, and doesn't remember the previous min and max
+    CHECK(!window_stats_summary(&w, &s));
+    window_stats_add(&w, 12);
+    CHECK(window_stats_take(&w, &s));
+    CHECK_EQ(s.count, 1);
+    CHECK(s.min == 12 && s.max == 12);
+    CHECK(near(s.mean, 12));
+    CHECK(!window_stats_take(&w, &s));
+}
+
+static void test_long_window(void) {
+    WINDOW_STATS w;
+    WINDOW_SUMMARY s;
+
+    // a day at the AZ3166 sampling rate, around a large offset: the sums are doubles, so the
+    // mean doesn't drift like it would with float
+    window_stats_reset(&w);
+    for (int i = 0; i < 2 * 86400; ++i)
+        window_stats_add(&w, 1000.0f + (i & 1 ? 0.5f : -0.5f));
+    CHECK(window_stats_summary(&w, &s));
+    CHECK_EQ(s.count, 2 * 86400);
+    CHECK(s.min == 999.5f && s.max == 1000.5f);
+    CHECK(near(s.mean, 1000));
+    CHECK(near(s.rms, sqrtf(1000.0f * 1000.0f + 0.25f)));
+}
+
+int main(void) {
+    test_empty();
+    test_values();
+    test_nan();
+    test_take();
+    test_long_window();
+    return test_done("window_stats");
+}
@@ -0,0 +1,97 @@
+# Copyright (c) Microsoft Corporation.
+# Licensed under the MIT License.
+
+"""Decode binary DMESG records from a device console log.
+
+Built with JD_DMESG_BINARY and JD_DMESG_HOST_DECODE, the device prints DMESG() calls as
+"#B <hex>" lines holding the format string address, a timestamp and the raw arguments
+(see dmesg.c). This looks the format strings up in the firmware ELF and formats the lines;
+all other lines are passed through unchanged.
+
+Usage: python dmesg-decode.py firmware.elf [console.log]
+Reads the log from stdin when no file is given. Needs pyelftools.
+"""
+
+import re
+import struct
+import sys
+
+from elftools.elf.elffile import ELFFile
+
+CONV_RE = re.compile(r"%([-0-9]*)([a-zA-Z%])")
+MAX_FORMAT = 256
+
+
+class Strings:
+    def __init__(self, path):
+        self.sections = []
+        with open(path, "rb") as f:
+            elf = ELFFile(f)
+            for sec in elf.iter_sections():
+                if sec["sh_type"] == "SHT_PROGBITS" and sec["sh_addr"] and sec["sh_size"]:
+                    self.sections.append((sec["sh_addr"], sec.data()))
+
+    def get(self, addr):
+        for start, data in self.sections:
+            if start <= addr < start + len(data):
+                off = addr - start
+                end = data.find(b"\0", off, off + MAX_FORMAT)
+                if end < 0:
+                    end = off + MAX_FORMAT
+                return data[off:end].decode("utf-8", "replace")
+        return None
+
+
+def format_record(strings, rec):
+    fmt_addr, micros = struct.unpack_from("<II", rec, 4)
+    fmt = strings.get(fmt_addr)
+    if fmt is None:
+        return "[unknown format at 0x%08x] %s" % (fmt_addr, rec.hex())
+    pos = 12
+
+    def conv(m):
+        nonlocal pos
+        flags, c = m.group(1), m.group(2)
+        if c == "%":
+            return "%"
+        if c == "s":
+            n = rec[pos]
+            s = rec[pos + 1 : pos + 1 + n].decode("utf-8", "replace")
+            pos += 1 + n
+            return s
+        (v,) = struct.unpack_from("<I", rec, pos)
+        pos += 4
+        # same as codal_vdmesg(), see dmesg.h
+        if c == "d":
+            return str(v - (1 << 32) if v & 0x80000000 else v)
+        if c == "u":
+            return str(v)
+        if c == "c":
+            return chr(v & 0xFF)
+        if c == "x":
+            return "0x%x" % v
+        # %X, %p
+        return "0x%08x" % v
+
+    text = CONV_RE.sub(conv, fmt)
+    return "%d.%03d %s" % (micros // 1000000, micros // 1000 % 1000, text)
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__)
+        sys.exit(1)
+    strings = Strings(sys.argv[1])
+    inp = open(sys.argv[2], "r", errors="replace") if len(sys.argv) > 2 else sys.stdin
+    for line in inp:
+        line = line.rstrip("\r\n")
+        if line.startswith("#B "):
+            try:
+                line = format_record(strings, bytes.fromhex(line[3:].strip()))
+            except (ValueError, IndexError, struct.error):
+                pass
+        print(line, flush=True)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,126 @@
+# Copyright (c) Microsoft Corporation.
+# Licensed under the MIT License.
+
+"""Capture DMESG output from the Jacdac USB link.
+
+Built with JD_USB_DMESG, the device sends DMESG records over USB CDC, between Jacdac frames
+(see usbd_cdc_if.c):
+    0xFE 'D' <record> 0xFE
+where 0xFE and 0xFF bytes in the record are sent as 0xFF (byte ^ 0x20). This extracts the
+records from the stream and prints them; Jacdac frames are skipped, or written raw to a
+file with --jacdac. Binary records (JD_DMESG_BINARY) are formatted like dmesg-decode.py
+does, which needs the firmware ELF.
+
+Usage: python usb-dmesg.py [--elf firmware.elf] [--jacdac out.bin] /dev/ttyACM0 | capture.bin
+Reading a serial port needs pyserial; pyelftools is needed with --elf.
+"""
+
+import argparse
+import importlib.util
+import os
+import struct
+import sys
+
+BREAK = 0xFE
+ESCAPE = 0xFF
+DMESG_FRAME = ord("D")
+
+
+def load_decoder():
+    path = os.path.join(os.path.dirname(os.path.abspath(__file__)), "dmesg-decode.py")
+    spec = importlib.util.spec_from_file_location("dmesg_decode", path)
+    mod = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(mod)
+    return mod
+
+
+class Demux:
+    def __init__(self, on_record, jacdac_out):
+        self.on_record = on_record
+        self.jacdac_out = jacdac_out
+        self.rec = None  # bytearray while inside a DMESG frame
+        self.after_break = False
+        self.escape = False
+
+    def feed(self, data):
+        jd = bytearray()
+        for b in data:
+            if self.rec is not None:
+                if b == BREAK:
+                    self.on_record(bytes(self.rec))
+                    self.rec = None
+                elif self.escape:
+                    self.rec.append(b ^ 0x20)
+                    self.escape = False
+                elif b == ESCAPE:
+                    self.escape = True
+                else:
+                    self.rec.append(b)
+            elif self.after_break:
+                self.after_break = False
+                if b == DMESG_FRAME:
+                    self.rec = bytearray()
+                    self.escape = False
+                else:
+                    jd.append(BREAK)
+                    jd.append(b)
+            elif b == BREAK:
+                self.after_break = True
+            else:
+                jd.append(b)
+        if self.jacdac_out and jd:
+            self.jacdac_out.write(jd)
+
+
+def open_input(path):
+    if os.path.isfile(path):
+        f = open(path, "rb")
+        return lambda: f.read(4096)
+    import serial
+
+    port = serial.Serial(path, timeout=0.1)
+    return lambda: port.read(4096) or b""
+
+
+def main():
+    ap = argparse.ArgumentParser(description="Capture DMESG records from the Jacdac USB link.")
+    ap.add_argument("--elf", help="firmware ELF, to format binary records")
+    ap.add_argument("--jacdac", help="write the Jacdac part of the stream to this file")
+    ap.add_argument("input", help="serial port, or a raw capture of the stream")
+    args = ap.parse_args()
+
+    strings = None
+    decoder = None
+    if args.elf:
+        decoder = load_decoder()
+        strings = decoder.Strings(args.elf)
+
+    def on_record(rec):
+        if rec[:1] == b"\0":
+            if strings is None:
+                line = "#B " + rec.hex()
+            else:
+                try:
+                    line = decoder.format_record(strings, rec)
+                except (IndexError, ValueError, struct.error):
+                    line = "[bad record] " + rec.hex()
+        else:
+            line = rec.decode("utf-8", "replace").rstrip("\r\n")
+        print(line, flush=True)
+
+    jacdac_out = open(args.jacdac, "wb") if args.jacdac else None
+    demux = Demux(on_record, jacdac_out)
+    read = open_input(args.input)
+    is_file = os.path.isfile(args.input)
+    try:
+        while True:
+            data = read()
+            if not data and is_file:
+                break
+            demux.feed(data)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()